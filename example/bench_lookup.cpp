@@ -0,0 +1,107 @@
+// Multi-threaded point lookups with the system or the pool allocator.
+// Usage: bench_lookup [system|pool] [threads] [seconds]
+// Run once per allocator: sq3pp::configure() only works before the first open.
+
+#include <sq3pp/Database.h>
+#include <sq3pp/Statement.h>
+#include <sq3pp/Transaction.h>
+#include <sq3pp/Exception.h>
+#include <sq3pp/Config.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+static const char* DB_FILE = "bench_lookup.db";
+static const int ROWS = 100000;
+
+static void populate() {
+    sq3pp::Database db(DB_FILE);
+    db.execute("PRAGMA journal_mode=WAL;");
+    db.execute("CREATE TABLE IF NOT EXISTS people (id INTEGER PRIMARY KEY, name TEXT, age INTEGER);");
+    int existing = 0;
+    db.execute("SELECT count(*) FROM people;", [&existing](sq3pp::Row& row){
+        existing = row[0].valueAs<int>();
+    });
+    if(existing >= ROWS){
+        return;
+    }
+    sq3pp::Transaction t = db.beginTransaction();
+    sq3pp::Statement insert = db.createStatement("INSERT OR REPLACE INTO people (id, name, age) VALUES (?, ?, ?);");
+    for(int i = 0; i < ROWS; ++i){
+        insert.reset();
+        insert.bind(i).bind("person-" + std::to_string(i)).bind(18 + i % 60);
+        insert.execute();
+    }
+    t.commit();
+}
+
+int main(int argc, char* argv[]) {
+    bool pool = argc > 1 && std::strcmp(argv[1], "pool") == 0;
+    int threads = argc > 2 ? std::atoi(argv[2]) : static_cast<int>(std::thread::hardware_concurrency());
+    int seconds = argc > 3 ? std::atoi(argv[3]) : 3;
+    if(threads <= 0) threads = 1;
+
+    try{
+        sq3pp::Configuration config;
+        config.threading = sq3pp::ThreadingMode::MULTI_THREAD;
+        config.memoryStatus = false;
+        config.allocator = pool ? sq3pp::Allocator::POOL : sq3pp::Allocator::SYSTEM;
+        sq3pp::configure(config);
+
+        populate();
+    }catch(const sq3pp::DatabaseException& ex){
+        std::cerr << "Database error (" << static_cast<int>(ex.code()) << "): " << ex.what() << std::endl;
+        return static_cast<int>(ex.code());
+    }
+
+    std::atomic<bool> stop(false);
+    std::atomic<long long> total(0);
+    std::vector<std::thread> workers;
+    for(int t = 0; t < threads; ++t){
+        workers.emplace_back([&stop, &total, t](){
+            // One connection per thread (MULTI_THREAD mode)
+            sq3pp::Database db(DB_FILE);
+            sq3pp::Statement lookup = db.createStatement("SELECT name, age FROM people WHERE id = ?;");
+            std::mt19937 rng(static_cast<unsigned>(t));
+            std::uniform_int_distribution<int> dist(0, ROWS - 1);
+            long long count = 0;
+            std::size_t checksum = 0;
+            while(!stop.load(std::memory_order_relaxed)){
+                lookup.reset();
+                lookup.bind(dist(rng));
+                lookup.execute([&checksum](sq3pp::Row& row){
+                    checksum += row["name"].valueAs<std::string>().size();
+                });
+                ++count;
+            }
+            total += count;
+            if(checksum == 0){
+                std::cerr << "no rows found" << std::endl;
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for(std::thread& worker : workers){
+        worker.join();
+    }
+
+    std::cout << (pool ? "pool" : "system") << " allocator, " << threads << " threads: "
+              << total / seconds << " lookups/s" << std::endl;
+    if(pool){
+        sq3pp::AllocatorStats stats = sq3pp::allocatorStats();
+        std::cout << "allocations: " << stats.allocations
+                  << ", cache hits: " << stats.cacheHits
+                  << ", cache misses: " << stats.cacheMisses
+                  << ", large: " << stats.largeAllocations
+                  << ", in use: " << stats.bytesInUse << " bytes" << std::endl;
+    }
+    return 0;
+}
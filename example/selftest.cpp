@@ -0,0 +1,427 @@
+#include <sq3pp/BulkLoadSession.h>
+#include <sq3pp/ChangeFeed.h>
+#include <sq3pp/Checkpointer.h>
+#include <sq3pp/Config.h>
+#include <sq3pp/Database.h>
+#include <sq3pp/MergeSession.h>
+#include <sq3pp/QueryCache.h>
+#include <sq3pp/Session.h>
+#include <sq3pp/ShardedDatabase.h>
+#include <sq3pp/Statement.h>
+#include <sq3pp/StatementRegistry.h>
+#include <sq3pp/Stats.h>
+#include <sq3pp/Exporter.h>
+#include <sq3pp/Importer.h>
+#include <sq3pp/Exception.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Checks run by `make check`; exits non-zero if any fails
+
+static int failures = 0;
+
+static void expect(bool condition, const std::string& what) {
+    if(!condition){
+        std::cerr << "FAIL: " << what << std::endl;
+        ++failures;
+    }
+}
+
+static int64_t count(sq3pp::Database& db, const std::string& sql) {
+    return db.queryOne<int64_t>(sql).value_or(-1);
+}
+
+// Every size up to the largest pooled one must get a block of its size
+// class: at least that big, and at most one class step (a quarter) larger
+static void checkPoolAllocator() {
+    for(int n = 1; n <= 16384; ++n){
+        void* p = sqlite3_malloc(n);
+        if(!p){
+            expect(false, "pool allocation of " + std::to_string(n) + " bytes");
+            return;
+        }
+        std::memset(p, 0xA5, static_cast<std::size_t>(n));
+        sqlite3_uint64 size = sqlite3_msize(p);
+        sqlite3_free(p);
+        if(size < static_cast<sqlite3_uint64>(n) || size > static_cast<sqlite3_uint64>(n + n / 4 + 16)){
+            expect(false, "pool block of " + std::to_string(size) + " bytes for " + std::to_string(n));
+            return;
+        }
+    }
+}
+
+// Record changes on one file and replay them on another
+static void checkChangesetRoundTrip(const std::string& source, const std::string& target) {
+    if(!sq3pp::Changeset::isAvailable()){
+        std::cout << "SKIP: SQLite built without the session extension" << std::endl;
+        return;
+    }
+    const std::string schema = "CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT, qty INTEGER);";
+    sq3pp::Database a;
+    sq3pp::Database b;
+    expect(a.open(source) == SQLITE_OK && b.open(target) == SQLITE_OK, "open changeset files");
+    for(sq3pp::Database* db : {&a, &b}){
+        db->execute(schema);
+        db->execute("INSERT INTO items VALUES (1, 'bolt', 10), (2, 'nut', 20), (3, 'washer', 30);");
+    }
+
+    sq3pp::Changeset changes;
+    {
+        sq3pp::Session session = a.trackChanges({"items"});
+        a.execute("INSERT INTO items VALUES (4, 'screw', 40);");
+        a.execute("UPDATE items SET qty = 11 WHERE id = 1;");
+        a.execute("DELETE FROM items WHERE id = 2;");
+        changes = session.changeset();
+    }
+    expect(!changes.empty(), "changeset records the changes");
+
+    changes.apply(b);
+    const std::string contents = "SELECT group_concat(id || ':' || name || ':' || qty, ',') FROM (SELECT * FROM items ORDER BY id);";
+    expect(a.queryOne<std::string>(contents) == b.queryOne<std::string>(contents), "changeset applied to the other file");
+
+    changes.invert().apply(b);
+    expect(b.queryOne<std::string>(contents) == std::string("1:bolt:10,2:nut:20,3:washer:30"), "inverted changeset undoes it");
+}
+
+// Reads inside a transaction see its writes and are not cached past a rollback
+static void checkQueryCacheTransaction(sq3pp::Database& db) {
+    db.execute("CREATE TABLE cached (id INTEGER PRIMARY KEY);");
+    sq3pp::QueryCache cache(db);
+    const std::string sql = "SELECT count(*) FROM cached;";
+    expect(cache.query(sql)->rows[0][0].valueAs<int64_t>() == 0, "empty table through the cache");
+
+    db.execute("BEGIN;");
+    db.execute("INSERT INTO cached VALUES (1);");
+    expect(cache.query(sql)->rows[0][0].valueAs<int64_t>() == 1, "cache sees the transaction's own write");
+    db.execute("ROLLBACK;");
+    expect(cache.query(sql)->rows[0][0].valueAs<int64_t>() == 0, "cache forgets a rolled back write");
+}
+
+// DELETE without WHERE invalidates too, and an application authorizer
+// keeps working next to the cache's own table tracking
+static void checkQueryCacheTruncate(sq3pp::Database& db) {
+    db.execute("CREATE TABLE truncated (id INTEGER PRIMARY KEY);");
+    db.execute("INSERT INTO truncated VALUES (1), (2);");
+    int denied = 0;
+    db.setAuthorizer([&denied](int action, const char* table, const char*, const char*, const char*){
+        if(action == SQLITE_INSERT && table && std::strcmp(table, "truncated") == 0){
+            ++denied;
+            return SQLITE_DENY;
+        }
+        return SQLITE_OK;
+    });
+    sq3pp::QueryCache cache(db);
+    const std::string sql = "SELECT count(*) FROM truncated;";
+    expect(cache.query(sql)->rows[0][0].valueAs<int64_t>() == 2, "table through the cache");
+    db.execute("DELETE FROM truncated;");
+    expect(cache.query(sql)->rows[0][0].valueAs<int64_t>() == 0, "DELETE without WHERE invalidates the cache");
+
+    bool failed = false;
+    try{
+        db.execute("INSERT INTO truncated VALUES (3);");
+    } catch(const sq3pp::DatabaseException&) {
+        failed = true;
+    }
+    expect(failed && denied == 1, "application authorizer still applies");
+    db.setAuthorizer(nullptr);
+}
+
+// Rows undone by ROLLBACK TO or by a failed statement are not reported
+static void checkChangeFeedRollbacks(sq3pp::Database& db) {
+    db.execute("CREATE TABLE fed (id INTEGER PRIMARY KEY);");
+    std::vector<int64_t> rowids;
+    int id = db.changeFeed().subscribe([&rowids](const sq3pp::ChangeFeed::Batch& batch){
+        for(const sq3pp::ChangeFeed::Event& event : batch){
+            rowids.push_back(event.rowid);
+        }
+    });
+    db.execute("BEGIN;");
+    db.execute("INSERT INTO fed VALUES (1);");
+    db.execute("SAVEPOINT \"Inner\"; INSERT INTO fed VALUES (2); ROLLBACK TO inner; RELEASE inner;");
+    try{
+        db.execute("INSERT INTO fed VALUES (3), (1);");
+    } catch(const sq3pp::DatabaseException&) {
+        // Duplicate key, the row 3 is undone
+    }
+    db.execute("COMMIT;");
+    db.changeFeed().unsubscribe(id);
+    expect(rowids == std::vector<int64_t>{1}, "change feed reports only the committed row");
+}
+
+// A Statement that outlives its Database still lets the connection close:
+// the last connection to a WAL database removes the -wal file
+static void checkStatementOutlivesDatabase(const std::string& path) {
+    {
+        sq3pp::Statement stmt;
+        {
+            sq3pp::Database db;
+            expect(db.open(path) == SQLITE_OK, "open WAL file");
+            db.execute("PRAGMA journal_mode = WAL; CREATE TABLE kept (id INTEGER PRIMARY KEY); INSERT INTO kept VALUES (1);");
+            stmt = db.createStatement("SELECT id FROM kept;");
+        }
+        expect(stmt.isValid(), "statement valid after its database");
+    }
+    expect(!std::ifstream(path + "-wal").good(), "connection closed with the last statement");
+    std::remove(path.c_str());
+}
+
+// The checkpointer gives back the auto-checkpoint setting it found
+static void checkCheckpointerRestore(const std::string& path) {
+    {
+        sq3pp::Database db;
+        expect(db.open(path) == SQLITE_OK, "open checkpointed file");
+        db.execute("PRAGMA journal_mode = WAL; PRAGMA wal_autocheckpoint = 250;");
+        {
+            sq3pp::Checkpointer checkpointer(db);
+            expect(count(db, "PRAGMA wal_autocheckpoint;") == 0, "auto-checkpoint off while running");
+        }
+        expect(count(db, "PRAGMA wal_autocheckpoint;") == 250, "auto-checkpoint restored");
+    }
+    std::remove(path.c_str());
+}
+
+// Closing the database under a running sampler stops it with an error
+static void checkSamplerOutlivesClose() {
+    sq3pp::Database db;
+    expect(db.open(":memory:") == SQLITE_OK, "open sampled database");
+    sq3pp::StatsSampler sampler(db, std::chrono::milliseconds(1), nullptr);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    db.close();
+    for(int i = 0; i < 1000 && sampler.error().empty(); ++i){
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    expect(!sampler.error().empty(), "sampler stops once the database is closed");
+}
+
+// Rows written by triggers are not counted as changed by a script
+static void checkScriptChanges(sq3pp::Database& db) {
+    db.execute("CREATE TABLE counted (id INTEGER PRIMARY KEY);"
+               "CREATE TABLE counted_log (id INTEGER);"
+               "CREATE TRIGGER counted_delete AFTER DELETE ON counted BEGIN INSERT INTO counted_log VALUES (old.id); END;");
+    int changes = db.execute("INSERT INTO counted VALUES (1), (2), (3); DELETE FROM counted WHERE id < 3; SELECT 1;");
+    expect(changes == 5, "script changes exclude trigger rows");
+}
+
+// A hook running the same SQL as the exec() it interrupts
+static void checkReentrantExec(sq3pp::Database& db) {
+    const std::string insert = "INSERT INTO reentrant (v) VALUES (?1);";
+    db.execute("CREATE TABLE reentrant (v INTEGER);");
+    bool inside = false;
+    db.setStatementHook([&](const char* sql){
+        if(!inside && insert == sql){
+            inside = true;
+            db.exec(insert, 2);
+            inside = false;
+        }
+    });
+    int changes = db.exec(insert, 1);
+    db.setStatementHook(nullptr);
+    expect(changes == 1, "outer exec counts its own row");
+    expect(count(db, "SELECT count(*) FROM reentrant WHERE v = 1;") == 1, "outer exec keeps its binding");
+    expect(count(db, "SELECT count(*) FROM reentrant WHERE v = 2;") == 1, "hook exec runs");
+}
+
+// Prepared statements looked up by name after their registry is gone
+static void checkPreparedOutlivesRegistry(sq3pp::Database& db) {
+    sq3pp::StatementRegistry::Prepared statements;
+    bool misuse = false;
+    try{
+        statements.get("answer");
+    } catch(const sq3pp::DatabaseException& e) {
+        misuse = e.code() == sq3pp::SQ3::MISUSE;
+    }
+    expect(misuse, "unprepared lookup by name is a misuse");
+    {
+        sq3pp::StatementRegistry registry;
+        registry.add("answer", "SELECT 42;");
+        statements = registry.prepare(db);
+    }
+    int64_t answer = 0;
+    statements.get("answer").execute([&](sq3pp::Row& row){ answer = row[0].valueAs<int64_t>(); });
+    expect(answer == 42, "lookup by name outlives the registry");
+}
+
+// Keys SQLite compares equal go to the same shard
+static void checkShardKeyHash() {
+    using sq3pp::ShardedDatabase;
+    using sq3pp::CellValue;
+    expect(ShardedDatabase::defaultHash(CellValue(int64_t(5))) == ShardedDatabase::defaultHash(CellValue(5.0)), "5 and 5.0 hash alike");
+    expect(ShardedDatabase::defaultHash(CellValue(int64_t(-7))) == ShardedDatabase::defaultHash(CellValue(-7.0)), "-7 and -7.0 hash alike");
+    expect(ShardedDatabase::defaultHash(CellValue(int64_t(5))) != ShardedDatabase::defaultHash(CellValue(5.5)), "5 and 5.5 hash apart");
+}
+
+// Two merges open at once, one finished and the other aborted, in both orders
+static void checkInterleavedMerges(sq3pp::Database& db) {
+    db.execute("CREATE TABLE merged (id INTEGER PRIMARY KEY, source TEXT);");
+    for(int finishFirst = 0; finishFirst < 2; ++finishFirst){
+        db.execute("DELETE FROM merged;");
+        sq3pp::MergeSession first = db.beginMerge("merged", {"id"});
+        sq3pp::MergeSession second = db.beginMerge("merged", {"id"});
+        first.add({1, "first"});
+        second.add({2, "second"});
+        if(finishFirst){
+            first.finish();
+            second.abort();
+        }else{
+            second.finish();
+            first.abort();
+        }
+        std::string kept = finishFirst ? "first" : "second";
+        expect(count(db, "SELECT count(*) FROM merged WHERE source = '" + kept + "';") == 1, "finished merge of " + kept + " is kept");
+        expect(count(db, "SELECT count(*) FROM merged;") == 1, "aborted merge writes nothing");
+        expect(count(db, "SELECT count(*) FROM temp.sqlite_master;") == 0, "staging tables are dropped");
+        expect(sqlite3_get_autocommit(db.getHandle()) != 0, "no savepoint left open");
+    }
+}
+
+// Rows deleted by triggers are not counted as deleted by the merge
+static void checkMergeDeletedWithTriggers(sq3pp::Database& db) {
+    db.execute("CREATE TABLE synced (id INTEGER PRIMARY KEY, name TEXT);"
+               "CREATE TABLE synced_log (id INTEGER);"
+               "CREATE TRIGGER synced_delete AFTER DELETE ON synced BEGIN INSERT INTO synced_log VALUES (old.id); END;"
+               "INSERT INTO synced VALUES (1, 'a'), (2, 'b'), (3, 'c');");
+    sq3pp::MergeOptions options;
+    options.deleteMissing = true;
+    sq3pp::MergeResult result = db.merge("synced", {"id"}, {{1, "a"}}, options);
+    expect(result.deleted == 2, "merge counts the rows it deleted, " + std::to_string(result.deleted));
+    expect(count(db, "SELECT count(*) FROM synced_log;") == 2, "trigger ran for each deleted row");
+}
+
+// A batch whose COMMIT fails is rolled back, not left open
+static void checkImportFailedCommit(sq3pp::Database& db) {
+    db.execute("PRAGMA foreign_keys = ON;"
+               "CREATE TABLE parents (id INTEGER PRIMARY KEY);"
+               "CREATE TABLE children (id INTEGER, parent INTEGER REFERENCES parents (id) DEFERRABLE INITIALLY DEFERRED);");
+    const std::string csv = "id,parent\n1,42\n";
+    bool failed = false;
+    try{
+        sq3pp::Importer(db, "children").importBuffer(csv.data(), csv.size());
+    } catch(const sq3pp::DatabaseException&) {
+        failed = true;
+    }
+    expect(failed, "import fails on a deferred foreign key");
+    expect(sqlite3_get_autocommit(db.getHandle()) != 0, "failed import batch is rolled back");
+    expect(count(db, "SELECT count(*) FROM children;") == 0, "failed import batch leaves no rows");
+    db.execute("PRAGMA foreign_keys = OFF;");
+}
+
+// Indexes dropped by a bulk load that never finished are rebuilt from
+// their record in the database
+static void checkBulkLoadRecovery(const std::string& path) {
+    {
+        sq3pp::Database db;
+        expect(db.open(path) == SQLITE_OK, "open bulk load file");
+        db.execute("CREATE TABLE loaded (id INTEGER PRIMARY KEY, name TEXT); CREATE INDEX loaded_name ON loaded (name);");
+        // Leaked on purpose: the session never finishes, as if the process died
+        new sq3pp::BulkLoadSession(db.beginBulkLoad({"loaded"}));
+        expect(count(db, "SELECT count(*) FROM sqlite_master WHERE name = 'loaded_name';") == 0, "bulk load drops the index");
+    }
+    sq3pp::Database db;
+    expect(db.open(path) == SQLITE_OK, "reopen bulk load file");
+    sq3pp::BulkLoadSession::recover(db);
+    expect(count(db, "SELECT count(*) FROM sqlite_master WHERE name = 'loaded_name';") == 1, "recover() rebuilds the index");
+    expect(count(db, "SELECT count(*) FROM sqlite_master WHERE name = 'sq3pp_bulkload_indexes';") == 0, "recover() removes its record");
+    {
+        sq3pp::BulkLoadSession session = db.beginBulkLoad({"loaded"});
+        session.finish();
+    }
+    expect(count(db, "SELECT count(*) FROM sqlite_master WHERE name IN ('loaded_name', 'sq3pp_bulkload_indexes');") == 1,
+           "finish() rebuilds the index and removes its record");
+    db.close();
+    std::remove(path.c_str());
+}
+
+static std::string readFile(const std::string& path) {
+    std::ifstream in(path);
+    std::stringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+// REAL values survive an export and import exactly, in both formats
+static void checkExportRealRoundTrip(sq3pp::Database& db, const std::string& path) {
+    db.execute("CREATE TABLE reals (v REAL); CREATE TABLE reals_csv (v REAL); CREATE TABLE reals_json (v REAL);"
+               "INSERT INTO reals VALUES (0.1 + 0.2), (5.0), (1e-300), (123456789.123456789), (-2.5e17);");
+    for(sq3pp::DataFormat format : {sq3pp::DataFormat::CSV, sq3pp::DataFormat::NDJSON}){
+        bool json = format == sq3pp::DataFormat::NDJSON;
+        sq3pp::Exporter::Options exportOptions;
+        exportOptions.format = format;
+        sq3pp::Exporter(db, exportOptions).exportFile("SELECT v FROM reals ORDER BY rowid;", path);
+        sq3pp::Importer::Options importOptions;
+        importOptions.format = format;
+        sq3pp::Importer(db, json ? "reals_json" : "reals_csv", importOptions).importFile(path);
+        std::string copy = json ? "reals_json" : "reals_csv";
+        expect(count(db, "SELECT count(*) FROM reals AS a JOIN " + copy + " AS b ON a.rowid = b.rowid"
+                         " WHERE a.v = b.v AND typeof(b.v) = 'real';") == 5, "REAL values round-trip through " + copy);
+    }
+
+    // JSON integers beyond 64 bits are kept as REAL, not saturated
+    const std::string big = "{\"v\":123456789012345678901}\n{\"v\":-123456789012345678901}\n";
+    sq3pp::Importer::Options jsonOptions;
+    jsonOptions.format = sq3pp::DataFormat::NDJSON;
+    db.execute("DELETE FROM reals_json;");
+    sq3pp::Importer(db, "reals_json", jsonOptions).importBuffer(big.data(), big.size());
+    expect(count(db, "SELECT count(*) FROM reals_json WHERE abs(v) = 123456789012345678901.0 AND typeof(v) = 'real';") == 2,
+           "overflowing JSON integers import as REAL");
+
+    sq3pp::Exporter::Options options;
+    options.format = sq3pp::DataFormat::NDJSON;
+    sq3pp::Exporter(db, options).exportFile("SELECT 1e999 AS up, -1e999 AS down;", path);
+    expect(readFile(path) == "{\"up\":\"Inf\",\"down\":\"-Inf\"}\n", "infinities are JSON strings");
+    std::remove(path.c_str());
+}
+
+int main() {
+    const std::string source = "selftest_a.db";
+    const std::string target = "selftest_b.db";
+    std::remove(source.c_str());
+    std::remove(target.c_str());
+
+    try{
+        // Before any connection is opened
+        sq3pp::Configuration config;
+        config.allocator = sq3pp::Allocator::POOL;
+        sq3pp::configure(config);
+        checkPoolAllocator();
+    checkShardKeyHash();
+
+        checkChangesetRoundTrip(source, target);
+        checkStatementOutlivesDatabase(target);
+        checkCheckpointerRestore(target);
+        checkSamplerOutlivesClose();
+        checkBulkLoadRecovery(target);
+
+        sq3pp::Database db;
+        expect(db.open(":memory:") == SQLITE_OK, "open in-memory database");
+        checkQueryCacheTransaction(db);
+        checkQueryCacheTruncate(db);
+        checkChangeFeedRollbacks(db);
+        checkScriptChanges(db);
+    checkReentrantExec(db);
+    checkPreparedOutlivesRegistry(db);
+        checkInterleavedMerges(db);
+        checkMergeDeletedWithTriggers(db);
+        checkExportRealRoundTrip(db, target);
+        checkImportFailedCommit(db);
+    } catch(const sq3pp::DatabaseException& e) {
+        std::cerr << "FAIL: " << e.what() << std::endl;
+        ++failures;
+    }
+
+    std::remove(source.c_str());
+    std::remove(target.c_str());
+    if(failures){
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,175 @@
+#ifndef SQ3PP_BINDING_H
+#define SQ3PP_BINDING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <sqlite3.h>
+
+namespace sq3pp{
+
+class CellValue;
+
+namespace detail{
+
+// Conversions between C++ values and SQLite parameters/columns, resolved at
+// compile time so typed statements bind and read without any dispatch.
+
+template<typename T>
+struct AlwaysFalse : std::false_type {};
+
+template<typename T>
+struct IsOptional : std::false_type {};
+
+template<typename T>
+struct IsOptional<std::optional<T>> : std::true_type {};
+
+// Defined in Statement.cpp, where CellValue is complete
+int bindCell(sqlite3_stmt* stmt, int index, const CellValue& value);
+CellValue columnCell(sqlite3_stmt* stmt, int column);
+
+// Bind value to the 1-based parameter index. Text and blobs are copied unless
+// lifetime is SQLITE_STATIC, in which case they must outlive the step.
+template<typename T>
+inline int bindValue(sqlite3_stmt* stmt, int index, const T& value, sqlite3_destructor_type lifetime = SQLITE_TRANSIENT) {
+    if constexpr (std::is_same_v<T, std::nullptr_t>){
+        return sqlite3_bind_null(stmt, index);
+    } else if constexpr (std::is_same_v<T, bool>){
+        return sqlite3_bind_int(stmt, index, value ? 1 : 0);
+    } else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>){
+        return sqlite3_bind_int64(stmt, index, static_cast<sqlite3_int64>(value));
+    } else if constexpr (std::is_floating_point_v<T>){
+        return sqlite3_bind_double(stmt, index, static_cast<double>(value));
+    } else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>){
+        return sqlite3_bind_text(stmt, index, value.data(), static_cast<int>(value.size()), lifetime);
+    } else if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*>){
+        return value ? sqlite3_bind_text(stmt, index, value, -1, lifetime) : sqlite3_bind_null(stmt, index);
+    } else if constexpr (std::is_array_v<T> && std::is_same_v<std::remove_extent_t<T>, char>){
+        return sqlite3_bind_text(stmt, index, value, -1, lifetime);
+    } else if constexpr (std::is_same_v<T, std::vector<uint8_t>>){
+        return sqlite3_bind_blob(stmt, index, value.data(), static_cast<int>(value.size()), lifetime);
+    } else if constexpr (IsOptional<T>::value){
+        return value ? bindValue(stmt, index, *value, lifetime) : sqlite3_bind_null(stmt, index);
+    } else if constexpr (std::is_same_v<T, CellValue>){
+        return bindCell(stmt, index, value);
+    } else {
+        static_assert(AlwaysFalse<T>::value, "Unsupported SQLite parameter type");
+        return SQLITE_MISUSE;
+    }
+}
+
+// Read the 0-based column of the current row as T
+template<typename T>
+inline T columnValue(sqlite3_stmt* stmt, int column) {
+    if constexpr (std::is_same_v<T, bool>){
+        return sqlite3_column_int(stmt, column) != 0;
+    } else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>){
+        return static_cast<T>(sqlite3_column_int64(stmt, column));
+    } else if constexpr (std::is_floating_point_v<T>){
+        return static_cast<T>(sqlite3_column_double(stmt, column));
+    } else if constexpr (std::is_same_v<T, std::string>){
+        const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, column));
+        return text ? std::string(text, sqlite3_column_bytes(stmt, column)) : std::string();
+    } else if constexpr (std::is_same_v<T, std::vector<uint8_t>>){
+        const uint8_t* data = static_cast<const uint8_t*>(sqlite3_column_blob(stmt, column));
+        return data ? std::vector<uint8_t>(data, data + sqlite3_column_bytes(stmt, column)) : std::vector<uint8_t>();
+    } else if constexpr (IsOptional<T>::value){
+        if(sqlite3_column_type(stmt, column) == SQLITE_NULL){
+            return std::nullopt;
+        }
+        return columnValue<typename T::value_type>(stmt, column);
+    } else if constexpr (std::is_same_v<T, CellValue>){
+        return columnCell(stmt, column);
+    } else {
+        static_assert(AlwaysFalse<T>::value, "Unsupported SQLite column type");
+    }
+}
+
+constexpr bool sameName(const char* sql, int a, int b, int length) {
+    for(int i = 0; i < length; ++i){
+        if(sql[a + i] != sql[b + i]) return false;
+    }
+    return true;
+}
+
+constexpr bool isNameChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'
+        || static_cast<unsigned char>(c) >= 0x80;
+}
+
+// Number of parameters SQLite will see in an SQL text, as
+// sqlite3_bind_parameter_count would report it: the largest index used,
+// where ?NNN sets the index, ? takes the next one and a repeated :name,
+// @name or $name reuses its first index. String literals, quoted
+// identifiers and comments are skipped.
+constexpr int countParameters(const char* sql) {
+    int count = 0;
+    // Named parameters seen so far, as (start, length) pairs
+    int names[2 * 64] = {};
+    int named = 0;
+    int i = 0;
+    while(sql[i] != '\0'){
+        char c = sql[i];
+        if(c == '\'' || c == '"' || c == '`' || c == '['){
+            char close = c == '[' ? ']' : c;
+            ++i;
+            while(sql[i] != '\0'){
+                if(sql[i] == close){
+                    if(close != ']' && sql[i + 1] == close){
+                        i += 2; // Doubled quote
+                        continue;
+                    }
+                    break;
+                }
+                ++i;
+            }
+            if(sql[i] != '\0') ++i;
+        } else if(c == '-' && sql[i + 1] == '-'){
+            while(sql[i] != '\0' && sql[i] != '\n') ++i;
+        } else if(c == '/' && sql[i + 1] == '*'){
+            i += 2;
+            while(sql[i] != '\0' && !(sql[i] == '*' && sql[i + 1] == '/')) ++i;
+            if(sql[i] != '\0') i += 2;
+        } else if(c == '?'){
+            ++i;
+            if(sql[i] >= '0' && sql[i] <= '9'){
+                int number = 0;
+                while(sql[i] >= '0' && sql[i] <= '9'){
+                    number = number * 10 + (sql[i] - '0');
+                    ++i;
+                }
+                if(number > count) count = number;
+            } else {
+                ++count;
+            }
+        } else if((c == ':' || c == '@' || c == '$') && isNameChar(sql[i + 1])){
+            int start = i;
+            ++i;
+            while(isNameChar(sql[i])) ++i;
+            int length = i - start;
+            bool seen = false;
+            for(int n = 0; n < named && !seen; ++n){
+                seen = names[2 * n + 1] == length && sameName(sql, names[2 * n], start, length);
+            }
+            if(!seen){
+                ++count;
+                if(named < 64){
+                    names[2 * named] = start;
+                    names[2 * named + 1] = length;
+                    ++named;
+                }
+            }
+        } else {
+            ++i;
+        }
+    }
+    return count;
+}
+
+}
+}
+#endif // SQ3PP_BINDING_H
@@ -0,0 +1,107 @@
+#ifndef SQ3PP_BULKLOADSESSION_H
+#define SQ3PP_BULKLOADSESSION_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sq3pp/Database.h>
+
+namespace sq3pp{
+
+struct BulkLoadOptions{
+    // MEMORY keeps ROLLBACK working; OFF is faster, but a failed load may
+    // then leave the database corrupt. Empty keeps the current setting.
+    std::string journalMode = "MEMORY";
+    std::string synchronous = "OFF";
+    int64_t cacheSize = -262144;    // PRAGMA cache_size (negative: KiB), 0 keeps it
+    bool dropIndexes = true;        // Drop secondary indexes now, recreate them in finish()
+    bool dropUniqueIndexes = false; // Also drop UNIQUE indexes; duplicates then only fail in finish()
+    bool analyze = true;            // ANALYZE the loaded tables in finish()
+};
+
+// Settings for loading large amounts of data into some tables. While the
+// session is open the connection journals in memory without syncing, and the
+// secondary indexes of the tables are dropped so inserts only write the table
+// b-trees. finish() builds the indexes again in one pass each, analyzes the
+// tables and restores the previous settings.
+//
+// Indexes SQLite creates itself (PRIMARY KEY, UNIQUE constraints) and, by
+// default, UNIQUE indexes are kept, so uniqueness is enforced during the load.
+// The Database must outlive the session. Loading should happen in
+// transactions that are committed before finish() is called.
+//
+// The SQL of the dropped indexes is also stored in a sq3pp_bulkload_indexes
+// table, in the transaction that drops them. If the process dies before
+// finish(), the next session on the same tables, or recover(), builds them
+// again.
+class BulkLoadSession{
+public:
+    struct Timings{
+        std::chrono::microseconds setup;    // Pragmas and dropping indexes
+        std::chrono::microseconds load;     // From the end of setup to finish()
+        std::chrono::microseconds indexes;  // Recreating indexes
+        std::chrono::microseconds analyze;
+        std::chrono::microseconds restore;
+        std::chrono::microseconds total;
+    };
+
+    BulkLoadSession(Database& db, const std::vector<std::string>& tables);
+    BulkLoadSession(Database& db, const std::vector<std::string>& tables, const BulkLoadOptions& options);
+    BulkLoadSession(const BulkLoadSession& other) = delete;
+    BulkLoadSession(BulkLoadSession&& other) noexcept;
+    BulkLoadSession& operator=(const BulkLoadSession& other) = delete;
+    BulkLoadSession& operator=(BulkLoadSession&& other) = delete;
+
+    // Finishes the session if finish() was not called, ignoring errors. A
+    // transaction still open (e.g. when unwinding from a failed load) is
+    // rolled back first, since the settings cannot be restored inside it.
+    ~BulkLoadSession();
+
+    // Recreate indexes, analyze and restore the settings. Indexes that cannot
+    // be built (e.g. UNIQUE indexes over duplicate rows) stay dropped and are
+    // reported, with their SQL, in one DatabaseException after the settings
+    // have been restored.
+    const Timings& finish();
+
+    bool isFinished() const {return _finished;}
+    const Timings& timings() const {return _timings;}
+
+    // Build the indexes recorded by sessions that did not finish, for the
+    // given tables or all of them. Must not run while a session on those
+    // tables is open. Indexes that cannot be built stay recorded and are
+    // reported in one DatabaseException.
+    static void recover(Database& db, const std::vector<std::string>& tables = {});
+
+    // Names of the indexes dropped for the load
+    std::vector<std::string> droppedIndexes() const;
+
+    // CREATE INDEX statements of the indexes finish() could not rebuild
+    const std::vector<std::string>& failedIndexes() const {return _failedIndexes;}
+
+private:
+    struct Index{
+        std::string name;
+        std::string table;
+        std::string sql;
+    };
+
+    std::string pragma(const std::string& name);
+    void restoreSettings();
+
+    Database* _db;
+    std::vector<std::string> _tables;
+    BulkLoadOptions _options;
+    std::string _journalMode;
+    std::string _synchronous;
+    std::string _cacheSize;
+    std::vector<Index> _indexes;
+    std::vector<std::string> _failedIndexes;
+    bool _finished;
+    std::chrono::steady_clock::time_point _start;
+    std::chrono::steady_clock::time_point _loadStart;
+    Timings _timings;
+};
+
+}
+#endif // SQ3PP_BULKLOADSESSION_H
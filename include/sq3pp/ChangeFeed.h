@@ -0,0 +1,86 @@
+#ifndef SQ3PP_CHANGEFEED_H
+#define SQ3PP_CHANGEFEED_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <functional>
+#include <sqlite3.h>
+
+namespace sq3pp{
+
+namespace detail{ struct ConnectionContext; }
+
+// Change notifications for a single connection.
+// Row changes reported by sqlite3_update_hook are collected while a transaction
+// is open and delivered as one batch per committed transaction, once control
+// returns to sq3pp (after Statement::execute/step, Transaction::commit or
+// Database::execute). Rolled back changes are discarded, including those
+// undone by ROLLBACK TO a savepoint or by a statement that failed inside a
+// transaction.
+//
+// While a feed exists, DELETE without WHERE removes rows one at a time (no
+// truncate optimization) so that every row is reported. Limitations
+// inherited from SQLite: changes to WITHOUT ROWID tables and writes made
+// through other connections are not reported.
+class ChangeFeed{
+public:
+    enum class Operation{
+        INSERT,
+        UPDATE,
+        DELETE
+    };
+
+    struct Event{
+        Operation op;
+        std::string database;
+        std::string table;
+        int64_t rowid;
+    };
+
+    using Batch = std::vector<Event>;
+    using Listener = std::function<void(const Batch& batch)>;
+
+    ChangeFeed(const ChangeFeed& other) = delete;
+    ChangeFeed& operator=(const ChangeFeed& other) = delete;
+    ~ChangeFeed();
+
+    // Register a listener, returns an id usable with unsubscribe()
+    int subscribe(Listener listener);
+    void unsubscribe(int id);
+
+    // Deliver committed batches to the listeners.
+    // Does nothing while a transaction is still open.
+    void deliver();
+
+private:
+    explicit ChangeFeed(sqlite3* handle);
+
+    static void onUpdate(void* data, int op, const char* dbName, const char* table, sqlite3_int64 rowid);
+    static int onCommit(void* data);
+    static void onRollback(void* data);
+
+    // Called by the connection's trace hook when a statement starts
+    void onStatement(const char* sql);
+    // Called when a step failed; drops the changes SQLite undid
+    void onStatementFailed();
+
+    sqlite3* _handle;
+    Batch _pending;
+    // Open savepoints (lower-case names) and the size of _pending when each began
+    std::vector<std::pair<std::string, std::size_t>> _savepoints;
+    std::size_t _statementStart;
+    std::vector<Batch> _committed;
+    bool _commitInFlight;
+    bool _delivering;
+    std::mutex _listenersMutex;
+    std::map<int, Listener> _listeners;
+    int _nextId;
+    friend struct detail::ConnectionContext;
+};
+
+}
+#endif // SQ3PP_CHANGEFEED_H
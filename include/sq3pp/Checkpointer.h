@@ -0,0 +1,89 @@
+#ifndef SQ3PP_CHECKPOINTER_H
+#define SQ3PP_CHECKPOINTER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <sq3pp/Database.h>
+
+namespace sq3pp{
+
+// Moves WAL checkpoints off the commit path. Automatic checkpoints of the
+// watched connection are disabled; a background thread with its own
+// connection runs PASSIVE checkpoints when the WAL grows past a threshold or
+// on a schedule, and a stronger checkpoint (TRUNCATE by default) once writes
+// have stopped for a while, so the WAL file shrinks again.
+//
+// The Database must be a WAL-mode file database that outlives the
+// checkpointer and is not moved meanwhile. The wal_autocheckpoint setting in
+// effect when it started is restored when the checkpointer is destroyed.
+class Checkpointer{
+public:
+    struct Options{
+        int frameThreshold = 1000;                      // Checkpoint once the WAL holds this many frames
+        std::chrono::milliseconds interval{1000};       // Also checkpoint a non-empty WAL this often
+        std::chrono::milliseconds idleAfter{5000};      // Escalate when no commit happened for this long
+        CheckpointMode idleMode = CheckpointMode::TRUNCATE;
+        std::chrono::milliseconds busyTimeout{100};     // How long an escalated checkpoint waits for readers
+    };
+
+    struct Report{
+        CheckpointMode mode;
+        CheckpointResult result;
+        int64_t walBytes;                       // WAL size before the checkpoint
+        std::chrono::microseconds duration;
+    };
+
+    struct Stats{
+        uint64_t checkpoints;
+        uint64_t escalations;
+        uint64_t busy;                          // Escalations that could not finish
+        int walFrames;                          // Frames reported by the latest commit
+        int64_t walBytes;
+        std::chrono::microseconds lastDuration;
+        std::chrono::microseconds maxDuration;
+        std::chrono::microseconds totalDuration;
+    };
+
+    Checkpointer(Database& db);
+    Checkpointer(Database& db, const Options& options, std::function<void(const Report& report)> onCheckpoint = nullptr);
+    Checkpointer(const Checkpointer& other) = delete;
+    Checkpointer& operator=(const Checkpointer& other) = delete;
+    ~Checkpointer();
+
+    // Wake the background thread to checkpoint now
+    void request();
+    void stop();
+
+    Stats stats() const;
+
+private:
+    void onCommit(int frames);
+    void run();
+    void checkpoint(CheckpointMode mode, int walFrames);
+
+    Database& _db;
+    Options _options;
+    std::function<void(const Report& report)> _onCheckpoint;
+    Database _checkpointDb;
+    int64_t _pageSize;
+    int _autoCheckpoint;                    // wal_autocheckpoint before the checkpointer started
+
+    mutable std::mutex _mutex;
+    std::condition_variable _wakeup;
+    bool _stopping;
+    bool _requested;
+    bool _walEmpty;
+    int _backfilled;                        // WAL frames already copied back
+    std::chrono::steady_clock::time_point _lastCommit;
+    Stats _stats;
+    std::thread _thread;
+};
+
+}
+#endif // SQ3PP_CHECKPOINTER_H
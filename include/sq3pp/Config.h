@@ -0,0 +1,59 @@
+#ifndef SQ3PP_CONFIG_H
+#define SQ3PP_CONFIG_H
+
+#include <cstdint>
+
+namespace sq3pp{
+
+enum class ThreadingMode{
+    DEFAULT,        // Keep the mode SQLite was compiled with
+    SINGLE_THREAD,
+    MULTI_THREAD,   // Connections must not be shared between threads
+    SERIALIZED
+};
+
+enum class Allocator{
+    SYSTEM,         // SQLite's default (malloc)
+    POOL            // Size-class pools with per-thread caches
+};
+
+// Process-wide SQLite settings, see sq3pp::configure()
+struct Configuration{
+    ThreadingMode threading = ThreadingMode::DEFAULT;
+    Allocator allocator = Allocator::SYSTEM;
+
+    // SQLITE_CONFIG_MEMSTATUS: track memory usage (needed by sqlite3_status).
+    // Keeping it on costs a global mutex per allocation.
+    bool memoryStatus = true;
+
+    // SQLITE_CONFIG_PAGECACHE: slots preallocated for the page cache, each
+    // slotSize bytes (page size plus a small header). 0 slots keeps the default.
+    int pageCacheSlotSize = 0;
+    int pageCacheSlots = 0;
+
+    // SQLITE_CONFIG_LOOKASIDE: default lookaside buffer of each new connection.
+    // Negative values keep the defaults.
+    int lookasideSlotSize = -1;
+    int lookasideSlots = -1;
+};
+
+// Apply process-wide settings through sqlite3_config.
+// Must be called before the first Database is opened; throws a
+// DatabaseException with SQ3::MISUSE once SQLite has been initialized.
+void configure(const Configuration& config);
+
+struct AllocatorStats{
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t reallocations;
+    int64_t bytesInUse;         // Sum of the size classes currently handed out
+    uint64_t cacheHits;         // Served from a per-thread cache
+    uint64_t cacheMisses;       // Had to refill from the shared pool or the system
+    uint64_t largeAllocations;  // Too big for the pools, passed to malloc
+};
+
+// Statistics of the POOL allocator (all zero with the SYSTEM allocator)
+AllocatorStats allocatorStats();
+
+}
+#endif // SQ3PP_CONFIG_H
@@ -2,14 +2,43 @@
 #define SQ3PP_DATABASE_H
 
 #include <string>
+#include <vector>
+#include <chrono>
 #include <memory>
 #include <functional>
+#include <optional>
 #include <sqlite3.h>
 
 namespace sq3pp{
 
 class Statement;
 class Transaction;
+class Row;
+class CellValue;
+class ChangeFeed;
+class Session;
+class Snapshot;
+class BulkLoadSession;
+struct BulkLoadOptions;
+class MergeSession;
+struct MergeOptions;
+struct MergeResult;
+struct DatabaseStats;
+
+namespace detail{ struct ConnectionContext; }
+
+enum class CheckpointMode{
+    PASSIVE,    // Copy what it can without waiting for readers or writers
+    FULL,       // Wait for writers, then copy every frame
+    RESTART,    // FULL, then wait for readers so the next writer restarts the WAL
+    TRUNCATE    // RESTART, then truncate the WAL file to zero bytes
+};
+
+struct CheckpointResult{
+    int walFrames;          // Frames in the WAL (-1 if not in WAL mode)
+    int checkpointedFrames; // Frames copied back into the database
+    bool busy;              // A FULL/RESTART/TRUNCATE could not finish
+};
 
 class Database{
 public:
@@ -27,6 +56,18 @@ public:
     int open(const char* dbName);
     int open(const std::string& dbName);
 
+    // Open with explicit sqlite3_open_v2 flags (SQLITE_OPEN_READONLY, ...)
+    // and an optional VFS name
+    int open(const std::string& dbName, int flags, const char* vfs = nullptr);
+
+    // Open a database file that nobody modifies while it is open, e.g. one
+    // built offline (URI parameter immutable=1: read-only, no locking, no
+    // change detection). Where supported, the file is memory-mapped once per
+    // process and pages are read straight from the shared mapping instead of
+    // being copied into every connection's page cache. preload asks the
+    // kernel to read the whole file ahead instead of on demand.
+    int openImmutable(const std::string& path, bool preload = false);
+
     
     inline bool isOpen() const {
         return _handle != nullptr;
@@ -34,7 +75,13 @@ public:
     
     void close();
 
-    int execute(const std::string& sql, std::function<int(void*, int, char**, char**)> callback = nullptr, void* data = nullptr);
+    // Run every statement of an SQL script in order, each prepared with
+    // sqlite3_prepare_v3. Result rows of any statement are passed to onRowFound.
+    // Returns the number of rows its INSERT, UPDATE and DELETE statements
+    // changed, without those changed by triggers or foreign key actions (as
+    // sqlite3_changes), and throws a DatabaseException carrying SQLite's
+    // error message on failure.
+    int execute(const std::string& sql, std::function<void(Row& row)> onRowFound = nullptr);
 
     //operator for if (db)
     inline explicit operator bool() const {
@@ -46,11 +93,113 @@ public:
     }
 
     Statement createStatement(const std::string& query);
+
+    // Prepare with sqlite3_prepare_v3 flags, e.g. SQLITE_PREPARE_PERSISTENT for
+    // statements kept for the lifetime of the connection
+    Statement createStatement(const std::string& query, unsigned int prepareFlags);
+
+    // Run sql with args bound to its parameters in order and return the rows
+    // changed. The prepared statement is cached per SQL text and reused.
+    template<typename... Args>
+    int exec(const std::string& sql, const Args&... args);
+
+    // First column of the first result row, or nullopt when there is no row
+    template<typename T, typename... Args>
+    std::optional<T> queryOne(const std::string& sql, const Args&... args);
     Transaction beginTransaction();
 
+    // Current state of a WAL database, to be shared with other connections.
+    // Taken inside the open transaction if there is one.
+    Snapshot snapshot(const std::string& schema = "main");
+
+    // Begin a read transaction that sees the database as of the snapshot
+    Transaction beginRead(const Snapshot& snapshot);
+
+    // Abort the statement running on this connection (sqlite3_interrupt).
+    // Safe to call from any thread while the database is open.
+    void interrupt();
+
+    // Interrupt statements still running at the given point in time; running
+    // statements fail with SQ3::TIMEOUT. Safe to call from any thread: only
+    // stores the deadline, which the progress handler installed at open checks.
+    void setDeadline(std::chrono::steady_clock::time_point deadline);
+    void setTimeout(std::chrono::milliseconds timeout);
+    void clearDeadline();
+
+    // Invoke handler every `instructions` virtual machine instructions while a
+    // statement runs (sqlite3_progress_handler). Returning false interrupts the
+    // statement. Deadlines are checked at the same interval.
+    void setProgressHandler(std::function<bool()> handler, int instructions = 1000);
+
+    // Called after each commit in WAL mode with the number of frames in the
+    // WAL (sqlite3_wal_hook). Installing a hook disables automatic checkpoints;
+    // pass nullptr to remove it.
+    void setWalHook(std::function<void(const char* schema, int frames)> hook);
+
+    // Called whenever a statement starts running on this connection, with its
+    // SQL text (sqlite3_trace_v2, SQLITE_TRACE_STMT). Statements run by
+    // triggers are reported too, their text starts with "--". Pass nullptr
+    // to remove it.
+    void setStatementHook(std::function<void(const char* sql)> hook);
+
+    // Called when a statement finishes running, with the statement and the
+    // time it took (sqlite3_trace_v2, SQLITE_TRACE_PROFILE). The statement may
+    // be inspected (sqlite3_sql, sqlite3_stmt_status) but not stepped. Pass
+    // nullptr to remove it.
+    void setProfileHook(std::function<void(sqlite3_stmt* stmt, std::chrono::nanoseconds elapsed)> hook);
+
+    // Authorize the actions of statements being prepared (sqlite3_set_authorizer):
+    // return SQLITE_OK, SQLITE_IGNORE or SQLITE_DENY. sq3pp keeps its own
+    // authorizer on the connection and calls this one from it, so use this
+    // instead of sqlite3_set_authorizer. Pass nullptr to remove it.
+    void setAuthorizer(std::function<int(int action, const char* arg1, const char* arg2,
+                                         const char* database, const char* trigger)> authorizer);
+
+    // Checkpoint after this many WAL frames (0 disables). Replaces the WAL hook.
+    void setAutoCheckpoint(int frames);
+
+    // Run a checkpoint on one schema, or on all attached ones if empty
+    // (sqlite3_wal_checkpoint_v2)
+    CheckpointResult checkpoint(CheckpointMode mode = CheckpointMode::PASSIVE, const std::string& schema = "");
+
+    // Committed row changes made through this connection (created on first use)
+    ChangeFeed& changeFeed();
+
+    // Record changes to the given tables (all tables if empty) with the session extension
+    Session trackChanges(const std::vector<std::string>& tables = {});
+
+    // Relax durability and drop the secondary indexes of tables until the
+    // returned session is finished (see BulkLoadSession)
+    BulkLoadSession beginBulkLoad(const std::vector<std::string>& tables);
+    BulkLoadSession beginBulkLoad(const std::vector<std::string>& tables, const BulkLoadOptions& options);
+
+    // Upsert rows into a table through a staging table sorted on the key
+    // columns, optionally deleting the rows not merged (see MergeSession)
+    MergeResult merge(const std::string& table, const std::vector<std::string>& keyColumns,
+                      const std::vector<std::vector<CellValue>>& rows);
+    MergeResult merge(const std::string& table, const std::vector<std::string>& keyColumns,
+                      const std::vector<std::vector<CellValue>>& rows, const MergeOptions& options);
+    MergeSession beginMerge(const std::string& table, const std::vector<std::string>& keyColumns);
+    MergeSession beginMerge(const std::string& table, const std::vector<std::string>& keyColumns, const MergeOptions& options);
+
+    // Cache, lookaside and memory counters of this connection (sqlite3_db_status).
+    // resetHighwater restarts the counters after reading them.
+    DatabaseStats stats(bool resetHighwater = false) const;
+
 private:
+    friend class QueryCache;
+    friend class StatsSampler;
+
+    // Prepared statement for sql from the connection's cache, or a temporary
+    // one while the cached statement is still held by an outer caller
+    std::shared_ptr<Statement> cachedStatement(const std::string& sql);
+
     std::shared_ptr<sqlite3> _handle;
+    std::shared_ptr<detail::ConnectionContext> _context;
 };
 
 }
-#endif // SQ3PP_DATABASE_H
\ No newline at end of file
+#endif // SQ3PP_DATABASE_H
+
+// Definitions of the Database member templates
+#include <sq3pp/Statement.h>
\ No newline at end of file
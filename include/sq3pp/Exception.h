@@ -40,6 +40,7 @@ enum class SQ3{
     DONE = 101,
 
     NOT_OPEN=2000,
+    TIMEOUT=2001,
 };
 
 class DatabaseException : public std::runtime_error{
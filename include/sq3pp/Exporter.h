@@ -0,0 +1,44 @@
+#ifndef SQ3PP_EXPORTER_H
+#define SQ3PP_EXPORTER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <sq3pp/Database.h>
+#include <sq3pp/Statement.h>
+#include <sq3pp/Importer.h>
+
+namespace sq3pp{
+
+// Writes query results as CSV or NDJSON to a file descriptor.
+// Column values are copied straight from sqlite3_column_text/blob into a
+// fixed-size output buffer, so memory use does not depend on the result size.
+// BLOBs are written as lowercase hex strings. REAL values are written with
+// enough digits to read back exactly; infinities become Inf and -Inf, as
+// strings in NDJSON.
+// In CSV, NULL is an empty field and an empty string is "", so the Importer
+// (emptyAsNull) reads both back unchanged.
+class Exporter{
+public:
+    struct Options{
+        DataFormat format = DataFormat::CSV;
+        char delimiter = ',';
+        bool header = true;             // CSV: write column names first
+        std::size_t bufferSize = 1 << 16;
+    };
+
+    explicit Exporter(Database& db);
+    Exporter(Database& db, const Options& options);
+
+    // Each call returns the number of rows written
+    std::size_t exportQuery(const std::string& sql, int fd);
+    std::size_t exportQuery(Statement& stmt, int fd);
+    std::size_t exportFile(const std::string& sql, const std::string& path);
+
+private:
+    Database& _db;
+    Options _options;
+};
+
+}
+#endif // SQ3PP_EXPORTER_H
@@ -0,0 +1,101 @@
+#ifndef SQ3PP_IMPORTER_H
+#define SQ3PP_IMPORTER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <sq3pp/Database.h>
+#include <sq3pp/Statement.h>
+
+namespace sq3pp{
+
+enum class DataFormat{
+    CSV,
+    NDJSON      // One JSON object per line
+};
+
+// Streams CSV or NDJSON data into a table through a single prepared INSERT.
+// Input is consumed in large chunks and only the row being parsed is buffered,
+// so memory use does not depend on the input size. Rows are committed in
+// batches unless a transaction is already open on the connection.
+//
+// CSV columns come from the header line, or from the table definition when
+// there is no header. NDJSON keys are matched against the table's columns and
+// unknown keys are ignored; nested objects and arrays are stored as JSON text.
+class Importer{
+public:
+    struct Options{
+        DataFormat format = DataFormat::CSV;
+        char delimiter = ',';
+        bool header = true;             // CSV: first line holds column names
+        bool emptyAsNull = true;        // CSV: unquoted empty fields become NULL
+        std::size_t batchSize = 10000;  // Rows per transaction
+        std::size_t chunkSize = 1 << 20;
+    };
+
+    Importer(Database& db, const std::string& table);
+    Importer(Database& db, const std::string& table, const Options& options);
+    Importer(const Importer& other) = delete;
+    Importer& operator=(const Importer& other) = delete;
+    ~Importer();
+
+    // Each call returns the number of rows inserted
+    std::size_t importFd(int fd);
+    std::size_t importFile(const std::string& path, bool useMmap = true);
+    std::size_t importBuffer(const char* data, std::size_t size);
+
+private:
+    enum class FieldType{
+        TEXT,
+        INTEGER,
+        REAL,
+        NULLTYPE
+    };
+
+    struct Field{
+        std::size_t offset;
+        std::size_t length;
+        FieldType type;
+    };
+
+    void begin();
+    std::size_t finish();
+    void abort();
+    void feed(const char* data, std::size_t size);
+    void feedCsv(const char* data, std::size_t size);
+    void feedJson(const char* data, std::size_t size);
+    void endCsvField(bool quoted);
+    void endCsvRecord();
+    void parseJsonLine(const char* line, std::size_t size);
+    void prepareInsert(const std::vector<std::string>& columns);
+    void insertRow(const char* base);
+    void commitBatch(bool reopen);
+
+    Database& _db;
+    std::string _table;
+    Options _options;
+    std::vector<std::string> _tableColumns;
+
+    Statement _insert;
+    Statement _begin;
+    Statement _commit;
+    std::vector<int> _jsonColumnIndex;  // Table column -> insert parameter, NDJSON only
+    std::vector<std::string> _jsonKeys;
+    bool _ownTransaction;
+    std::size_t _rowsInBatch;
+    std::size_t _rows;
+
+    // Parser state
+    std::string _buffer;        // Current record (CSV fields / pending NDJSON line)
+    std::vector<Field> _fields;
+    std::string _values;        // Unescaped NDJSON values of the current line
+    std::string _key;
+    std::size_t _fieldStart;
+    bool _inQuotes;
+    bool _quoted;
+    bool _pendingQuote;
+    bool _headerDone;
+};
+
+}
+#endif // SQ3PP_IMPORTER_H
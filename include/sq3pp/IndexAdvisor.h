@@ -0,0 +1,99 @@
+#ifndef SQ3PP_INDEXADVISOR_H
+#define SQ3PP_INDEXADVISOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sq3pp/Database.h>
+
+namespace sq3pp{
+
+// Suggests indexes for the statements an application actually runs. While it
+// exists, every SELECT, INSERT, UPDATE and DELETE completed on the connection
+// is recorded together with its full scan, sort and automatic index counters
+// (sqlite3_stmt_status); statements differing only in literal values count
+// as one, with the literals replaced by parameters. analyze() then looks at
+// the WHERE, ON and ORDER BY columns of the recorded statements, derives
+// candidate indexes for the tables they scan or sort, and tries each
+// candidate on an in-memory copy of the schema carrying the row counts and
+// sampled statistics of the real database. The candidate the planner uses to
+// save the most estimated rows visited over the recorded workload is
+// recommended first, then the others are tried again with it in place, and
+// so on.
+//
+//   IndexAdvisor advisor(db);
+//   ... run the application ...
+//   std::cout << IndexAdvisor::report(advisor.analyze());
+//
+// The Database must outlive the advisor and is not moved meanwhile. Its
+// profile hook is taken over and removed on destruction.
+class IndexAdvisor{
+public:
+    struct Options{
+        std::size_t maxStatements = 1000;   // Distinct statements kept, later ones are ignored
+        int64_t sampleRows = 100000;        // Rows read per table to estimate a candidate's selectivity
+        double minSaving = 0.05;            // Share of its statements' estimated cost an index must save
+    };
+
+    struct Observed{
+        std::string sql;
+        uint64_t executions;
+        uint64_t fullScanSteps;     // Rows stepped over in full table scans
+        uint64_t sorts;             // Sort operations
+        uint64_t autoIndexes;       // Rows inserted into automatic indexes
+        std::chrono::nanoseconds time;
+    };
+
+    struct Recommendation{
+        std::string table;
+        std::vector<std::string> columns;
+        std::string sql;                        // CREATE INDEX statement
+        std::vector<std::string> statements;    // Statements whose plan improves
+        double costBefore;          // Estimated rows visited by the statements on the table, times executions
+        double costAfter;           // The same with this index and the ones ranked above it
+        double benefit;             // costBefore - costAfter, including index maintenance on writes
+        uint64_t fullScanSteps;     // Observed counters of the improved statements
+        uint64_t sorts;
+        uint64_t autoIndexes;
+    };
+
+    IndexAdvisor(Database& db);
+    IndexAdvisor(Database& db, const Options& options);
+    IndexAdvisor(const IndexAdvisor& other) = delete;
+    IndexAdvisor& operator=(const IndexAdvisor& other) = delete;
+    ~IndexAdvisor();
+
+    // Pause or resume recording
+    void setRecording(bool recording) {_recording = recording;}
+    bool isRecording() const {return _recording.load();}
+
+    // Add a statement to the workload without running it, e.g. from a log
+    void record(const std::string& sql, uint64_t executions = 1);
+
+    // Recorded statements, most time spent first
+    std::vector<Observed> workload() const;
+    void clear();
+
+    // Recommended indexes, most useful first. Reads the schema and samples
+    // the tables through the watched connection; recording is paused meanwhile.
+    std::vector<Recommendation> analyze();
+
+    static std::string report(const std::vector<Recommendation>& recommendations);
+
+private:
+    void onProfile(sqlite3_stmt* stmt, std::chrono::nanoseconds elapsed);
+
+    Database& _db;
+    Options _options;
+    std::atomic<bool> _recording;
+    mutable std::mutex _mutex;
+    std::map<std::string, Observed> _statements;
+};
+
+}
+#endif // SQ3PP_INDEXADVISOR_H
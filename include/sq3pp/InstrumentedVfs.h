@@ -0,0 +1,88 @@
+#ifndef SQ3PP_INSTRUMENTEDVFS_H
+#define SQ3PP_INSTRUMENTEDVFS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace sq3pp{
+
+// Shim VFS that forwards to another VFS (the default one unless named) and
+// counts the I/O per kind of file: bytes and calls for reads and writes,
+// syncs, and latency histograms of each. Select it per connection through
+// the vfs argument of Database::open:
+//
+//   db.open(file, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, InstrumentedVfs::install());
+//   ...
+//   InstrumentedVfs::Stats io = InstrumentedVfs::stats();
+//
+// Counters are relaxed atomics shared by all connections using the VFS, so
+// recording costs two clock reads and a few increments per call, and reading
+// them does not stop the connections. Installed VFSes stay registered for
+// the lifetime of the process.
+class InstrumentedVfs{
+public:
+    enum class FileType{
+        MAIN_DB,
+        JOURNAL,    // Rollback journal of the main database
+        WAL,
+        TEMP,       // Temporary databases and journals, statement journals
+        OTHER       // Super-journals and anything else
+    };
+    static constexpr std::size_t FILE_TYPES = 5;
+
+    // Latency buckets by powers of two: bucket 0 holds calls under 1us,
+    // bucket i calls of [2^(i-1), 2^i) us, the last one everything slower
+    struct Histogram{
+        static constexpr std::size_t BUCKETS = 24;
+        uint64_t buckets[BUCKETS];
+
+        uint64_t count() const;
+        // Upper bound of the bucket holding the given fraction (0..1) of calls
+        std::chrono::microseconds percentile(double fraction) const;
+        static std::chrono::microseconds upperBound(std::size_t bucket);
+    };
+
+    struct FileStats{
+        uint64_t opens;
+        uint64_t reads;
+        uint64_t readBytes;
+        uint64_t writes;
+        uint64_t writeBytes;
+        uint64_t syncs;
+        uint64_t truncates;
+        std::chrono::microseconds readTime;
+        std::chrono::microseconds writeTime;
+        std::chrono::microseconds syncTime;
+        Histogram readLatency;
+        Histogram writeLatency;
+        Histogram syncLatency;
+    };
+
+    struct Stats{
+        FileStats files[FILE_TYPES];
+
+        const FileStats& operator[](FileType type) const {return files[static_cast<std::size_t>(type)];}
+        FileStats total() const;
+
+        // Counts accumulated since an earlier sample
+        Stats operator-(const Stats& earlier) const;
+    };
+
+    static constexpr const char* DEFAULT_NAME = "sq3pp-instrumented";
+
+    // Register a shim named name over base (empty: the current default VFS)
+    // and return its name. Installing a name twice returns the existing shim.
+    static const char* install(const std::string& name = DEFAULT_NAME, const std::string& base = "",
+                               bool makeDefault = false);
+
+    // Sample the counters of an installed shim
+    static Stats stats(const std::string& name = DEFAULT_NAME);
+    static void reset(const std::string& name = DEFAULT_NAME);
+
+    static const char* typeName(FileType type);
+};
+
+}
+#endif // SQ3PP_INSTRUMENTEDVFS_H
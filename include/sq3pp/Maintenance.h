@@ -0,0 +1,95 @@
+#ifndef SQ3PP_MAINTENANCE_H
+#define SQ3PP_MAINTENANCE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <sq3pp/Database.h>
+
+namespace sq3pp{
+
+// Keeps a long-running database in shape: a background thread with its own
+// connection runs PRAGMA optimize, ANALYZE and incremental_vacuum once no
+// statement has started on the watched connection for a while. Each run is
+// limited by a time budget and is interrupted as soon as the watched
+// connection starts a statement again; unfinished work resumes in the next
+// idle window.
+//
+// Only activity on the watched connection is seen. The Database must be a
+// file database that outlives the maintenance object and is not moved
+// meanwhile. Its statement hook is taken over and removed on destruction.
+class Maintenance{
+public:
+    struct Options{
+        std::chrono::milliseconds idleAfter{10000};     // Run once no statement started for this long
+        std::chrono::milliseconds checkInterval{1000};  // How often idleness is checked
+        std::chrono::milliseconds budget{500};          // Time limit of one run
+        std::chrono::seconds runEvery{3600};            // Pause between completed runs
+        std::chrono::milliseconds busyTimeout{100};
+        bool optimize = true;           // PRAGMA optimize over all tables
+        bool analyze = false;           // Full ANALYZE, one table after the other
+        int analysisLimit = 1000;       // PRAGMA analysis_limit for both (0 = unlimited)
+        int vacuumPages = 256;          // Pages per incremental_vacuum step (0 disables)
+    };
+
+    struct Report{
+        bool completed;                 // Every task finished
+        bool interrupted;               // Stopped because the database was used
+        bool timedOut;                  // Stopped because the budget ran out
+        bool optimized;
+        int analyzedTables;
+        int64_t freedPages;             // Pages returned to the file system
+        int64_t freelistPages;          // Free pages left in the file
+        std::string error;              // Other failure, e.g. the database was locked
+        std::chrono::microseconds elapsed;
+    };
+
+    Maintenance(Database& db);
+    Maintenance(Database& db, const Options& options, std::function<void(const Report& report)> onReport = nullptr);
+    Maintenance(const Maintenance& other) = delete;
+    Maintenance& operator=(const Maintenance& other) = delete;
+    ~Maintenance();
+
+    // Run at the next check, even if the database is busy or a run is not due
+    void request();
+    void stop();
+
+    uint64_t runs() const {return _runs.load();}
+    Report lastReport() const;
+
+private:
+    void onStatement();
+    void run();
+    Report runTasks();
+    bool shouldStop(std::chrono::steady_clock::time_point deadline) const;
+    int64_t pragmaValue(const std::string& pragma);
+
+    Database& _db;
+    Options _options;
+    std::function<void(const Report& report)> _onReport;
+    Database _maintenanceDb;
+
+    std::atomic<std::chrono::steady_clock::rep> _lastActivity;
+    std::atomic<bool> _running;
+    std::atomic<bool> _interrupted;
+    std::atomic<uint64_t> _runs;
+    std::size_t _nextTable;                 // Where the next ANALYZE round resumes
+
+    mutable std::mutex _mutex;
+    std::condition_variable _wakeup;
+    bool _stopping;
+    bool _requested;
+    bool _pending;                          // The previous run did not finish
+    std::chrono::steady_clock::time_point _lastRun;
+    Report _lastReport;
+    std::thread _thread;
+};
+
+}
+#endif // SQ3PP_MAINTENANCE_H
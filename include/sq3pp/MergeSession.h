@@ -0,0 +1,90 @@
+#ifndef SQ3PP_MERGESESSION_H
+#define SQ3PP_MERGESESSION_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sq3pp/Database.h>
+#include <sq3pp/Statement.h>
+
+namespace sq3pp{
+
+struct MergeOptions{
+    std::vector<std::string> columns;       // Columns of each row, in order (empty: all columns of the table)
+    std::vector<std::string> updateColumns; // Overwritten on a key match (empty: all non-key columns)
+    bool skipUnchanged = true;              // Leave matched rows alone when no column differs
+    bool deleteMissing = false;             // Delete the rows whose key was not merged
+    std::string deleteWhere;                // Limits deleteMissing to rows matching this condition
+};
+
+struct MergeResult{
+    int64_t rows;                           // Distinct keys merged; of duplicates the last row wins
+    int64_t inserted;
+    int64_t updated;
+    int64_t unchanged;
+    int64_t deleted;
+    std::chrono::microseconds staging;      // Adding rows, until finish()
+    std::chrono::microseconds apply;        // Writing them to the table
+};
+
+// Upserts many rows into a table in one set-based statement. Rows are first
+// inserted into a TEMP staging table clustered on the key columns, which
+// sorts them and keeps the last row of each key. finish() then writes them
+// with a single INSERT ... SELECT ... ON CONFLICT DO UPDATE in key order, so
+// the table and its indexes are updated in order instead of at random, and
+// can delete the rows that were not merged.
+//
+// The key columns must be the table's PRIMARY KEY or carry a UNIQUE index and
+// must not be NULL. finish() writes inside a savepoint, so the merge is
+// atomic also inside an enclosing transaction; a session ending without
+// finish() leaves the table untouched. The Database must outlive the session.
+class MergeSession{
+public:
+    MergeSession(Database& db, const std::string& table, const std::vector<std::string>& keyColumns);
+    MergeSession(Database& db, const std::string& table, const std::vector<std::string>& keyColumns, const MergeOptions& options);
+    MergeSession(const MergeSession& other) = delete;
+    MergeSession(MergeSession&& other) noexcept;
+    MergeSession& operator=(const MergeSession& other) = delete;
+    MergeSession& operator=(MergeSession&& other) = delete;
+
+    // Drops the staging table if finish() was not called
+    ~MergeSession();
+
+    // One value per merged column, in the order of MergeOptions::columns
+    void add(const std::vector<CellValue>& row);
+
+    template<typename... Args>
+    void addRow(const Args&... args) {
+        checkActive();
+        _insert.run(args...);
+        ++_added;
+    }
+
+    MergeResult finish();
+    void abort();
+
+    bool isFinished() const {return _finished;}
+    std::size_t added() const {return _added;}
+    const std::vector<std::string>& columns() const {return _columns;}
+
+private:
+    void checkActive() const;
+    Statement prepare(const std::string& sql);
+
+    Database* _db;
+    std::string _table;
+    std::string _staging;
+    std::vector<std::string> _keys;
+    std::vector<std::string> _columns;
+    MergeOptions _options;
+    Statement _insert;
+    Statement _apply;
+    bool _finished;
+    std::size_t _added;
+    std::chrono::steady_clock::time_point _start;
+};
+
+}
+#endif // SQ3PP_MERGESESSION_H
@@ -0,0 +1,102 @@
+#ifndef SQ3PP_PAGEDQUERY_H
+#define SQ3PP_PAGEDQUERY_H
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <sq3pp/Database.h>
+#include <sq3pp/Statement.h>
+
+namespace sq3pp{
+
+// Pages through a table by seeking on an ordered key instead of LIMIT/OFFSET,
+// so every page costs the same however deep it is. Each page continues from
+// the key of the last (or first) row of the previous one, passed around as an
+// opaque token:
+//
+//   PagedQuery orders(db, "orders", {{"created", true}, {"id"}});
+//   PagedQuery::Page page = orders.first(50, onRow);
+//   page = orders.next(page.last, 50, onRow);          // token from the client
+//   page = orders.previous(page.first, 50, onRow);
+//
+// The key must identify rows uniquely (end it with the primary key) and must
+// not be NULL; an index on the key columns, in order, makes each page a
+// single seek. The key values are appended to the selected columns of every
+// row. The generated statements are prepared once and reused, so the query
+// must not outlive the Database and must stay on one thread at a time.
+class PagedQuery{
+public:
+    struct Key{
+        std::string column;
+        bool descending = false;
+    };
+
+    struct Options{
+        std::string select = "*";       // Result columns
+        std::string where;              // Extra filter, with positional ? parameters
+    };
+
+    struct Page{
+        std::size_t rows;
+        std::string first;      // Token of the first row, for previous(); empty without rows
+        std::string last;       // Token of the last row, for next(); empty without rows
+        bool hasPrevious;       // Rows exist before this page
+        bool hasNext;           // Rows exist after this page
+    };
+
+    PagedQuery(Database& db, const std::string& table, const std::vector<Key>& keys);
+    PagedQuery(Database& db, const std::string& table, const std::vector<Key>& keys, const Options& options);
+
+    // Values of the ? parameters of Options::where, used by every page
+    void setParameters(std::vector<CellValue> parameters) {_parameters = std::move(parameters);}
+
+    // Rows are passed to onRow in key order, also when paging backwards. An
+    // empty token makes next() start at the first page and previous() at the
+    // last one. Tokens are checked against the table, key and filter.
+    Page first(std::size_t pageSize, const std::function<void(Row& row)>& onRow);
+    Page last(std::size_t pageSize, const std::function<void(Row& row)>& onRow);
+    Page next(const std::string& token, std::size_t pageSize, const std::function<void(Row& row)>& onRow);
+    Page previous(const std::string& token, std::size_t pageSize, const std::function<void(Row& row)>& onRow);
+
+    // SQL of the statement fetching the page after a token
+    std::string nextQuery() const {return query(FORWARD | AFTER);}
+
+private:
+    // Statement variants: reading direction and bounds on the key
+    enum Variant{
+        FORWARD = 0,
+        BACKWARD = 1,       // Reversed order, only reading the key
+        AFTER = 2,          // key > lower
+        FROM = 4,           // key >= lower
+        BEFORE = 8          // key < upper
+    };
+
+    std::string query(int variant) const;
+    std::string condition(const char* prefix, bool after, bool inclusive) const;
+    Statement& statement(int variant);
+
+    // Read forward from a bound; fills rows, first, last and hasNext
+    Page readForward(int variant, const std::vector<CellValue>* lower, const std::vector<CellValue>* upper,
+                     std::size_t pageSize, const std::function<void(Row& row)>& onRow);
+    // Key of the pageSize-th row before upper (or before the end); false if
+    // there are fewer rows, then the earliest key is returned
+    bool seekBackward(const std::vector<CellValue>* upper, std::size_t pageSize, std::vector<CellValue>& key, bool& found);
+
+    void bindParameters(Statement& stmt);
+    std::vector<CellValue> readKey(sqlite3_stmt* stmt) const;
+    std::string encode(const std::vector<CellValue>& key) const;
+    std::vector<CellValue> decode(const std::string& token) const;
+
+    Database& _db;
+    std::string _table;
+    std::vector<Key> _keys;
+    Options _options;
+    std::string _fingerprint;
+    std::vector<CellValue> _parameters;
+    std::map<int, Statement> _statements;
+};
+
+}
+#endif // SQ3PP_PAGEDQUERY_H
@@ -0,0 +1,72 @@
+#ifndef SQ3PP_PARALLELSCAN_H
+#define SQ3PP_PARALLELSCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <sq3pp/Snapshot.h>
+#include <sq3pp/Statement.h>
+
+namespace sq3pp{
+
+// Reads a whole table in parallel. The key range of an integer column (the
+// rowid by default) is split into partitions, and every partition is read by
+// the same query on one of several read-only connections, one per thread.
+//
+// Works on database files only (each connection opens the file itself);
+// concurrent readers need WAL mode to keep running while a writer commits.
+// Without a snapshot, partitions may observe different commits.
+class ParallelScan{
+public:
+    struct Options{
+        std::size_t connections = 0;    // Read connections (0 = one per hardware thread)
+        std::size_t partitions = 0;     // Key ranges (0 = four per connection)
+        std::string column = "rowid";   // Integer column to split on, ideally indexed
+        std::string select = "*";       // Result columns of the scan query
+        std::string where;              // Extra filter combined with the range
+        Snapshot snapshot;              // When valid, every connection reads this snapshot
+    };
+
+    // Inclusive key range of one partition
+    struct Range{
+        int64_t first;
+        int64_t last;
+    };
+
+    // Reads the key bounds of the table and plans the partitions
+    ParallelScan(const std::string& file, const std::string& table);
+    ParallelScan(const std::string& file, const std::string& table, const Options& options);
+
+    const std::vector<Range>& ranges() const {return _ranges;}
+    const std::string& query() const {return _query;}
+
+    // Pass every row to onRow. Partitions run concurrently, so onRow must be
+    // thread-safe; the rows of one partition arrive in order on one thread.
+    // The first error stops the remaining partitions and is rethrown.
+    void run(const std::function<void(Row& row, std::size_t partition)>& onRow);
+
+    // Fold the rows of each partition into a copy of initial, then combine
+    // the partial results (in partition order) into initial
+    template<typename T, typename RowFn, typename CombineFn>
+    T reduce(T initial, RowFn onRow, CombineFn combine) {
+        std::vector<T> partials(_ranges.size(), initial);
+        run([&partials, &onRow](Row& row, std::size_t partition){
+            onRow(partials[partition], row);
+        });
+        for(T& partial : partials){
+            combine(initial, partial);
+        }
+        return initial;
+    }
+
+private:
+    std::string _file;
+    Options _options;
+    std::string _query;
+    std::vector<Range> _ranges;
+};
+
+}
+#endif // SQ3PP_PARALLELSCAN_H
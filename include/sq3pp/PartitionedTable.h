@@ -0,0 +1,118 @@
+#ifndef SQ3PP_PARTITIONEDTABLE_H
+#define SQ3PP_PARTITIONEDTABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <sq3pp/Database.h>
+#include <sq3pp/Statement.h>
+
+namespace sq3pp{
+
+// Keeps an append-mostly table split by time into one database file per
+// window, so old data is dropped by deleting a file instead of DELETEing
+// rows. Partitions are ATTACHed on demand, at most maxAttached at a time
+// with the least recently used one detached first, and a TEMP view named
+// after the table combines the attached partitions with UNION ALL:
+//
+//   PartitionedTable events(db, "events", "ts INTEGER NOT NULL, kind TEXT, body TEXT", "ts");
+//   events.insert({now, "login", body});
+//   events.select(dayStart, dayEnd, "kind, count(*)", "", {}, onRow);  // per partition
+//   events.attachRange(weekStart, weekEnd);                             // then query the view
+//   db.execute("SELECT kind, count(*) FROM events GROUP BY kind;", onRow);
+//   events.retireBefore(now - 30 * 86400);
+//
+// Times are integers in any unit (e.g. unix seconds); window is in the same
+// unit. The partitions are listed in a sq3pp_partitions table of the main
+// database, which should therefore be a file. SQLite cannot ATTACH or DETACH
+// inside a transaction: insert rows for a new window with insertRows() or
+// attach them with attachRange() before opening one. The Database must
+// outlive the table and stay on one thread at a time.
+class PartitionedTable{
+public:
+    struct Options{
+        int64_t window = 86400;             // Width of a partition, in time units
+        std::size_t maxAttached = 8;        // Partitions attached at once, within SQLITE_LIMIT_ATTACHED
+        std::string directory;              // Partition files (empty: next to the main database)
+        std::vector<std::string> indexes;   // Column lists indexed in every partition, e.g. "kind, ts"
+        bool indexTime = true;              // Also index the time column
+    };
+
+    struct Partition{
+        int64_t start;          // First time in the partition
+        int64_t end;            // First time after it
+        std::string file;
+        bool attached;
+    };
+
+    // columns is the column list of CREATE TABLE, including the time column
+    PartitionedTable(Database& db, const std::string& table, const std::string& columns, const std::string& timeColumn);
+    PartitionedTable(Database& db, const std::string& table, const std::string& columns, const std::string& timeColumn,
+                     const Options& options);
+    PartitionedTable(const PartitionedTable& other) = delete;
+    PartitionedTable& operator=(const PartitionedTable& other) = delete;
+
+    // Detaches the partitions and drops the view
+    ~PartitionedTable();
+
+    // Oldest first
+    std::vector<Partition> partitions() const;
+    int64_t partitionStart(int64_t time) const;
+
+    // One value per column, in declaration order; the partition of its time
+    // is created if missing
+    void insert(const std::vector<CellValue>& row);
+    // Many rows, one transaction per partition unless one is already open
+    void insertRows(const std::vector<std::vector<CellValue>>& rows);
+
+    // Run SELECT columns FROM partition WHERE time in [from, to) AND (where)
+    // on each partition overlapping the range, oldest first, so any number of
+    // partitions can be read. Positional parameters bind to where.
+    int select(int64_t from, int64_t to, const std::string& columns, const std::string& where,
+               const std::vector<CellValue>& params, const std::function<void(Row& row)>& onRow);
+
+    // Attach the partitions overlapping [from, to), detaching others if
+    // needed, so the view covers the range; returns how many overlap.
+    // Throws RANGE if more than maxAttached do.
+    std::size_t attachRange(int64_t from, int64_t to);
+
+    // Detach and delete every partition ending at or before time; returns
+    // how many were removed
+    std::size_t retireBefore(int64_t time);
+
+    const std::string& viewName() const {return _table;}
+
+private:
+    struct State{
+        Partition partition;
+        std::string schema;
+        uint64_t lastUse;
+        Statement insert;
+    };
+
+    // Attached, created if missing
+    State& partitionFor(int64_t time);
+    void attach(State& state, const std::set<int64_t>& pinned);
+    void detach(State& state);
+    void rebuildView();
+    int64_t timeOf(const std::vector<CellValue>& row) const;
+    void insertInto(State& state, const std::vector<CellValue>& row);
+
+    Database& _db;
+    std::string _table;
+    std::string _columns;
+    std::string _timeColumn;
+    Options _options;
+    std::string _template;
+    std::vector<std::string> _columnNames;
+    std::size_t _timeIndex;
+    uint64_t _uses;
+    std::map<int64_t, State> _partitions;
+};
+
+}
+#endif // SQ3PP_PARTITIONEDTABLE_H
@@ -0,0 +1,82 @@
+#ifndef SQ3PP_QUERYCACHE_H
+#define SQ3PP_QUERYCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sq3pp/Database.h>
+#include <sq3pp/Statement.h>
+
+namespace sq3pp{
+
+// In-memory cache of read-only query results, keyed by SQL text and bound
+// parameters. Entries are dropped when a committed transaction on the same
+// connection touches one of the tables they read (through the ChangeFeed).
+// Writes from other connections and schema changes are detected with
+// PRAGMA data_version / schema_version and clear the whole cache.
+// Queries run inside a transaction bypass the cache, so they see the
+// transaction's own writes and nothing they read outlives a rollback.
+//
+// The Database must outlive the cache and must not be moved while it exists.
+class QueryCache{
+public:
+    struct Result{
+        std::vector<std::string> columns;
+        std::vector<std::vector<CellValue>> rows;
+    };
+
+    QueryCache(Database& db, std::size_t maxEntries = 256);
+    QueryCache(const QueryCache& other) = delete;
+    QueryCache& operator=(const QueryCache& other) = delete;
+    ~QueryCache();
+
+    // Run a read-only query, serving it from memory when possible.
+    // Statements that write are executed but never cached.
+    std::shared_ptr<const Result> query(const std::string& sql, const std::vector<CellValue>& params = {});
+
+    // Drop cached results that depend on a table
+    void invalidate(const std::string& table);
+    void clear();
+
+    std::size_t size() const {return _entries.size();}
+    uint64_t hits() const {return _hits;}
+    uint64_t misses() const {return _misses;}
+
+private:
+    struct Prepared{
+        Statement stmt;
+        std::set<std::string> tables;
+        bool readOnly;
+    };
+
+    struct Entry{
+        std::string key;
+        std::string sql;
+        std::shared_ptr<const Result> result;
+    };
+
+    Prepared& prepare(const std::string& sql);
+    void checkExternalChanges();
+    void onChanges(const std::vector<std::string>& tables);
+    void erase(std::list<Entry>::iterator it);
+
+    Database& _db;
+    std::size_t _maxEntries;
+    int _listenerId;
+    uint64_t _hits;
+    uint64_t _misses;
+    int64_t _dataVersion;
+    int64_t _schemaVersion;
+    Statement _versionStmt;
+    std::unordered_map<std::string, std::unique_ptr<Prepared>> _prepared;
+    std::list<Entry> _entries; // Most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+};
+
+}
+#endif // SQ3PP_QUERYCACHE_H
@@ -0,0 +1,84 @@
+#ifndef SQ3PP_QUERYPLANGUARD_H
+#define SQ3PP_QUERYPLANGUARD_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <sq3pp/Database.h>
+
+namespace sq3pp{
+
+class StatementRegistry;
+
+// Output of EXPLAIN QUERY PLAN, one line per node in plan order
+struct QueryPlan{
+    struct Node{
+        int id;
+        int parent;
+        int depth;
+        std::string detail;     // e.g. "SEARCH users USING INDEX users_email (email=?)"
+    };
+
+    std::vector<Node> nodes;
+
+    static QueryPlan explain(Database& db, const std::string& sql);
+
+    // Indented tree, two spaces per level, one node per line
+    std::string text() const;
+};
+
+// Catches plan regressions of a fixed set of statements: capture their plans
+// into a baseline file once, commit it, and let CI check the current plans of
+// a local database against it. Nodes that were not in the baseline and scan
+// a whole table, sort through a temporary b-tree or build an automatic index
+// are reported as regressions; other plan changes are only listed.
+//
+//   QueryPlanGuard guard;
+//   guard.add(registry);
+//   guard.saveBaseline(db, "plans.txt");       // after reviewing the plans
+//   guard.verify(db, "plans.txt");             // in tests, throws on regressions
+class QueryPlanGuard{
+public:
+    enum class Issue{
+        FULL_SCAN,          // SCAN of a table or index
+        TEMP_BTREE,         // USE TEMP B-TREE for ORDER BY, GROUP BY or DISTINCT
+        AUTOMATIC_INDEX,    // Index built on the fly for one statement
+        ERROR               // The statement no longer prepares
+    };
+
+    struct Finding{
+        std::string name;
+        Issue issue;
+        std::string detail;
+    };
+
+    struct Result{
+        std::vector<Finding> regressions;
+        std::vector<std::string> changed;   // Plans differing only in other ways
+        std::vector<std::string> missing;   // Statements without a baseline
+
+        bool ok() const {return regressions.empty();}
+        std::string report() const;
+    };
+
+    void add(const std::string& name, const std::string& sql);
+    // Every statement of a registry, under its registry name
+    void add(const StatementRegistry& registry);
+
+    // Current plan text of every statement, by name
+    std::map<std::string, std::string> capture(Database& db) const;
+
+    void saveBaseline(Database& db, const std::string& path) const;
+    Result check(Database& db, const std::string& path) const;
+
+    // check(), throwing a DatabaseException with the report on regressions
+    void verify(Database& db, const std::string& path) const;
+
+    static const char* issueName(Issue issue);
+
+private:
+    std::map<std::string, std::string> _statements;
+};
+
+}
+#endif // SQ3PP_QUERYPLANGUARD_H
@@ -0,0 +1,43 @@
+#ifndef SQ3PP_SCANSTATUS_H
+#define SQ3PP_SCANSTATUS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+
+namespace sq3pp{
+
+// What each part of a statement's plan did when it ran
+// (sqlite3_stmt_scanstatus_v2). Only available when SQLite is built with
+// SQLITE_ENABLE_STMT_SCANSTATUS; read it through Statement::scanStatus() or
+// Statement::explainAnalyze().
+struct ScanStatus{
+    struct Loop{
+        int id;                 // Plan node, as in EXPLAIN QUERY PLAN
+        int parent;
+        int depth;
+        std::string name;       // Table or index, empty for other nodes
+        std::string detail;     // EXPLAIN QUERY PLAN text of the node
+        int64_t loops;          // Times the loop was started (-1 if not a loop)
+        int64_t rowsVisited;    // Rows visited over all runs (-1 if not a loop)
+        double estimatedRows;   // Planner estimate of rows per run (-1 if not a loop)
+        int64_t cycles;         // CPU cycles spent in the node (-1 if not measured)
+    };
+
+    std::vector<Loop> loops;
+    int64_t cycles;             // Whole statement (-1 if not measured)
+
+    // Plan tree annotated with actual and estimated rows and the share of
+    // cycles of each node
+    std::string text() const;
+
+    static ScanStatus read(sqlite3_stmt* stmt);
+    static void reset(sqlite3_stmt* stmt);
+
+    // Whether SQLite was built with SQLITE_ENABLE_STMT_SCANSTATUS
+    static bool isAvailable();
+};
+
+}
+#endif // SQ3PP_SCANSTATUS_H
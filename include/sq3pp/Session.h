@@ -0,0 +1,102 @@
+#ifndef SQ3PP_SESSION_H
+#define SQ3PP_SESSION_H
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sq3pp/Database.h>
+
+struct sqlite3_session;
+
+namespace sq3pp{
+
+// Binary description of the changes recorded by a Session
+// (see the SQLite session extension). A changeset can be stored, sent to
+// another node, inverted and applied to another database.
+class Changeset{
+public:
+    enum class ConflictType{
+        DATA,           // Row found but values differ from the expected ones
+        NOTFOUND,       // Row to update/delete does not exist
+        CONFLICT,       // Insert hits an existing primary key
+        CONSTRAINT,     // Applying the change violates a constraint
+        FOREIGN_KEY     // Foreign key violations remain at the end
+    };
+
+    enum class Operation{
+        INSERT,
+        UPDATE,
+        DELETE
+    };
+
+    enum class Resolution{
+        OMIT,           // Skip the conflicting change
+        REPLACE,        // Overwrite (only valid for DATA and CONFLICT)
+        ABORT           // Roll back the whole apply
+    };
+
+    struct Conflict{
+        ConflictType type;
+        Operation op;
+        std::string table;
+    };
+
+    using ConflictHandler = std::function<Resolution(const Conflict& conflict)>;
+
+    Changeset() = default;
+    explicit Changeset(std::vector<uint8_t> data) : _data(std::move(data)) {}
+
+    const std::vector<uint8_t>& data() const {return _data;}
+    bool empty() const {return _data.empty();}
+
+    // Changeset that undoes this one
+    Changeset invert() const;
+
+    // Apply to a database; without a handler any conflict aborts
+    void apply(Database& db, ConflictHandler onConflict = nullptr) const;
+
+    // Streaming variants, the changeset is never held in memory as a whole
+    static void invert(std::istream& in, std::ostream& out);
+    static void apply(Database& db, std::istream& in, ConflictHandler onConflict = nullptr);
+
+    // Whether SQLite was built with the session extension
+    static bool isAvailable();
+
+private:
+    std::vector<uint8_t> _data;
+};
+
+
+// Records changes made to the attached tables of a connection.
+// Obtained through Database::trackChanges().
+class Session{
+private:
+    Session(std::shared_ptr<sqlite3> handle, const std::vector<std::string>& tables);
+
+public:
+    Session(const Session& other) = delete;
+    Session& operator=(const Session& other) = delete;
+    Session(Session&& other) noexcept;
+    Session& operator=(Session&& other) noexcept;
+    ~Session();
+
+    // Start recording another table
+    void attach(const std::string& table);
+
+    void enable(bool enabled);
+    bool isEmpty() const;
+
+    Changeset changeset() const;
+    void changeset(std::ostream& out) const;
+
+private:
+    std::shared_ptr<sqlite3> _handle;
+    sqlite3_session* _session;
+    friend class Database;
+};
+
+}
+#endif // SQ3PP_SESSION_H
@@ -0,0 +1,87 @@
+#ifndef SQ3PP_SHARDEDDATABASE_H
+#define SQ3PP_SHARDEDDATABASE_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sq3pp/Database.h>
+#include <sq3pp/Statement.h>
+#include <sq3pp/ThreadPool.h>
+
+namespace sq3pp{
+
+// Spreads one logical dataset over several database files. Writes are routed
+// to a single shard by hashing a key, so writers to different shards do not
+// wait on each other. Reads run on every shard in parallel and are merged.
+//
+// Every shard has one connection guarded by its own mutex; all methods are
+// safe to call from several threads.
+class ShardedDatabase{
+public:
+    struct Result{
+        std::vector<std::string> columns;
+        std::vector<std::vector<CellValue>> rows;
+    };
+
+    // Maps a routing key to a shard (taken modulo the shard count)
+    using KeyHash = std::function<std::size_t(const CellValue& key)>;
+
+    // Folds a shard row into the accumulator, which starts as the first row seen
+    using Reducer = std::function<void(std::vector<CellValue>& accumulator, const std::vector<CellValue>& row)>;
+
+    // Open (or create) one database per file. threads = 0 uses one thread per shard.
+    ShardedDatabase(const std::vector<std::string>& files, KeyHash hash = nullptr, std::size_t threads = 0);
+    ShardedDatabase(const ShardedDatabase& other) = delete;
+    ShardedDatabase& operator=(const ShardedDatabase& other) = delete;
+    ~ShardedDatabase();
+
+    std::size_t shardCount() const {return _shards.size();}
+    std::size_t shardFor(const CellValue& key) const;
+
+    // Run a write on the shard owning key; returns the rows changed
+    int execute(const CellValue& key, const std::string& sql, const std::vector<CellValue>& params = {});
+
+    // Run work with exclusive use of the shard owning key, inside a transaction
+    // that commits when work returns and rolls back if it throws
+    void write(const CellValue& key, const std::function<void(Database& db)>& work);
+
+    // Run a script on every shard in parallel (schema setup, maintenance)
+    void executeAll(const std::string& sql);
+
+    // Run a query on every shard and append the results in shard order
+    Result query(const std::string& sql, const std::vector<CellValue>& params = {});
+
+    // Run a query already sorted by `column` on every shard and merge the
+    // sorted shard results into one sorted result
+    Result queryOrdered(const std::string& sql, int column, bool descending = false,
+                        const std::vector<CellValue>& params = {});
+
+    // Run a query on every shard and fold all rows into a single row
+    Result queryReduced(const std::string& sql, const Reducer& reducer,
+                        const std::vector<CellValue>& params = {});
+
+    // Column-wise sum; combines per-shard COUNT(*) and SUM() results
+    static Reducer sum();
+
+    // Stable FNV-1a hash of the key's value, used when no hash is given. A REAL
+    // holding an exact integer hashes as that INTEGER.
+    static std::size_t defaultHash(const CellValue& key);
+
+private:
+    struct Shard{
+        Database db;
+        std::mutex mutex;
+    };
+
+    std::vector<Result> fanOut(const std::string& sql, const std::vector<CellValue>& params);
+
+    std::vector<std::unique_ptr<Shard>> _shards;
+    KeyHash _hash;
+    ThreadPool _pool;
+};
+
+}
+#endif // SQ3PP_SHARDEDDATABASE_H
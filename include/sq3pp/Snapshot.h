@@ -0,0 +1,45 @@
+#ifndef SQ3PP_SNAPSHOT_H
+#define SQ3PP_SNAPSHOT_H
+
+#include <memory>
+#include <string>
+#include <sq3pp/Database.h>
+
+namespace sq3pp{
+
+// A point in the history of a WAL database (sqlite3_snapshot). Taken with
+// Database::snapshot() and opened on any connection to the same file with
+// Database::beginRead(), so several readers see exactly the same commit.
+//
+// A snapshot can only be opened while the WAL still holds it: a checkpoint
+// that restarts or truncates the WAL invalidates it. Keeping a read
+// transaction open on one connection prevents that.
+// Copies share the same underlying snapshot.
+class Snapshot{
+private:
+    Snapshot(std::shared_ptr<sqlite3> handle, const std::string& schema);
+
+public:
+    Snapshot() = default;
+
+    bool isValid() const {return _snapshot != nullptr;}
+    const std::string& schema() const {return _schema;}
+
+    // <0 if this snapshot is older than other, 0 if equal, >0 if newer
+    int compare(const Snapshot& other) const;
+
+    // Whether SQLite was built with SQLITE_ENABLE_SNAPSHOT
+    static bool isAvailable();
+
+private:
+    // Start the open read transaction of handle at this snapshot
+    void openOn(sqlite3* handle) const;
+
+    std::shared_ptr<sqlite3_snapshot> _snapshot;
+    std::string _schema;
+    friend class Database;
+    friend class Transaction;
+};
+
+}
+#endif // SQ3PP_SNAPSHOT_H
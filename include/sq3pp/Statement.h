@@ -2,11 +2,18 @@
 #define SQ3PP_STATEMENT_H
 
 #include <cstdint>
+#include <chrono>
 #include <memory>
 #include <iostream>
 #include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 #include <sq3pp/Exception.h>
 #include <sq3pp/Database.h>
+#include <sq3pp/Binding.h>
+#include <sq3pp/ScanStatus.h>
 
 namespace sq3pp{
 class CellValue{
@@ -43,6 +50,13 @@ class CellValue{
     bool isText() const {return _type == Type::TEXT;}
     bool isBlob() const {return _type == Type::BLOB;}
 
+    // Size in bytes of a BLOB or TEXT value, 0 otherwise
+    int size() const;
+
+    // Order values the way SQLite does: NULL < numbers < TEXT < BLOB.
+    // Returns <0, 0 or >0. TEXT compares bytewise (BINARY collation).
+    int compare(const CellValue& other) const;
+
     template<typename T>
     T valueAs() const;
     
@@ -94,6 +108,9 @@ class Row{
         int valueType() const {return _type;}
         const char* columnName() const;
 
+        // Size in bytes of the value as BLOB or TEXT (sqlite3_column_bytes)
+        int size() const;
+
         private:
         int _column;
         int _type;
@@ -138,20 +155,37 @@ class Row{
     int _columnCount;
     std::shared_ptr<sqlite3_stmt> _stmt;
     friend class Statement;
+    friend class Database;
 };
 
 
 
+// A parameter name resolved to its index with Statement::param(). Binding
+// through a handle costs the same as positional binding. Valid for any
+// statement prepared from the same SQL text.
+class ParamHandle{
+    public:
+    ParamHandle() : _index(-1) {}
+    int index() const {return _index;}
+    bool isValid() const {return _index >= 0;}
+
+    private:
+    explicit ParamHandle(int index) : _index(index) {}
+    int _index;
+    friend class Statement;
+};
+
+
 class Statement{
     private:
     class Binder{
         private:
-        Binder(Statement& parent, int index): parentStmt(parent), _index(index), _id("") {}
-        Binder(Statement& parent, const std::string& id): parentStmt(parent), _index(-1), _id(id) {}
+        Binder(Statement& parent, int index): parentStmt(parent), _index(index), _id() {}
+        Binder(Statement& parent, std::string_view id): parentStmt(parent), _index(-1), _id(id) {}
 
         Statement& parentStmt;
         int _index;
-        std::string _id;
+        std::string_view _id; // Only used within the full expression that created the Binder
 
         public:
         Binder& operator=(const Binder& other) = delete;
@@ -166,7 +200,8 @@ class Statement{
         friend class Statement;
     };
 
-    Statement(std::shared_ptr<sqlite3> handle, const std::string& query);
+    Statement(std::shared_ptr<sqlite3> handle, std::shared_ptr<detail::ConnectionContext> context, const std::string& query,
+              unsigned int prepareFlags = 0);
 
     public:
     Statement();
@@ -178,6 +213,7 @@ class Statement{
 
     
     bool isValid() const {return _stmt != nullptr;}
+    sqlite3_stmt* getHandle() const {return _stmt.get();}
     void reset(bool clearBindings = true);
     void finalize();
     
@@ -202,30 +238,54 @@ class Statement{
     // Parameter names should not include the leading ':' or '@' or '$' used in SQLite
     // If the index is found, bind the value to that index and update the internal counter accordingly
     // If the parameter name is not found, return an error code
-    Statement& bindById(const std::string& id, const std::string& value);
-    Statement& bindById(const std::string& id, const char* value);
-    Statement& bindById(const std::string& id, std::nullptr_t);
-    Statement& bindById(const std::string& id, int value);
-    Statement& bindById(const std::string& id, int64_t value);
-    Statement& bindById(const std::string& id, double value);
-    Statement& bindById(const std::string& id, void* blob_value, int n);
-    Statement& bindById(const std::string& id, const std::vector<uint8_t>& blob_value);
-    Statement& bindById(const std::string& id, const CellValue& cellValue);
+    Statement& bindById(std::string_view id, const std::string& value);
+    Statement& bindById(std::string_view id, const char* value);
+    Statement& bindById(std::string_view id, std::nullptr_t);
+    Statement& bindById(std::string_view id, int value);
+    Statement& bindById(std::string_view id, int64_t value);
+    Statement& bindById(std::string_view id, double value);
+    Statement& bindById(std::string_view id, void* blob_value, int n);
+    Statement& bindById(std::string_view id, const std::vector<uint8_t>& blob_value);
+    Statement& bindById(std::string_view id, const CellValue& cellValue);
 
 
     Binder operator[](int index){return Binder(*this, index);}
-    Binder operator[](const std::string& id){return Binder(*this, id);}
+    Binder operator[](std::string_view id){return Binder(*this, id);}
+    Binder operator[](ParamHandle param){return Binder(*this, param.index());}
 
 
-    // Get the index for a parameter name (0-based)
-    int getIndexForId(const std::string& id);
+    // Get the index for a parameter name (0-based), -1 if not found.
+    // Names are resolved from a table built when the statement is prepared.
+    int getIndexForId(std::string_view id) const;
+
+    // Resolve a parameter name once and bind through the handle afterwards.
+    // Throws if the name is not found.
+    ParamHandle param(std::string_view id) const;
 
     // Reset the internal bind index counter (0-based)
     void resetBindIndex(int index=0);
 
 
+    // Limit the time a run of this statement may take, measured from the first
+    // step after a reset. Exceeding it throws/returns SQ3::TIMEOUT.
+    // A zero timeout disables the limit.
+    void setTimeout(std::chrono::milliseconds timeout) {_timeout = timeout;}
+
     SQ3 step(std::function<void(Row& row)> onRowFound = nullptr);
 
+    // Step without building a Row: true while rows remain, false once done.
+    // Columns are read from getHandle(). Throws on error.
+    bool stepRow();
+
+    // Rows changed by the last run stepRow() completed, counted before any
+    // change listener could run other statements
+    int changes() const {return _changes;}
+
+
+    // Bind args to the parameters in order, run the statement to completion,
+    // then reset it and clear the bindings. Returns the number of rows changed.
+    template<typename... Args>
+    int run(const Args&... args);
 
     // Return the number of rows affected or retrieved by the execution
     int execute();
@@ -234,16 +294,92 @@ class Statement{
 
     Row& getCurrentRow(){ return _currentRow;}
 
+    // Per-loop counters of the runs since the last resetScanStatus(); needs
+    // SQLite built with SQLITE_ENABLE_STMT_SCANSTATUS (see ScanStatus)
+    ScanStatus scanStatus() const;
+    void resetScanStatus();
+
+    // Run the statement to completion with its current bindings, discarding
+    // the rows, and return what each part of the plan did. Like EXPLAIN
+    // ANALYZE, the statement is really executed.
+    ScanStatus explainAnalyze();
+
     
     private:
+    // Resets the statement and clears its bindings when leaving scope
+    class ResetGuard{
+        public:
+        explicit ResetGuard(Statement& stmt) : _stmt(stmt) {}
+        ~ResetGuard() {_stmt.reset(true);}
+        private:
+        Statement& _stmt;
+    };
+
+    void indexParameterNames();
+
+    // Bind args to parameters 1..n without copying text or blobs
+    template<typename... Args>
+    void bindAll(const Args&... args);
+
+    // Declared first so it is destroyed last: it may own the connection,
+    // which cannot close while _stmt is not finalized
+    std::shared_ptr<detail::ConnectionContext> _context;
     std::shared_ptr<sqlite3_stmt> _stmt;
     std::string _query;
     int _bindIndex;
     int _rowIndex;
+    int _changes;
+    std::chrono::milliseconds _timeout;
+    std::chrono::steady_clock::time_point _deadline;
     Row _currentRow;
+    // Parameter names without their prefix and 0-based indexes, sorted by name
+    std::vector<std::pair<std::string, int>> _paramNames;
     friend class Database;
 };
 
+
+template<typename... Args>
+void Statement::bindAll(const Args&... args) {
+    if(!isValid()){
+        throw DatabaseException(SQ3::MISUSE, "Cannot bind parameters: statement is not valid.");
+    }
+    sqlite3_stmt* stmt = _stmt.get();
+    (void)stmt; // Unused without arguments
+    int index = 0;
+    int rc = SQLITE_OK;
+    ((rc = rc == SQLITE_OK ? detail::bindValue(stmt, ++index, args, SQLITE_STATIC) : rc), ...);
+    if(rc != SQLITE_OK){
+        throw DatabaseException(static_cast<SQ3>(rc), "Cannot bind parameter " + std::to_string(index) + ": " + sqlite3_errstr(rc));
+    }
+}
+
+template<typename... Args>
+int Statement::run(const Args&... args) {
+    ResetGuard guard(*this);
+    reset(true);
+    bindAll(args...);
+    while(stepRow()){}
+    return _changes;
+}
+
+template<typename... Args>
+int Database::exec(const std::string& sql, const Args&... args) {
+    std::shared_ptr<Statement> stmt = cachedStatement(sql);
+    return stmt->run(args...);
+}
+
+template<typename T, typename... Args>
+std::optional<T> Database::queryOne(const std::string& sql, const Args&... args) {
+    std::shared_ptr<Statement> stmt = cachedStatement(sql);
+    Statement::ResetGuard guard(*stmt);
+    stmt->reset(true);
+    stmt->bindAll(args...);
+    if(!stmt->stepRow() || sqlite3_column_count(stmt->getHandle()) == 0){
+        return std::nullopt;
+    }
+    return detail::columnValue<T>(stmt->getHandle(), 0);
+}
+
 }
 
 std::ostream& operator<<(std::ostream& os, const sq3pp::CellValue& cellValue);
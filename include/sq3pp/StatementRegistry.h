@@ -0,0 +1,118 @@
+#ifndef SQ3PP_STATEMENTREGISTRY_H
+#define SQ3PP_STATEMENTREGISTRY_H
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sq3pp/Database.h>
+#include <sq3pp/Exception.h>
+#include <sq3pp/Statement.h>
+
+namespace sq3pp{
+
+// SQL declared once at startup under stable names, then prepared eagerly on
+// each connection so that no request pays for parsing or schema loading.
+//
+//   StatementRegistry registry;
+//   const auto findUser = registry.add("findUser", "SELECT * FROM users WHERE id = ?;");
+//   StatementRegistry::Prepared statements = registry.prepare(db);
+//   statements[findUser].bind(42);
+//
+// Every statement is prepared even if some fail, and all failures are reported
+// together in one DatabaseException.
+class StatementRegistry{
+public:
+    // Position of a statement in the registry, for O(1) access
+    using Id = std::size_t;
+
+    struct Error{
+        Id id;
+        std::string name;
+        SQ3 code;
+        std::string message;
+    };
+
+    struct Timings{
+        std::chrono::microseconds total;                // Wall time of the whole prepare call
+        std::chrono::microseconds first;                // First statement, includes loading the schema
+        std::vector<std::chrono::microseconds> prepare; // Per Id, slowest across connections
+        Id slowest;
+        std::size_t connections;
+    };
+
+    // The statements of one connection, indexed by Id. Keeps its own copy of
+    // the names declared when it was prepared, so it may outlive the registry.
+    class Prepared{
+    public:
+        Prepared() = default;
+
+        Statement& operator[](Id id) {
+            if(id >= _statements.size()){
+                throw DatabaseException(SQ3::RANGE, "Statement id out of range: " + std::to_string(id));
+            }
+            return _statements[id];
+        }
+
+        // Looks the name up first; prefer Ids on hot paths
+        Statement& get(const std::string& name) {
+            if(!_ids){
+                throw DatabaseException(SQ3::MISUSE, "Statements not prepared by a registry: " + name);
+            }
+            auto it = _ids->find(name);
+            if(it == _ids->end()){
+                throw DatabaseException(SQ3::MISUSE, "Statement not registered: " + name);
+            }
+            return (*this)[it->second];
+        }
+
+        std::size_t size() const {return _statements.size();}
+
+    private:
+        friend class StatementRegistry;
+        std::shared_ptr<const std::unordered_map<std::string, Id>> _ids;
+        std::vector<Statement> _statements;
+    };
+
+    // Declare a statement; names must be unique
+    Id add(const std::string& name, const std::string& sql);
+
+    // Id of a declared statement, throws if the name is unknown
+    Id id(const std::string& name) const;
+    bool contains(const std::string& name) const {return _ids.count(name) != 0;}
+
+    const std::string& name(Id id) const {return _entries.at(id).name;}
+    const std::string& sql(Id id) const {return _entries.at(id).sql;}
+    std::size_t size() const {return _entries.size();}
+
+    // Prepare every statement on db. Throws one DatabaseException listing all
+    // statements that failed.
+    Prepared prepare(Database& db, Timings* timings = nullptr) const;
+
+    // Prepare on several connections at once, one thread per connection
+    // (at most threads, 0 = one per hardware thread). The result is in the
+    // order of connections.
+    std::vector<Prepared> prepare(const std::vector<Database*>& connections, std::size_t threads = 0,
+                                  Timings* timings = nullptr) const;
+
+    // Prepare and discard every statement, returning the failures
+    std::vector<Error> validate(Database& db) const;
+
+private:
+    struct Entry{
+        std::string name;
+        std::string sql;
+    };
+
+    Prepared prepareAll(Database& db, const std::shared_ptr<const std::unordered_map<std::string, Id>>& ids,
+                        std::vector<Error>& errors, std::vector<std::chrono::microseconds>& durations) const;
+    void throwErrors(const std::vector<Error>& errors) const;
+
+    std::vector<Entry> _entries;
+    std::unordered_map<std::string, Id> _ids;
+};
+
+}
+#endif // SQ3PP_STATEMENTREGISTRY_H
@@ -0,0 +1,107 @@
+#ifndef SQ3PP_STATS_H
+#define SQ3PP_STATS_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <sq3pp/Database.h>
+
+namespace sq3pp{
+
+// Per-connection counters from sqlite3_db_status.
+// Gauges hold the current value, counters accumulate since the connection
+// was opened (or since the last stats(true) call).
+struct DatabaseStats{
+    // Gauges
+    int64_t cacheUsed;              // Page cache memory (bytes)
+    int64_t cacheUsedShared;        // Same, shared cache split between connections
+    int64_t schemaUsed;             // Schema memory (bytes)
+    int64_t stmtUsed;               // Prepared statement memory (bytes)
+    int64_t lookasideUsed;          // Lookaside slots in use
+    int64_t lookasideUsedHighwater;
+
+    // Counters
+    int64_t cacheHit;
+    int64_t cacheMiss;
+    int64_t cacheWrite;
+    int64_t cacheSpill;
+    int64_t lookasideHit;
+    int64_t lookasideMissSize;
+    int64_t lookasideMissFull;
+
+    // Counters become the difference, gauges keep this snapshot's values
+    DatabaseStats operator-(const DatabaseStats& earlier) const;
+
+    // Fraction of page requests served from the cache (0 when idle)
+    double cacheHitRatio() const;
+};
+
+// Process-wide memory counters from sqlite3_status64
+struct MemoryStats{
+    int64_t memoryUsed;
+    int64_t memoryHighwater;
+    int64_t mallocCount;            // Outstanding allocations
+    int64_t mallocCountHighwater;
+    int64_t largestAllocation;      // Highwater of a single request (bytes)
+    int64_t pageCacheUsed;          // Slots of SQLITE_CONFIG_PAGECACHE in use
+    int64_t pageCacheOverflow;      // Page cache bytes that did not fit the slots
+    int64_t pageCacheOverflowHighwater;
+    int64_t largestPageCacheAllocation;
+
+    MemoryStats operator-(const MemoryStats& earlier) const;
+};
+
+// Memory counters require SQLITE_CONFIG_MEMSTATUS (see sq3pp::configure)
+MemoryStats memoryStats(bool resetHighwater = false);
+
+
+// Samples memory and connection statistics on a background thread and passes
+// them, together with the change since the previous sample, to a callback.
+// The sampler only keeps a weak reference to the connection and reads it
+// under the connection mutex, so the connection must be in serialized
+// threading mode. Sampling stops, with error() set, once it is closed.
+class StatsSampler{
+public:
+    struct Sample{
+        MemoryStats memory;
+        DatabaseStats database;
+        DatabaseStats databaseDelta;
+        std::chrono::steady_clock::time_point time;
+    };
+
+    using Callback = std::function<void(const Sample& sample)>;
+
+    StatsSampler(Database& db, std::chrono::milliseconds interval, Callback callback);
+    StatsSampler(const StatsSampler& other) = delete;
+    StatsSampler& operator=(const StatsSampler& other) = delete;
+    ~StatsSampler();
+
+    void stop();
+
+    // Why sampling stopped on its own (e.g. the database was closed); empty
+    // while it runs
+    std::string error() const;
+
+private:
+    void run();
+    // Read the connection's counters; false, with error() set, if it failed
+    bool readDatabase(DatabaseStats& stats);
+    void fail(const std::string& error);
+
+    std::weak_ptr<sqlite3> _handle;
+    std::chrono::milliseconds _interval;
+    Callback _callback;
+    mutable std::mutex _mutex;
+    std::condition_variable _wakeup;
+    bool _stopping;
+    std::string _error;
+    std::thread _thread;
+};
+
+}
+#endif // SQ3PP_STATS_H
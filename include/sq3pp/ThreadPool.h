@@ -0,0 +1,51 @@
+#ifndef SQ3PP_THREADPOOL_H
+#define SQ3PP_THREADPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace sq3pp{
+
+// Fixed set of worker threads running submitted tasks in FIFO order.
+// The destructor finishes the queued tasks before joining the workers.
+class ThreadPool{
+public:
+    // Zero threads means one per hardware thread
+    explicit ThreadPool(std::size_t threads = 0);
+    ThreadPool(const ThreadPool& other) = delete;
+    ThreadPool& operator=(const ThreadPool& other) = delete;
+    ~ThreadPool();
+
+    std::size_t size() const {return _workers.size();}
+
+    // Queue a task; exceptions it throws are delivered through the future
+    template<typename F>
+    std::future<std::invoke_result_t<F>> submit(F&& task) {
+        using R = std::invoke_result_t<F>;
+        auto packaged = std::make_shared<std::packaged_task<R()>>(std::forward<F>(task));
+        std::future<R> result = packaged->get_future();
+        enqueue([packaged](){ (*packaged)(); });
+        return result;
+    }
+
+private:
+    void enqueue(std::function<void()> task);
+    void run();
+
+    std::vector<std::thread> _workers;
+    std::deque<std::function<void()>> _tasks;
+    std::mutex _mutex;
+    std::condition_variable _wakeup;
+    bool _stopping;
+};
+
+}
+#endif // SQ3PP_THREADPOOL_H
@@ -3,9 +3,12 @@
 
 #include <sq3pp/Database.h>
 namespace sq3pp{
+class Snapshot;
 class Transaction{
     private:
-        Transaction(std::shared_ptr<sqlite3> database);
+        // With a snapshot, the transaction reads the database as of that snapshot
+        Transaction(std::shared_ptr<sqlite3> database, std::shared_ptr<detail::ConnectionContext> context,
+                    const Snapshot* snapshot = nullptr);
     public:
         ~Transaction();
 
@@ -14,6 +17,7 @@ class Transaction{
 
     private:
         std::shared_ptr<sqlite3> _dbHandle;
+        std::shared_ptr<detail::ConnectionContext> _context;
         bool _committed;
         friend class Database;
 };
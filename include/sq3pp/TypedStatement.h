@@ -0,0 +1,142 @@
+#ifndef SQ3PP_TYPEDSTATEMENT_H
+#define SQ3PP_TYPEDSTATEMENT_H
+
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <sq3pp/Binding.h>
+#include <sq3pp/Database.h>
+#include <sq3pp/Exception.h>
+#include <sq3pp/Statement.h>
+
+namespace sq3pp{
+
+// Tags naming the parameter and result types of a TypedStatement:
+//   TypedStatement<Params(int64_t, std::string), Result(std::string)>
+struct Params;
+struct Result;
+
+// Wraps a string literal in a type so its placeholders can be counted at
+// compile time: TypedStatement<...> stmt(db, SQ3PP_SQL("SELECT ..."));
+#define SQ3PP_SQL(literal) \
+    []{ struct SqlText{ static constexpr const char* value(){ return literal; } }; return SqlText{}; }()
+
+template<typename ParamSignature, typename ResultSignature = Result()>
+class TypedStatement;
+
+// Statement whose parameter and column types are fixed at compile time.
+// Binding and reading are plain sqlite3_bind_* / sqlite3_column_* calls;
+// arity is checked at compile time for SQ3PP_SQL literals and when the
+// statement is prepared otherwise.
+template<typename... P, typename... R>
+class TypedStatement<Params(P...), Result(R...)>{
+public:
+    using Row = std::tuple<R...>;
+
+    TypedStatement(Database& db, const std::string& sql) : _stmt(db.createStatement(sql)) {
+        if(!_stmt.isValid()){
+            sqlite3* handle = db.getHandle();
+            if(!handle){
+                throw DatabaseException(SQ3::NOT_OPEN, "Cannot prepare statement: database is not open.");
+            }
+            throw DatabaseException(static_cast<SQ3>(sqlite3_errcode(handle)), std::string(sqlite3_errmsg(handle)) + ": " + sql);
+        }
+        check(sql);
+    }
+
+    template<typename Sql, typename = decltype(Sql::value())>
+    TypedStatement(Database& db, Sql) : TypedStatement(db, std::string(Sql::value())) {
+        static_assert(detail::countParameters(Sql::value()) == static_cast<int>(sizeof...(P)),
+                      "Number of SQL parameters does not match Params(...)");
+    }
+
+    // Reset and bind every parameter (values are copied)
+    TypedStatement& bind(const P&... args) {
+        sqlite3_stmt* stmt = _stmt.getHandle();
+        _stmt.reset(false);
+        bindAll(stmt, SQLITE_TRANSIENT, std::index_sequence_for<P...>(), args...);
+        return *this;
+    }
+
+    // Advance to the next row; false once the statement is done
+    bool next() {
+        return _stmt.stepRow();
+    }
+
+    Row row() const {
+        return readRow(std::index_sequence_for<R...>());
+    }
+
+    // Run a statement to completion and return the number of changed rows
+    int execute(const P&... args) {
+        Cleanup cleanup(_stmt);
+        bindAll(_stmt.getHandle(), SQLITE_STATIC, std::index_sequence_for<P...>(), args...);
+        while(_stmt.stepRow()){}
+        return _stmt.changes();
+    }
+
+    std::vector<Row> query(const P&... args) {
+        std::vector<Row> rows;
+        Cleanup cleanup(_stmt);
+        bindAll(_stmt.getHandle(), SQLITE_STATIC, std::index_sequence_for<P...>(), args...);
+        while(_stmt.stepRow()){
+            rows.push_back(row());
+        }
+        return rows;
+    }
+
+    // First row only, for point lookups
+    std::optional<Row> queryOne(const P&... args) {
+        Cleanup cleanup(_stmt);
+        bindAll(_stmt.getHandle(), SQLITE_STATIC, std::index_sequence_for<P...>(), args...);
+        if(_stmt.stepRow()){
+            return row();
+        }
+        return std::nullopt;
+    }
+
+    Statement& statement() {return _stmt;}
+
+private:
+    // Leaves the statement reset with no bindings, even when a step throws
+    struct Cleanup{
+        explicit Cleanup(Statement& stmt) : _stmt(stmt) {_stmt.reset(true);}
+        ~Cleanup() {_stmt.reset(true);}
+        Statement& _stmt;
+    };
+
+    void check(const std::string& sql) {
+        sqlite3_stmt* stmt = _stmt.getHandle();
+        if(sqlite3_bind_parameter_count(stmt) != static_cast<int>(sizeof...(P))){
+            throw DatabaseException(SQ3::RANGE, "Statement expects " + std::to_string(sqlite3_bind_parameter_count(stmt))
+                + " parameters, Params(...) has " + std::to_string(sizeof...(P)) + ": " + sql);
+        }
+        if(sizeof...(R) > 0 && sqlite3_column_count(stmt) != static_cast<int>(sizeof...(R))){
+            throw DatabaseException(SQ3::RANGE, "Statement returns " + std::to_string(sqlite3_column_count(stmt))
+                + " columns, Result(...) has " + std::to_string(sizeof...(R)) + ": " + sql);
+        }
+    }
+
+    template<std::size_t... I>
+    void bindAll(sqlite3_stmt* stmt, sqlite3_destructor_type lifetime, std::index_sequence<I...>, const P&... args) {
+        int rc = SQLITE_OK;
+        ((rc = rc == SQLITE_OK ? detail::bindValue(stmt, static_cast<int>(I) + 1, args, lifetime) : rc), ...);
+        if(rc != SQLITE_OK){
+            throw DatabaseException(static_cast<SQ3>(rc), std::string("Cannot bind parameters: ") + sqlite3_errstr(rc));
+        }
+    }
+
+    template<std::size_t... I>
+    Row readRow(std::index_sequence<I...>) const {
+        sqlite3_stmt* stmt = _stmt.getHandle();
+        (void)stmt;
+        return Row(detail::columnValue<R>(stmt, static_cast<int>(I))...);
+    }
+
+    Statement _stmt;
+};
+
+}
+#endif // SQ3PP_TYPEDSTATEMENT_H
@@ -0,0 +1,254 @@
+#include <sq3pp/BulkLoadSession.h>
+#include <sq3pp/Exception.h>
+#include <sq3pp/Statement.h>
+#include <sq3pp/Transaction.h>
+#include "SqlText.h"
+
+using namespace sq3pp;
+using detail::quoteIdentifier;
+using Clock = std::chrono::steady_clock;
+
+static std::chrono::microseconds since(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+}
+
+// Dropped indexes are recorded in the database, in the transaction that drops
+// them, so a load that never reaches finish() does not lose them
+static const char* const INDEX_TABLE = "sq3pp_bulkload_indexes";
+
+static bool hasIndexTable(Database& db) {
+    return db.queryOne<int64_t>("SELECT count(*) FROM main.sqlite_master WHERE type = 'table' AND name = ?1;",
+                                std::string(INDEX_TABLE)).value_or(0) > 0;
+}
+
+// Build an index and forget its record in one transaction
+static void rebuild(Database& db, const std::string& name, const std::string& sql) {
+    Transaction transaction = db.beginTransaction();
+    db.execute(sql + ";");
+    db.exec("DELETE FROM main." + quoteIdentifier(INDEX_TABLE) + " WHERE name = ?1;", name);
+    transaction.commit();
+}
+
+static void dropIndexTableIfEmpty(Database& db) {
+    std::string table = "main." + quoteIdentifier(INDEX_TABLE);
+    if(db.queryOne<int64_t>("SELECT count(*) FROM " + table + ";").value_or(0) == 0){
+        db.execute("DROP TABLE " + table + ";");
+    }
+}
+
+void BulkLoadSession::recover(Database& db, const std::vector<std::string>& tables) {
+    if(!db.isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot recover bulk load indexes: database is not open.");
+    }
+    if(!hasIndexTable(db)){
+        return;
+    }
+    std::vector<Index> indexes;
+    db.execute("SELECT name, tbl_name, sql FROM main." + quoteIdentifier(INDEX_TABLE) + " ORDER BY rowid;", [&](Row& row){
+        std::string table = row[1].valueAs<std::string>();
+        bool wanted = tables.empty();
+        for(const std::string& name : tables){
+            wanted = wanted || sqlite3_stricmp(name.c_str(), table.c_str()) == 0;
+        }
+        if(wanted){
+            indexes.push_back(Index{row[0].valueAs<std::string>(), table, row[2].valueAs<std::string>()});
+        }
+    });
+    std::string failures;
+    int failed = 0;
+    for(const Index& index : indexes){
+        try{
+            rebuild(db, index.name, index.sql);
+        } catch(const DatabaseException& e) {
+            ++failed;
+            failures += "\n  " + index.sql + ": " + e.what();
+        }
+    }
+    dropIndexTableIfEmpty(db);
+    if(failed > 0){
+        throw DatabaseException(SQ3::CONSTRAINT, "Cannot recover " + std::to_string(failed) + " dropped index(es):" + failures);
+    }
+}
+
+BulkLoadSession::BulkLoadSession(Database& db, const std::vector<std::string>& tables)
+    : BulkLoadSession(db, tables, BulkLoadOptions()) {}
+
+BulkLoadSession::BulkLoadSession(Database& db, const std::vector<std::string>& tables, const BulkLoadOptions& options)
+    : _db(&db), _tables(tables), _options(options), _finished(false), _start(Clock::now()), _timings{} {
+    if(!_db->isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot start bulk load: database is not open.");
+    }
+    if(!sqlite3_get_autocommit(_db->getHandle())){
+        // The journal mode cannot change inside a transaction
+        throw DatabaseException(SQ3::MISUSE, "Cannot start bulk load inside a transaction.");
+    }
+
+    Statement exists = _db->createStatement("SELECT count(*) FROM sqlite_master WHERE type = 'table' AND name = ?1 COLLATE NOCASE;");
+    for(const std::string& table : _tables){
+        int64_t count = 0;
+        exists.bind(table).execute([&count](Row& row){
+            count = row[0].valueAs<int64_t>();
+        });
+        exists.reset(true);
+        if(count == 0){
+            throw DatabaseException(SQ3::ERROR, "Cannot start bulk load: no such table: " + table);
+        }
+    }
+    exists.finalize();
+
+    // Indexes left dropped by a load that did not finish
+    recover(*_db, _tables);
+
+    _journalMode = pragma("journal_mode");
+    _synchronous = pragma("synchronous");
+    _cacheSize = pragma("cache_size");
+    try{
+        if(!_options.journalMode.empty()){
+            _db->execute("PRAGMA journal_mode = " + _options.journalMode + ";");
+        }
+        if(!_options.synchronous.empty()){
+            _db->execute("PRAGMA synchronous = " + _options.synchronous + ";");
+        }
+        if(_options.cacheSize != 0){
+            _db->execute("PRAGMA cache_size = " + std::to_string(_options.cacheSize) + ";");
+        }
+
+        if(_options.dropIndexes){
+            // Automatic indexes have no SQL and cannot be dropped
+            Transaction transaction = _db->beginTransaction();
+            Statement select = _db->createStatement(
+                "SELECT m.name, m.tbl_name, m.sql FROM sqlite_master AS m JOIN pragma_index_list(m.tbl_name) AS l ON l.name = m.name"
+                " WHERE m.type = 'index' AND m.tbl_name = ?1 COLLATE NOCASE AND m.sql IS NOT NULL AND (?2 OR NOT l.\"unique\");");
+            for(const std::string& table : _tables){
+                select.bind(table).bind(_options.dropUniqueIndexes ? 1 : 0).execute([this](Row& row){
+                    _indexes.push_back(Index{row[0].valueAs<std::string>(), row[1].valueAs<std::string>(), row[2].valueAs<std::string>()});
+                });
+                select.reset(true);
+            }
+            select.finalize();
+            if(!_indexes.empty()){
+                std::string table = "main." + quoteIdentifier(INDEX_TABLE);
+                _db->execute("CREATE TABLE IF NOT EXISTS " + table + " (name TEXT PRIMARY KEY, tbl_name TEXT NOT NULL, sql TEXT NOT NULL);");
+                for(const Index& index : _indexes){
+                    _db->exec("INSERT INTO " + table + " (name, tbl_name, sql) VALUES (?1, ?2, ?3);", index.name, index.table, index.sql);
+                }
+            }
+            for(const Index& index : _indexes){
+                _db->execute("DROP INDEX " + quoteIdentifier(index.name) + ";");
+            }
+            transaction.commit();
+        }
+    } catch(...) {
+        _indexes.clear(); // Rolled back
+        try{
+            restoreSettings();
+        } catch(...) {
+            // Report the original error
+        }
+        throw;
+    }
+    _timings.setup = since(_start);
+    _loadStart = Clock::now();
+}
+
+BulkLoadSession::BulkLoadSession(BulkLoadSession&& other) noexcept
+    : _db(other._db), _tables(std::move(other._tables)), _options(std::move(other._options)),
+      _journalMode(std::move(other._journalMode)), _synchronous(std::move(other._synchronous)),
+      _cacheSize(std::move(other._cacheSize)), _indexes(std::move(other._indexes)),
+      _failedIndexes(std::move(other._failedIndexes)), _finished(other._finished),
+      _start(other._start), _loadStart(other._loadStart), _timings(other._timings) {
+    other._finished = true;
+}
+
+BulkLoadSession::~BulkLoadSession() {
+    if(!_finished){
+        try{
+            if(_db->isOpen() && !sqlite3_get_autocommit(_db->getHandle())){
+                sqlite3_exec(_db->getHandle(), "ROLLBACK;", nullptr, nullptr, nullptr);
+            }
+            finish();
+        } catch(...) {
+            // Suppress all exceptions in destructor
+        }
+    }
+}
+
+std::string BulkLoadSession::pragma(const std::string& name) {
+    std::string value;
+    _db->execute("PRAGMA " + name + ";", [&value](Row& row){
+        value = row[0].valueAs<std::string>();
+    });
+    return value;
+}
+
+const BulkLoadSession::Timings& BulkLoadSession::finish() {
+    if(_finished){
+        return _timings;
+    }
+    if(!_db->isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot finish bulk load: database is not open.");
+    }
+    if(!sqlite3_get_autocommit(_db->getHandle())){
+        throw DatabaseException(SQ3::MISUSE, "Cannot finish bulk load inside a transaction.");
+    }
+    _timings.load = since(_loadStart);
+    _finished = true;
+
+    // Each index is built with one sort over the loaded rows
+    Clock::time_point start = Clock::now();
+    std::string failures;
+    int failed = 0;
+    for(const Index& index : _indexes){
+        try{
+            rebuild(*_db, index.name, index.sql);
+        } catch(const DatabaseException& e) {
+            ++failed;
+            failures += "\n  " + index.sql + ": " + e.what();
+            _failedIndexes.push_back(index.sql);
+        }
+    }
+    if(!_indexes.empty()){
+        // Failed indexes are reported to the caller from here on
+        for(const Index& index : _indexes){
+            _db->exec("DELETE FROM main." + quoteIdentifier(INDEX_TABLE) + " WHERE name = ?1;", index.name);
+        }
+        dropIndexTableIfEmpty(*_db);
+    }
+    _timings.indexes = since(start);
+
+    start = Clock::now();
+    if(_options.analyze){
+        try{
+            for(const std::string& table : _tables){
+                _db->execute("ANALYZE " + quoteIdentifier(table) + ";");
+            }
+        } catch(const DatabaseException& e) {
+            ++failed;
+            failures += std::string("\n  ANALYZE: ") + e.what();
+        }
+    }
+    _timings.analyze = since(start);
+
+    start = Clock::now();
+    restoreSettings();
+    _timings.restore = since(start);
+    _timings.total = since(_start);
+
+    if(failed > 0){
+        throw DatabaseException(SQ3::CONSTRAINT, "Bulk load finished with " + std::to_string(failed) + " error(s):" + failures);
+    }
+    return _timings;
+}
+
+void BulkLoadSession::restoreSettings() {
+    _db->execute("PRAGMA journal_mode = " + _journalMode + "; PRAGMA synchronous = " + _synchronous
+                 + "; PRAGMA cache_size = " + _cacheSize + ";");
+}
+
+std::vector<std::string> BulkLoadSession::droppedIndexes() const {
+    std::vector<std::string> names;
+    for(const Index& index : _indexes){
+        names.push_back(index.name);
+    }
+    return names;
+}
@@ -0,0 +1,190 @@
+#include <sq3pp/ChangeFeed.h>
+#include <cctype>
+
+using namespace sq3pp;
+
+static void skipSpace(const char*& p) {
+    for(;;){
+        while(std::isspace(static_cast<unsigned char>(*p))) ++p;
+        if(p[0] == '-' && p[1] == '-'){
+            while(*p && *p != '\n') ++p;
+        } else if(p[0] == '/' && p[1] == '*'){
+            p += 2;
+            while(*p && !(p[0] == '*' && p[1] == '/')) ++p;
+            if(*p) p += 2;
+        } else {
+            return;
+        }
+    }
+}
+
+// Next keyword or identifier, unquoted and lower-cased
+static std::string nextWord(const char*& p) {
+    skipSpace(p);
+    std::string word;
+    char close = 0;
+    if(*p == '"' || *p == '`' || *p == '\''){
+        close = *p++;
+    } else if(*p == '['){
+        close = ']';
+        ++p;
+    }
+    if(close){
+        for(; *p; ++p){
+            if(*p == close){
+                if(close != ']' && p[1] == close){
+                    ++p; // Doubled quote
+                } else {
+                    ++p;
+                    break;
+                }
+            }
+            word += static_cast<char>(std::tolower(static_cast<unsigned char>(*p)));
+        }
+        return word;
+    }
+    while(std::isalnum(static_cast<unsigned char>(*p)) || *p == '_' || static_cast<unsigned char>(*p) >= 0x80){
+        word += static_cast<char>(std::tolower(static_cast<unsigned char>(*p++)));
+    }
+    return word;
+}
+
+ChangeFeed::ChangeFeed(sqlite3* handle)
+    : _handle(handle), _statementStart(0), _commitInFlight(false), _delivering(false), _nextId(1) {
+    sqlite3_update_hook(_handle, onUpdate, this);
+    sqlite3_commit_hook(_handle, onCommit, this);
+    sqlite3_rollback_hook(_handle, onRollback, this);
+}
+
+ChangeFeed::~ChangeFeed() {
+    sqlite3_update_hook(_handle, nullptr, nullptr);
+    sqlite3_commit_hook(_handle, nullptr, nullptr);
+    sqlite3_rollback_hook(_handle, nullptr, nullptr);
+}
+
+int ChangeFeed::subscribe(Listener listener) {
+    std::lock_guard<std::mutex> lock(_listenersMutex);
+    int id = _nextId++;
+    _listeners[id] = std::move(listener);
+    return id;
+}
+
+void ChangeFeed::unsubscribe(int id) {
+    std::lock_guard<std::mutex> lock(_listenersMutex);
+    _listeners.erase(id);
+}
+
+void ChangeFeed::deliver() {
+    if(_delivering || _committed.empty() || !sqlite3_get_autocommit(_handle)){
+        return;
+    }
+    // The commit went through: nothing left to undo on a later rollback
+    _commitInFlight = false;
+
+    std::vector<Batch> batches;
+    batches.swap(_committed);
+
+    std::vector<Listener> listeners;
+    {
+        std::lock_guard<std::mutex> lock(_listenersMutex);
+        for(auto& entry : _listeners){
+            listeners.push_back(entry.second);
+        }
+    }
+
+    // Listeners may run statements on this connection, don't re-enter
+    _delivering = true;
+    try{
+        for(const Batch& batch : batches){
+            for(Listener& listener : listeners){
+                listener(batch);
+            }
+        }
+    } catch(...) {
+        _delivering = false;
+        throw;
+    }
+    _delivering = false;
+}
+
+void ChangeFeed::onUpdate(void* data, int op, const char* dbName, const char* table, sqlite3_int64 rowid) {
+    ChangeFeed* feed = static_cast<ChangeFeed*>(data);
+    Operation operation = Operation::UPDATE;
+    if(op == SQLITE_INSERT){
+        operation = Operation::INSERT;
+    } else if(op == SQLITE_DELETE){
+        operation = Operation::DELETE;
+    }
+    feed->_pending.push_back(Event{operation, dbName ? dbName : "", table ? table : "", rowid});
+}
+
+int ChangeFeed::onCommit(void* data) {
+    ChangeFeed* feed = static_cast<ChangeFeed*>(data);
+    if(!feed->_pending.empty()){
+        feed->_committed.push_back(std::move(feed->_pending));
+        feed->_pending.clear();
+        feed->_commitInFlight = true;
+    }
+    feed->_savepoints.clear();
+    feed->_statementStart = 0;
+    return 0;
+}
+
+void ChangeFeed::onRollback(void* data) {
+    ChangeFeed* feed = static_cast<ChangeFeed*>(data);
+    feed->_pending.clear();
+    feed->_savepoints.clear();
+    feed->_statementStart = 0;
+    // A COMMIT that failed (e.g. SQLITE_BUSY) and was then rolled back
+    if(feed->_commitInFlight && !feed->_committed.empty()){
+        feed->_committed.pop_back();
+    }
+    feed->_commitInFlight = false;
+}
+
+void ChangeFeed::onStatement(const char* sql) {
+    _statementStart = _pending.size();
+    const char* p = sql;
+    std::string word = nextWord(p);
+    if(word == "savepoint"){
+        _savepoints.emplace_back(nextWord(p), _pending.size());
+        return;
+    }
+    bool rollback = word == "rollback";
+    if(rollback){
+        word = nextWord(p);
+        if(word == "transaction"){
+            word = nextWord(p);
+        }
+        if(word != "to"){
+            return; // Whole transaction, reported by the rollback hook
+        }
+    } else if(word != "release"){
+        return;
+    }
+    std::string name = nextWord(p);
+    if(name == "savepoint"){
+        name = nextWord(p);
+    }
+    for(std::size_t i = _savepoints.size(); i-- > 0;){
+        if(_savepoints[i].first == name){
+            if(rollback){
+                // The savepoint stays open, the ones after it are gone
+                _pending.resize(_savepoints[i].second);
+                _savepoints.resize(i + 1);
+            } else {
+                _savepoints.resize(i);
+            }
+            return;
+        }
+    }
+}
+
+void ChangeFeed::onStatementFailed() {
+    // A failed statement undoes its changes unless it failed under ON CONFLICT
+    // FAIL; SQLite then sets sqlite3_changes() to 0. Outside a transaction the
+    // rollback or commit hook already settled them.
+    if(!sqlite3_get_autocommit(_handle) && sqlite3_changes64(_handle) == 0 && _statementStart < _pending.size()){
+        _pending.resize(_statementStart);
+    }
+}
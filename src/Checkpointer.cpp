@@ -0,0 +1,186 @@
+#include <sq3pp/Checkpointer.h>
+#include <sq3pp/Exception.h>
+#include <sq3pp/Statement.h>
+#include "Reopen.h"
+
+using namespace sq3pp;
+using Clock = std::chrono::steady_clock;
+
+// WAL file layout: 32-byte header, then one 24-byte header per frame
+static int64_t walSize(int frames, int64_t pageSize) {
+    return frames > 0 ? 32 + static_cast<int64_t>(frames) * (pageSize + 24) : 0;
+}
+
+Checkpointer::Checkpointer(Database& db) : Checkpointer(db, Options()) {}
+
+Checkpointer::Checkpointer(Database& db, const Options& options, std::function<void(const Report& report)> onCheckpoint)
+    : _db(db), _options(options), _onCheckpoint(std::move(onCheckpoint)), _pageSize(4096), _autoCheckpoint(0),
+      _stopping(false), _requested(false), _walEmpty(true), _backfilled(0), _lastCommit(Clock::now()), _stats{} {
+    if(!_db.isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot start checkpointer: database is not open.");
+    }
+    const char* file = sqlite3_db_filename(_db.getHandle(), "main");
+    if(!file || !*file){
+        throw DatabaseException(SQ3::MISUSE, "Cannot start checkpointer: it needs a file database.");
+    }
+    std::string journalMode;
+    _db.execute("PRAGMA journal_mode;", [&journalMode](Row& row){
+        journalMode = row[0].valueAs<std::string>();
+    });
+    if(journalMode != "wal"){
+        throw DatabaseException(SQ3::MISUSE, "Cannot start checkpointer: the database is not in WAL mode.");
+    }
+    // The WAL hook replaces SQLite's auto-checkpoint; restored when stopping
+    _db.execute("PRAGMA wal_autocheckpoint;", [this](Row& row){
+        _autoCheckpoint = static_cast<int>(row[0].valueAs<int64_t>());
+    });
+    if(_options.frameThreshold <= 0){
+        _options.frameThreshold = 1000;
+    }
+
+    // Same VFS and URI parameters as the application's connection
+    int rc = detail::reopen(_db.getHandle(), _checkpointDb, SQLITE_OPEN_READWRITE);
+    if(rc != SQLITE_OK){
+        throw DatabaseException(static_cast<SQ3>(rc), std::string("Cannot open checkpoint connection: ") + sqlite3_errstr(rc));
+    }
+    sqlite3_busy_timeout(_checkpointDb.getHandle(), static_cast<int>(_options.busyTimeout.count()));
+    // Reading the journal mode also makes the new connection open the WAL
+    _checkpointDb.execute("PRAGMA journal_mode; PRAGMA page_size;", [this](Row& row){
+        if(row[0].isInteger()){
+            _pageSize = row[0].valueAs<int64_t>();
+        }
+    });
+
+    _db.setWalHook([this](const char*, int frames){
+        onCommit(frames);
+    });
+    _thread = std::thread(&Checkpointer::run, this);
+}
+
+Checkpointer::~Checkpointer() {
+    if(_db.isOpen()){
+        try{
+            _db.setWalHook(nullptr);
+            _db.setAutoCheckpoint(_autoCheckpoint);
+        } catch(...) {
+            // Suppress all exceptions in destructor
+        }
+    }
+    stop();
+}
+
+void Checkpointer::request() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _requested = true;
+    }
+    _wakeup.notify_one();
+}
+
+void Checkpointer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wakeup.notify_all();
+    if(_thread.joinable()){
+        _thread.join();
+    }
+}
+
+Checkpointer::Stats Checkpointer::stats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+void Checkpointer::onCommit(int frames) {
+    // Runs inside the writer's commit: only record and signal
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stats.walFrames = frames;
+        _stats.walBytes = walSize(frames, _pageSize);
+        _lastCommit = Clock::now();
+        _walEmpty = false;
+        if(frames < _backfilled){
+            _backfilled = 0; // The writer restarted the WAL from the beginning
+        }
+        if(frames - _backfilled >= _options.frameThreshold && !_requested){
+            _requested = wake = true;
+        }
+    }
+    if(wake){
+        _wakeup.notify_one();
+    }
+}
+
+void Checkpointer::run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while(!_stopping){
+        _wakeup.wait_for(lock, _options.interval, [this]{ return _stopping || _requested; });
+        if(_stopping){
+            break;
+        }
+        if(_walEmpty){
+            _requested = false;
+            continue;
+        }
+        CheckpointMode mode = CheckpointMode::PASSIVE;
+        if(Clock::now() - _lastCommit >= _options.idleAfter){
+            mode = _options.idleMode;
+        }else if(!_requested && _stats.walFrames <= _backfilled){
+            continue; // Scheduled round with nothing new to copy
+        }
+        _requested = false;
+        int frames = _stats.walFrames;
+        lock.unlock();
+        checkpoint(mode, frames);
+        lock.lock();
+    }
+}
+
+void Checkpointer::checkpoint(CheckpointMode mode, int walFrames) {
+    Report report;
+    report.mode = mode;
+    Clock::time_point start = Clock::now();
+    try{
+        report.result = _checkpointDb.checkpoint(mode);
+    } catch(const DatabaseException&) {
+        // Locked by another checkpointer or similar, retried on the next round
+        report.result = CheckpointResult{walFrames, -1, true};
+    }
+    report.duration = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+    report.walBytes = walSize(report.result.walFrames > 0 ? report.result.walFrames : walFrames, _pageSize);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_stats.checkpoints;
+        _stats.lastDuration = report.duration;
+        _stats.totalDuration += report.duration;
+        if(report.duration > _stats.maxDuration){
+            _stats.maxDuration = report.duration;
+        }
+        if(!report.result.busy && report.result.checkpointedFrames > _backfilled){
+            _backfilled = report.result.checkpointedFrames;
+        }
+        if(mode != CheckpointMode::PASSIVE){
+            ++_stats.escalations;
+            if(report.result.busy){
+                ++_stats.busy;
+            }else if(_lastCommit < start){
+                // No commit slipped in: the WAL is reset (and truncated) now
+                _walEmpty = true;
+                _backfilled = 0;
+                _stats.walFrames = 0;
+                _stats.walBytes = 0;
+            }
+        }
+    }
+    if(_onCheckpoint){
+        try{
+            _onCheckpoint(report);
+        } catch(...) {
+            // Keep checkpointing, a background thread has nowhere to report to
+        }
+    }
+}
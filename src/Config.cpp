@@ -0,0 +1,61 @@
+#include <sq3pp/Config.h>
+#include <sq3pp/Exception.h>
+#include "PoolAllocator.h"
+#include <sqlite3.h>
+#include <string>
+
+using namespace sq3pp;
+
+static void checkConfig(int rc, const char* option) {
+    if(rc == SQLITE_MISUSE){
+        throw DatabaseException(SQ3::MISUSE, std::string("Cannot set ") + option
+            + ": sq3pp::configure() must be called before the first database is opened.");
+    }
+    if(rc != SQLITE_OK){
+        throw DatabaseException(static_cast<SQ3>(rc), std::string("Cannot set ") + option + ": " + sqlite3_errstr(rc));
+    }
+}
+
+static bool usingPool = false;
+
+void sq3pp::configure(const Configuration& config) {
+    switch(config.threading){
+        case ThreadingMode::SINGLE_THREAD:
+            checkConfig(sqlite3_config(SQLITE_CONFIG_SINGLETHREAD), "threading mode");
+            break;
+        case ThreadingMode::MULTI_THREAD:
+            checkConfig(sqlite3_config(SQLITE_CONFIG_MULTITHREAD), "threading mode");
+            break;
+        case ThreadingMode::SERIALIZED:
+            checkConfig(sqlite3_config(SQLITE_CONFIG_SERIALIZED), "threading mode");
+            break;
+        case ThreadingMode::DEFAULT:
+        default:
+            break;
+    }
+
+    checkConfig(sqlite3_config(SQLITE_CONFIG_MEMSTATUS, config.memoryStatus ? 1 : 0), "memory status");
+
+    if(config.allocator == Allocator::POOL){
+        checkConfig(sqlite3_config(SQLITE_CONFIG_MALLOC, detail::poolMemMethods()), "allocator");
+        usingPool = true;
+    }
+
+    if(config.pageCacheSlots > 0 && config.pageCacheSlotSize > 0){
+        // A NULL buffer lets SQLite allocate the slots itself
+        checkConfig(sqlite3_config(SQLITE_CONFIG_PAGECACHE, nullptr, config.pageCacheSlotSize, config.pageCacheSlots), "page cache");
+    }
+
+    if(config.lookasideSlotSize >= 0 && config.lookasideSlots >= 0){
+        checkConfig(sqlite3_config(SQLITE_CONFIG_LOOKASIDE, config.lookasideSlotSize, config.lookasideSlots), "lookaside");
+    }
+
+    checkConfig(sqlite3_initialize(), "configuration");
+}
+
+AllocatorStats sq3pp::allocatorStats() {
+    if(!usingPool){
+        return AllocatorStats{};
+    }
+    return detail::poolAllocatorStats();
+}
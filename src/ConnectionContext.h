@@ -0,0 +1,256 @@
+#ifndef SQ3PP_CONNECTIONCONTEXT_H
+#define SQ3PP_CONNECTIONCONTEXT_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstring>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <sqlite3.h>
+#include <sq3pp/ChangeFeed.h>
+#include <sq3pp/Exception.h>
+#include <sq3pp/Statement.h>
+
+namespace sq3pp{
+namespace detail{
+
+// Per-connection state shared by a Database and the Statements/Transactions
+// created from it. Hooks registered on the sqlite3 handle point into this
+// object, so it is kept alive for as long as anything may step on the handle.
+struct ConnectionContext{
+    using Clock = std::chrono::steady_clock;
+
+    explicit ConnectionContext(std::shared_ptr<sqlite3> db)
+        : handle(std::move(db)), progressInterval(1000),
+          connectionDeadline(noDeadline()), statementDeadline(Clock::time_point::max()), deadlineExceeded(false) {
+        // Installed once, so setting a deadline from another thread only
+        // stores an atomic and never calls into the connection
+        installProgressHandler();
+        installAuthorizer();
+    }
+
+    ~ConnectionContext() {
+        // Unregister hooks before the handle can be closed
+        changeFeed.reset();
+        if(walListener){
+            sqlite3_wal_hook(handle.get(), nullptr, nullptr);
+        }
+        sqlite3_trace_v2(handle.get(), 0, nullptr, nullptr);
+        sqlite3_progress_handler(handle.get(), 0, nullptr, nullptr);
+        sqlite3_set_authorizer(handle.get(), nullptr, nullptr);
+    }
+
+    ChangeFeed& feed() {
+        if(!changeFeed){
+            changeFeed.reset(new ChangeFeed(handle.get()));
+            // Expires the prepared statements, so DELETEs prepared earlier
+            // stop using the truncate optimization too
+            installAuthorizer();
+            // The feed follows savepoints through the statements that start
+            installTrace();
+        }
+        return *changeFeed;
+    }
+
+    // Called once control returns from SQLite after a statement completed
+    void afterStep() {
+        if(changeFeed){
+            changeFeed->deliver();
+        }
+    }
+
+    static Clock::rep noDeadline() {
+        return Clock::time_point::max().time_since_epoch().count();
+    }
+
+    // The progress handler serves deadlines and the user callback alike
+    void installProgressHandler() {
+        sqlite3_progress_handler(handle.get(), progressInterval, onProgress, this);
+    }
+
+    static int onProgress(void* data) {
+        ConnectionContext* ctx = static_cast<ConnectionContext*>(data);
+        Clock::rep connection = ctx->connectionDeadline.load(std::memory_order_relaxed);
+        if(connection != noDeadline() || ctx->statementDeadline != Clock::time_point::max()){
+            Clock::time_point now = Clock::now();
+            if(now >= ctx->statementDeadline || now.time_since_epoch().count() >= connection){
+                ctx->deadlineExceeded = true;
+                return 1;
+            }
+        }
+        if(ctx->progressHandler){
+            try{
+                return ctx->progressHandler() ? 0 : 1;
+            } catch(...) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    // The only authorizer on the connection: sq3pp's own checks run here and
+    // the application's authorizer is chained from it
+    void installAuthorizer() {
+        sqlite3_set_authorizer(handle.get(), onAuthorize, this);
+    }
+
+    static int onAuthorize(void* data, int action, const char* arg1, const char* arg2, const char* database, const char* trigger) {
+        ConnectionContext* ctx = static_cast<ConnectionContext*>(data);
+        bool userTable = arg1 && std::strncmp(arg1, "sqlite_", 7) != 0;
+        if(action == SQLITE_READ && userTable && ctx->readTables){
+            ctx->readTables->insert(arg1);
+        }
+        int rc = SQLITE_OK;
+        if(ctx->authorizer){
+            try{
+                rc = ctx->authorizer(action, arg1, arg2, database, trigger);
+            } catch(...) {
+                rc = SQLITE_DENY;
+            }
+        }
+        // IGNORE on a DELETE turns off the truncate optimization, which would
+        // empty the table without reporting the rows to the change feed. DROP
+        // also authorizes a DELETE right after its own action, and IGNORE
+        // would skip the DROP.
+        if(rc == SQLITE_OK && action == SQLITE_DELETE && userTable && ctx->changeFeed && !isDrop(ctx->lastAction)){
+            rc = SQLITE_IGNORE;
+        }
+        ctx->lastAction = action;
+        return rc;
+    }
+
+    static bool isDrop(int action) {
+        return action == SQLITE_DROP_TABLE || action == SQLITE_DROP_TEMP_TABLE || action == SQLITE_DROP_VIEW
+               || action == SQLITE_DROP_TEMP_VIEW || action == SQLITE_DROP_VTABLE;
+    }
+
+    // Replaces automatic checkpoints, which use the same hook
+    void setWalListener(std::function<void(const char* schema, int frames)> listener) {
+        walListener = std::move(listener);
+        if(walListener){
+            sqlite3_wal_hook(handle.get(), onWal, this);
+        }else{
+            sqlite3_wal_hook(handle.get(), nullptr, nullptr);
+        }
+    }
+
+    static int onWal(void* data, sqlite3*, const char* schema, int frames) {
+        ConnectionContext* ctx = static_cast<ConnectionContext*>(data);
+        try{
+            ctx->walListener(schema, frames);
+        } catch(...) {
+            // The commit already succeeded, nothing to report it to
+        }
+        return SQLITE_OK;
+    }
+
+    // Statement start and completion listeners share the trace callback
+    void setStatementListener(std::function<void(const char* sql)> listener) {
+        statementListener = std::move(listener);
+        installTrace();
+    }
+
+    void setProfileListener(std::function<void(sqlite3_stmt* stmt, sqlite3_int64 nanoseconds)> listener) {
+        profileListener = std::move(listener);
+        installTrace();
+    }
+
+    void installTrace() {
+        unsigned int mask = (statementListener || changeFeed ? SQLITE_TRACE_STMT : 0) | (profileListener ? SQLITE_TRACE_PROFILE : 0);
+        sqlite3_trace_v2(handle.get(), mask, mask ? onTrace : nullptr, mask ? this : nullptr);
+    }
+
+    static int onTrace(unsigned int type, void* data, void* p, void* x) {
+        ConnectionContext* ctx = static_cast<ConnectionContext*>(data);
+        try{
+            if(type == SQLITE_TRACE_STMT){
+                const char* sql = static_cast<const char*>(x);
+                // Statements run by triggers start with "--"
+                if(ctx->changeFeed && !(sql[0] == '-' && sql[1] == '-')){
+                    ctx->changeFeed->onStatement(sql);
+                }
+                if(ctx->statementListener){
+                    ctx->statementListener(sql);
+                }
+            }else if(type == SQLITE_TRACE_PROFILE && ctx->profileListener){
+                ctx->profileListener(static_cast<sqlite3_stmt*>(p), *static_cast<sqlite3_int64*>(x));
+            }
+        } catch(...) {
+            // Must not unwind through SQLite
+        }
+        return 0;
+    }
+
+    // Error code for a failed step, interrupts caused by a deadline become TIMEOUT
+    SQ3 errorCode(int rc) {
+        if(changeFeed){
+            changeFeed->onStatementFailed();
+        }
+        if(rc == SQLITE_INTERRUPT && deadlineExceeded){
+            deadlineExceeded = false;
+            return SQ3::TIMEOUT;
+        }
+        return static_cast<SQ3>(rc);
+    }
+
+    std::shared_ptr<sqlite3> handle;
+    std::unique_ptr<ChangeFeed> changeFeed;
+
+    // Statements of Database::exec/queryOne. They hold a reference back to this
+    // context, so Database::close() clears the cache to break the cycle.
+    // Callers hold their own reference while running one, so evicting it
+    // from a nested call (row callback, change listener) is safe.
+    struct CachedStatement{
+        std::shared_ptr<Statement> stmt;
+        uint64_t lastUse;
+    };
+    std::unordered_map<std::string, CachedStatement> statementCache;
+    uint64_t statementUses = 0;
+
+    std::function<void(const char* schema, int frames)> walListener;
+    std::function<void(const char* sql)> statementListener;
+    std::function<void(sqlite3_stmt* stmt, sqlite3_int64 nanoseconds)> profileListener;
+
+    std::function<int(int action, const char* arg1, const char* arg2, const char* database, const char* trigger)> authorizer;
+    // When set, collects the tables read by the statements being prepared
+    std::set<std::string>* readTables = nullptr;
+    int lastAction = 0;
+
+    std::function<bool()> progressHandler;
+    int progressInterval;
+    std::atomic<Clock::rep> connectionDeadline;
+    Clock::time_point statementDeadline;
+    bool deadlineExceeded;
+};
+
+// Applies a statement deadline to the SQLite calls made during its lifetime
+class DeadlineScope{
+public:
+    DeadlineScope(ConnectionContext* ctx, ConnectionContext::Clock::time_point deadline)
+        : _ctx(ctx), _previous(ConnectionContext::Clock::time_point::max()) {
+        if(_ctx){
+            _ctx->deadlineExceeded = false;
+            _previous = _ctx->statementDeadline;
+            if(deadline < _previous){
+                _ctx->statementDeadline = deadline;
+            }
+        }
+    }
+
+    ~DeadlineScope() {
+        if(_ctx){
+            _ctx->statementDeadline = _previous;
+        }
+    }
+
+private:
+    ConnectionContext* _ctx;
+    ConnectionContext::Clock::time_point _previous;
+};
+
+}
+}
+#endif // SQ3PP_CONNECTIONCONTEXT_H
@@ -1,7 +1,14 @@
 #include <sq3pp/Database.h>
+#include <sq3pp/BulkLoadSession.h>
+#include <sq3pp/MergeSession.h>
 #include <sq3pp/Statement.h>
 #include <sq3pp/Transaction.h>
 #include <sq3pp/Exception.h>
+#include <sq3pp/ChangeFeed.h>
+#include <sq3pp/Session.h>
+#include <sq3pp/Snapshot.h>
+#include "ConnectionContext.h"
+#include "MmapVfs.h"
 #include <stdexcept>
 
 using namespace sq3pp;
@@ -15,12 +22,13 @@ Database::Database(const std::string& dbName) : _handle(nullptr) {
     open(dbName);
 }
 
-Database::Database(Database&& other) noexcept : _handle(std::move(other._handle)) {}
+Database::Database(Database&& other) noexcept : _handle(std::move(other._handle)), _context(std::move(other._context)) {}
 
 Database& Database::operator=(Database&& other) noexcept {
     if (this != &other) {
         close();
         _handle = std::move(other._handle);
+        _context = std::move(other._context);
     }
     return *this;
 }
@@ -41,7 +49,9 @@ int Database::open(const char* dbName) {
     }
     rc = sqlite3_open(dbName, &handle);
     if (rc == SQLITE_OK) {
-        _handle = std::shared_ptr<sqlite3>(handle, sqlite3_close);
+        std::shared_ptr<sqlite3> shared(handle, sqlite3_close);
+        std::atomic_store(&_context, std::make_shared<detail::ConnectionContext>(shared));
+        std::atomic_store(&_handle, shared);
     } else if (handle) {
         // SQLite may return a handle even on failure - must close it
         sqlite3_close(handle);
@@ -53,51 +63,329 @@ int Database::open(const std::string& dbName) {
     return open(dbName.c_str());
 }
 
-void Database::close() {
-    if (isOpen()) {
-        _handle.reset();
+int Database::open(const std::string& dbName, int flags, const char* vfs) {
+    sqlite3* handle = nullptr;
+    if (_handle) {
+        close();
+    }
+    int rc = sqlite3_open_v2(dbName.c_str(), &handle, flags, vfs);
+    if (rc == SQLITE_OK) {
+        std::shared_ptr<sqlite3> shared(handle, sqlite3_close);
+        std::atomic_store(&_context, std::make_shared<detail::ConnectionContext>(shared));
+        std::atomic_store(&_handle, shared);
+    } else if (handle) {
+        sqlite3_close(handle);
     }
+    return rc;
 }
 
-struct ExecuteCallback{
-    std::function<int(void*, int, char**, char**)> userCallback;
-    void* userData;
-};
+int Database::openImmutable(const std::string& path, bool preload) {
+    std::string uri = "file:";
+    for(char c : path){
+        if(c == '?' || c == '#' || c == '%'){
+            static const char hex[] = "0123456789ABCDEF";
+            uri += '%';
+            uri += hex[(c >> 4) & 0xF];
+            uri += hex[c & 0xF];
+        }else{
+            uri += c;
+        }
+    }
+    uri += "?immutable=1";
+    if(preload){
+        uri += "&preload=1";
+    }
+    const char* vfs = detail::immutableVfs();
+    int rc = open(uri, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI, vfs);
+    if(rc == SQLITE_OK && vfs){
+        // Let SQLite use xFetch for as much of the file as it allows
+        // (capped at SQLITE_MAX_MMAP_SIZE)
+        sqlite3_exec(_handle.get(), "PRAGMA mmap_size = 1099511627776;", nullptr, nullptr, nullptr);
+    }
+    return rc;
+}
 
-static int execCallback(void* data, int argc, char** argv, char** azColName) {
-    ExecuteCallback* execCb = reinterpret_cast<ExecuteCallback*>(data);
-    if(execCb && execCb->userCallback){
-        return execCb->userCallback(execCb->userData, argc, argv, azColName);
+void Database::close() {
+    if (isOpen()) {
+        // Release the context first so its hooks are removed before the handle closes
+        // Stored atomically: interrupt() and setDeadline() may read them from other threads
+        _context->statementCache.clear();
+        std::atomic_store(&_context, std::shared_ptr<detail::ConnectionContext>());
+        std::atomic_store(&_handle, std::shared_ptr<sqlite3>());
     }
-    return 0;
 }
 
-int Database::execute(const std::string& sql, std::function<int(void*,int, char**, char**)> callback, void* data) {
+int Database::execute(const std::string& sql, std::function<void(Row& row)> onRowFound) {
     if(!isOpen()){
-        return SQLITE_MISUSE;
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot execute: database is not open.");
     }
-    char* errMsg = nullptr;
-    ExecuteCallback execCb{callback, data};
+    sqlite3* db = _handle.get();
+    sqlite3_int64 changes = 0;
+    _context->deadlineExceeded = false;
+    const char* tail = sql.c_str();
+    const char* end = tail + sql.size();
+
+    while(tail < end){
+        sqlite3_stmt* raw = nullptr;
+        const char* next = nullptr;
+        int rc = sqlite3_prepare_v3(db, tail, static_cast<int>(end - tail), 0, &raw, &next);
+        if(rc != SQLITE_OK){
+            throw DatabaseException(static_cast<SQ3>(rc), std::string(sqlite3_errmsg(db))
+                + " (at offset " + std::to_string(tail - sql.c_str()) + ")");
+        }
+        const char* current = tail;
+        tail = next;
+        if(!raw){
+            continue; // Whitespace or comment
+        }
 
-    int rc = sqlite3_exec(_handle.get(), sql.c_str(), execCallback, &execCb, &errMsg);
-    if (rc != SQLITE_OK) {
-        if (errMsg) {
-            sqlite3_free(errMsg);
+        std::shared_ptr<sqlite3_stmt> stmt(raw, sqlite3_finalize);
+        sqlite3_int64 totalBefore = sqlite3_total_changes64(db);
+        int rowIndex = 0;
+        while((rc = sqlite3_step(raw)) == SQLITE_ROW){
+            if(onRowFound){
+                Row row(rowIndex, stmt);
+                onRowFound(row);
+            }
+            ++rowIndex;
+        }
+        if(rc != SQLITE_DONE){
+            const char* errMsg = sqlite3_errmsg(db);
+            if(!errMsg) errMsg = sqlite3_errstr(rc);
+            SQ3 code = _context->errorCode(rc);
+            if(code == SQ3::TIMEOUT) errMsg = "deadline exceeded";
+            throw DatabaseException(code, std::string(errMsg)
+                + " (at offset " + std::to_string(current - sql.c_str()) + ")");
         }
+        // Count before change listeners get a chance to run statements. The
+        // total moves only when an INSERT/UPDATE/DELETE ran, and then
+        // sqlite3_changes64() has its rows without those of triggers.
+        if(sqlite3_total_changes64(db) != totalBefore){
+            changes += sqlite3_changes64(db);
+        }
+        _context->afterStep();
     }
-    return rc;
+    return static_cast<int>(changes);
 }
 
 Statement Database::createStatement(const std::string& query) {
     if(!isOpen()){
         throw DatabaseException(SQ3::ERROR, "Cannot create statement: database is not open.");
     }
-    return Statement(_handle, query);
+    return Statement(_handle, _context, query);
+}
+
+Statement Database::createStatement(const std::string& query, unsigned int prepareFlags) {
+    if(!isOpen()){
+        throw DatabaseException(SQ3::ERROR, "Cannot create statement: database is not open.");
+    }
+    return Statement(_handle, _context, query, prepareFlags);
+}
+
+std::shared_ptr<Statement> Database::cachedStatement(const std::string& sql) {
+    if(!isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot execute: database is not open.");
+    }
+    auto& cache = _context->statementCache;
+    auto it = cache.find(sql);
+    bool busy = it != cache.end() && it->second.stmt.use_count() > 1;
+    if(it != cache.end() && !busy){
+        it->second.lastUse = ++_context->statementUses;
+        return it->second.stmt;
+    }
+    std::shared_ptr<Statement> stmt(new Statement(_handle, _context, sql, busy ? 0 : SQLITE_PREPARE_PERSISTENT));
+    if(!stmt->isValid()){
+        const char* errMsg = sqlite3_errmsg(_handle.get());
+        throw DatabaseException(static_cast<SQ3>(sqlite3_errcode(_handle.get())), errMsg ? errMsg : "Cannot prepare statement.");
+    }
+    // A hook or listener running the same SQL inside an outer exec/queryOne
+    // must not reset the outer statement: it gets a temporary one
+    if(busy){
+        return stmt;
+    }
+    // Bounded so ad-hoc SQL text cannot grow the cache forever: drop the
+    // least recently used statement that no caller is running
+    if(cache.size() >= 256){
+        auto victim = cache.end();
+        for(auto entry = cache.begin(); entry != cache.end(); ++entry){
+            if(entry->second.stmt.use_count() == 1 && (victim == cache.end() || entry->second.lastUse < victim->second.lastUse)){
+                victim = entry;
+            }
+        }
+        if(victim != cache.end()){
+            cache.erase(victim);
+        }
+    }
+    cache[sql] = detail::ConnectionContext::CachedStatement{stmt, ++_context->statementUses};
+    return stmt;
 }
 
 Transaction Database::beginTransaction() {
     if(!isOpen()){
         throw DatabaseException(SQ3::ERROR, "Cannot begin transaction: database is not open.");
     }
-    return Transaction(_handle);
-}
\ No newline at end of file
+    return Transaction(_handle, _context);
+}
+
+Snapshot Database::snapshot(const std::string& schema) {
+    if(!isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot take snapshot: database is not open.");
+    }
+    return Snapshot(_handle, schema);
+}
+
+Transaction Database::beginRead(const Snapshot& snapshot) {
+    if(!isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot begin read: database is not open.");
+    }
+    return Transaction(_handle, _context, &snapshot);
+}
+
+void Database::interrupt() {
+    std::shared_ptr<sqlite3> handle = std::atomic_load(&_handle);
+    if(handle){
+        sqlite3_interrupt(handle.get());
+    }
+}
+
+void Database::setDeadline(std::chrono::steady_clock::time_point deadline) {
+    std::shared_ptr<detail::ConnectionContext> context = std::atomic_load(&_context);
+    if(!context){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot set deadline: database is not open.");
+    }
+    context->connectionDeadline.store(deadline.time_since_epoch().count());
+}
+
+void Database::setTimeout(std::chrono::milliseconds timeout) {
+    setDeadline(std::chrono::steady_clock::now() + timeout);
+}
+
+void Database::clearDeadline() {
+    std::shared_ptr<detail::ConnectionContext> context = std::atomic_load(&_context);
+    if(context){
+        context->connectionDeadline.store(detail::ConnectionContext::noDeadline());
+    }
+}
+
+void Database::setProgressHandler(std::function<bool()> handler, int instructions) {
+    if(!isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot set progress handler: database is not open.");
+    }
+    _context->progressHandler = std::move(handler);
+    _context->progressInterval = instructions > 0 ? instructions : 1000;
+    _context->installProgressHandler();
+}
+
+void Database::setWalHook(std::function<void(const char* schema, int frames)> hook) {
+    if(!isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot set WAL hook: database is not open.");
+    }
+    _context->setWalListener(std::move(hook));
+}
+
+void Database::setStatementHook(std::function<void(const char* sql)> hook) {
+    if(!isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot set statement hook: database is not open.");
+    }
+    _context->setStatementListener(std::move(hook));
+}
+
+void Database::setProfileHook(std::function<void(sqlite3_stmt* stmt, std::chrono::nanoseconds elapsed)> hook) {
+    if(!isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot set profile hook: database is not open.");
+    }
+    if(!hook){
+        _context->setProfileListener(nullptr);
+        return;
+    }
+    _context->setProfileListener([hook](sqlite3_stmt* stmt, sqlite3_int64 nanoseconds){
+        hook(stmt, std::chrono::nanoseconds(nanoseconds));
+    });
+}
+
+void Database::setAuthorizer(std::function<int(int action, const char* arg1, const char* arg2,
+                                                const char* database, const char* trigger)> authorizer) {
+    if(!isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot set authorizer: database is not open.");
+    }
+    _context->authorizer = std::move(authorizer);
+    // Statements prepared under the previous authorizer are prepared again
+    _context->installAuthorizer();
+}
+
+void Database::setAutoCheckpoint(int frames) {
+    if(!isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot set auto-checkpoint: database is not open.");
+    }
+    // sqlite3_wal_autocheckpoint installs its own WAL hook
+    _context->walListener = nullptr;
+    sqlite3_wal_autocheckpoint(_handle.get(), frames);
+}
+
+CheckpointResult Database::checkpoint(CheckpointMode mode, const std::string& schema) {
+    if(!isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot checkpoint: database is not open.");
+    }
+    int sqliteMode = SQLITE_CHECKPOINT_PASSIVE;
+    switch(mode){
+        case CheckpointMode::FULL: sqliteMode = SQLITE_CHECKPOINT_FULL; break;
+        case CheckpointMode::RESTART: sqliteMode = SQLITE_CHECKPOINT_RESTART; break;
+        case CheckpointMode::TRUNCATE: sqliteMode = SQLITE_CHECKPOINT_TRUNCATE; break;
+        case CheckpointMode::PASSIVE:
+        default: break;
+    }
+    CheckpointResult result{-1, -1, false};
+    int rc = sqlite3_wal_checkpoint_v2(_handle.get(), schema.empty() ? nullptr : schema.c_str(), sqliteMode,
+                                       &result.walFrames, &result.checkpointedFrames);
+    if(rc == SQLITE_BUSY){
+        result.busy = true;
+    } else if(rc != SQLITE_OK){
+        const char* errMsg = sqlite3_errmsg(_handle.get());
+        if(!errMsg) errMsg = sqlite3_errstr(rc);
+        throw DatabaseException(static_cast<SQ3>(rc), std::string("Checkpoint failed: ") + errMsg);
+    }
+    return result;
+}
+
+ChangeFeed& Database::changeFeed() {
+    if(!isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot access change feed: database is not open.");
+    }
+    return _context->feed();
+}
+Session Database::trackChanges(const std::vector<std::string>& tables) {
+    if(!isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot track changes: database is not open.");
+    }
+    return Session(_handle, tables);
+}
+
+BulkLoadSession Database::beginBulkLoad(const std::vector<std::string>& tables) {
+    return BulkLoadSession(*this, tables);
+}
+
+BulkLoadSession Database::beginBulkLoad(const std::vector<std::string>& tables, const BulkLoadOptions& options) {
+    return BulkLoadSession(*this, tables, options);
+}
+
+MergeResult Database::merge(const std::string& table, const std::vector<std::string>& keyColumns,
+                            const std::vector<std::vector<CellValue>>& rows) {
+    return merge(table, keyColumns, rows, MergeOptions());
+}
+
+MergeResult Database::merge(const std::string& table, const std::vector<std::string>& keyColumns,
+                            const std::vector<std::vector<CellValue>>& rows, const MergeOptions& options) {
+    MergeSession session(*this, table, keyColumns, options);
+    for(const std::vector<CellValue>& row : rows){
+        session.add(row);
+    }
+    return session.finish();
+}
+
+MergeSession Database::beginMerge(const std::string& table, const std::vector<std::string>& keyColumns) {
+    return MergeSession(*this, table, keyColumns);
+}
+
+MergeSession Database::beginMerge(const std::string& table, const std::vector<std::string>& keyColumns, const MergeOptions& options) {
+    return MergeSession(*this, table, keyColumns, options);
+}
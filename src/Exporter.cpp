@@ -0,0 +1,277 @@
+#include <sq3pp/Exporter.h>
+#include <sq3pp/Exception.h>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace sq3pp;
+
+namespace{
+
+// Fixed-size buffer flushed to a file descriptor with write(2)
+class Writer{
+public:
+    Writer(int fd, std::size_t size) : _fd(fd), _buffer(size < 64 ? 64 : size), _used(0) {}
+
+    void put(char c) {
+        if(_used == _buffer.size()) flush();
+        _buffer[_used++] = c;
+    }
+
+    void put(const char* data, std::size_t size) {
+        if(size > _buffer.size() - _used){
+            flush();
+            if(size >= _buffer.size()){
+                writeAll(data, size);
+                return;
+            }
+        }
+        std::memcpy(_buffer.data() + _used, data, size);
+        _used += size;
+    }
+
+    void flush() {
+        writeAll(_buffer.data(), _used);
+        _used = 0;
+    }
+
+private:
+    void writeAll(const char* data, std::size_t size) {
+        while(size > 0){
+            ssize_t n = ::write(_fd, data, size);
+            if(n < 0){
+                if(errno == EINTR) continue;
+                throw DatabaseException(SQ3::IOERR, std::string("Failed to write output: ") + std::strerror(errno));
+            }
+            data += n;
+            size -= static_cast<std::size_t>(n);
+        }
+    }
+
+    int _fd;
+    std::vector<char> _buffer;
+    std::size_t _used;
+};
+
+}
+
+static void writeHex(Writer& out, const unsigned char* data, int size) {
+    static const char digits[] = "0123456789abcdef";
+    for(int i = 0; i < size; ++i){
+        out.put(digits[data[i] >> 4]);
+        out.put(digits[data[i] & 0x0F]);
+    }
+}
+
+static void writeCsv(Writer& out, const char* text, int size, char delimiter) {
+    // An unquoted empty field is NULL, so '' is written as ""
+    bool needsQuotes = size == 0;
+    for(int i = 0; i < size; ++i){
+        char c = text[i];
+        if(c == delimiter || c == '"' || c == '\n' || c == '\r'){
+            needsQuotes = true;
+            break;
+        }
+    }
+    if(!needsQuotes){
+        out.put(text, static_cast<std::size_t>(size));
+        return;
+    }
+    out.put('"');
+    const char* start = text;
+    const char* end = text + size;
+    for(const char* p = text; p < end; ++p){
+        if(*p == '"'){
+            out.put(start, static_cast<std::size_t>(p - start + 1));
+            out.put('"');
+            start = p + 1;
+        }
+    }
+    out.put(start, static_cast<std::size_t>(end - start));
+    out.put('"');
+}
+
+// Shortest of %.15g and %.17g that reads back as the same double, with
+// ".0" kept on whole numbers so they stay REAL. JSON has no infinities:
+// they are written as the strings SQLite renders them as.
+static void writeReal(Writer& out, double value, bool json) {
+    if(std::isnan(value)){
+        if(json) out.put("null", 4);
+        return;
+    }
+    if(std::isinf(value)){
+        const char* text = value > 0 ? "\"Inf\"" : "\"-Inf\"";
+        std::size_t size = std::strlen(text);
+        out.put(json ? text : text + 1, json ? size : size - 2);
+        return;
+    }
+    char buffer[32];
+    int size = std::snprintf(buffer, sizeof(buffer), "%.15g", value);
+    if(std::strtod(buffer, nullptr) != value){
+        size = std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+    }
+    out.put(buffer, static_cast<std::size_t>(size));
+    if(std::strspn(buffer, "-0123456789") == static_cast<std::size_t>(size)){
+        out.put(".0", 2);
+    }
+}
+
+static void writeJsonString(Writer& out, const char* text, int size) {
+    static const char digits[] = "0123456789abcdef";
+    out.put('"');
+    const char* start = text;
+    const char* end = text + size;
+    for(const char* p = text; p < end; ++p){
+        unsigned char c = static_cast<unsigned char>(*p);
+        if(c >= 0x20 && c != '"' && c != '\\'){
+            continue;
+        }
+        out.put(start, static_cast<std::size_t>(p - start));
+        start = p + 1;
+        out.put('\\');
+        switch(c){
+            case '"': out.put('"'); break;
+            case '\\': out.put('\\'); break;
+            case '\n': out.put('n'); break;
+            case '\r': out.put('r'); break;
+            case '\t': out.put('t'); break;
+            default:
+                out.put("u00", 3);
+                out.put(digits[c >> 4]);
+                out.put(digits[c & 0x0F]);
+                break;
+        }
+    }
+    out.put(start, static_cast<std::size_t>(end - start));
+    out.put('"');
+}
+
+Exporter::Exporter(Database& db) : Exporter(db, Options()) {}
+
+Exporter::Exporter(Database& db, const Options& options) : _db(db), _options(options) {}
+
+std::size_t Exporter::exportQuery(const std::string& sql, int fd) {
+    if(!_db.isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot export: database is not open.");
+    }
+    Statement stmt = _db.createStatement(sql);
+    if(!stmt.isValid()){
+        throw DatabaseException(static_cast<SQ3>(sqlite3_errcode(_db.getHandle())), sqlite3_errmsg(_db.getHandle()));
+    }
+    return exportQuery(stmt, fd);
+}
+
+std::size_t Exporter::exportFile(const std::string& sql, const std::string& path) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        throw DatabaseException(SQ3::CANTOPEN, "Cannot open " + path + ": " + std::strerror(errno));
+    }
+    std::size_t rows = 0;
+    try{
+        rows = exportQuery(sql, fd);
+    } catch(...) {
+        ::close(fd);
+        throw;
+    }
+    // Never retried: the descriptor is released even when close fails
+    if(::close(fd) != 0){
+        throw DatabaseException(SQ3::IOERR, "Failed to close " + path + ": " + std::strerror(errno));
+    }
+    return rows;
+}
+
+std::size_t Exporter::exportQuery(Statement& statement, int fd) {
+    if(!statement.isValid()){
+        throw DatabaseException(SQ3::MISUSE, "Cannot export: statement is not valid.");
+    }
+    // Keeps the bindings; starts over if the statement was stepped before
+    statement.reset(false);
+    sqlite3_stmt* stmt = statement.getHandle();
+    const int columns = sqlite3_column_count(stmt);
+    const bool json = _options.format == DataFormat::NDJSON;
+    Writer out(fd, _options.bufferSize);
+
+    // Pre-render what repeats on every row
+    std::vector<std::string> keys;
+    for(int i = 0; i < columns; ++i){
+        const char* name = sqlite3_column_name(stmt, i);
+        name = name ? name : "";
+        if(json){
+            std::string key;
+            for(const char* p = name; *p; ++p){
+                if(*p == '"' || *p == '\\') key += '\\';
+                key += *p;
+            }
+            keys.push_back((i ? ",\"" : "{\"") + key + "\":");
+        } else if(_options.header){
+            if(i) out.put(_options.delimiter);
+            writeCsv(out, name, static_cast<int>(std::strlen(name)), _options.delimiter);
+        }
+    }
+    if(!json && _options.header && columns > 0){
+        out.put('\n');
+    }
+
+    std::size_t rows = 0;
+    try{
+        while(statement.stepRow()){
+            for(int i = 0; i < columns; ++i){
+                if(json){
+                    out.put(keys[i].data(), keys[i].size());
+                } else if(i){
+                    out.put(_options.delimiter);
+                }
+                switch(sqlite3_column_type(stmt, i)){
+                    case SQLITE_NULL:
+                        if(json) out.put("null", 4);
+                        break;
+                    case SQLITE_INTEGER: {
+                        // SQLite renders integers itself, no CellValue round-trip
+                        const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
+                        out.put(text, static_cast<std::size_t>(sqlite3_column_bytes(stmt, i)));
+                        break;
+                    }
+                    case SQLITE_FLOAT:
+                        // Its text form keeps only 15 significant digits
+                        writeReal(out, sqlite3_column_double(stmt, i), json);
+                        break;
+                    case SQLITE_BLOB: {
+                        const unsigned char* data = static_cast<const unsigned char*>(sqlite3_column_blob(stmt, i));
+                        int size = sqlite3_column_bytes(stmt, i);
+                        if(json) out.put('"');
+                        writeHex(out, data, size);
+                        if(json) out.put('"');
+                        break;
+                    }
+                    case SQLITE_TEXT:
+                    default: {
+                        const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
+                        int size = sqlite3_column_bytes(stmt, i);
+                        if(json){
+                            writeJsonString(out, text, size);
+                        } else {
+                            writeCsv(out, text, size, _options.delimiter);
+                        }
+                        break;
+                    }
+                }
+            }
+            if(json){
+                out.put(columns ? "}\n" : "{}\n", columns ? 2 : 3);
+            } else {
+                out.put('\n');
+            }
+            ++rows;
+        }
+    } catch(...) {
+        statement.reset(false);
+        throw;
+    }
+    statement.reset(false);
+    out.flush();
+    return rows;
+}
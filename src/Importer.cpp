@@ -0,0 +1,599 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <sq3pp/Importer.h>
+#include <sq3pp/Exception.h>
+#include "SqlText.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#endif
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace sq3pp;
+using detail::quoteIdentifier;
+
+static void throwStepError(sqlite3_stmt* stmt, int rc) {
+    const char* errMsg = sqlite3_errmsg(sqlite3_db_handle(stmt));
+    if(!errMsg) errMsg = sqlite3_errstr(rc);
+    throw DatabaseException(static_cast<SQ3>(rc), errMsg);
+}
+
+static void run(Statement& stmt) {
+    stmt.reset();
+    try{
+        stmt.execute();
+    } catch(...) {
+        stmt.reset();
+        throw;
+    }
+    stmt.reset();
+}
+
+static void appendUtf8(std::string& out, unsigned int cp) {
+    if(cp < 0x80){
+        out += static_cast<char>(cp);
+    } else if(cp < 0x800){
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if(cp < 0x10000){
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+static unsigned int parseHex4(const char* p) {
+    unsigned int value = 0;
+    for(int i = 0; i < 4; ++i){
+        char c = p[i];
+        value <<= 4;
+        if(c >= '0' && c <= '9') value |= static_cast<unsigned int>(c - '0');
+        else if(c >= 'a' && c <= 'f') value |= static_cast<unsigned int>(c - 'a' + 10);
+        else if(c >= 'A' && c <= 'F') value |= static_cast<unsigned int>(c - 'A' + 10);
+        else throw DatabaseException(SQ3::FORMAT, "Invalid \\u escape in JSON string.");
+    }
+    return value;
+}
+
+Importer::Importer(Database& db, const std::string& table) : Importer(db, table, Options()) {}
+
+Importer::Importer(Database& db, const std::string& table, const Options& options)
+    : _db(db), _table(table), _options(options), _ownTransaction(false), _rowsInBatch(0), _rows(0),
+      _fieldStart(0), _inQuotes(false), _quoted(false), _pendingQuote(false), _headerDone(false) {
+    if(!_db.isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot create importer: database is not open.");
+    }
+    if(_options.batchSize == 0) _options.batchSize = 1;
+    if(_options.chunkSize == 0) _options.chunkSize = 1 << 20;
+
+    Statement info = _db.createStatement("SELECT name FROM pragma_table_info(?);");
+    info.bind(_table);
+    info.execute([this](Row& row){
+        _tableColumns.push_back(row[0].valueAs<std::string>());
+    });
+    if(_tableColumns.empty()){
+        throw DatabaseException(SQ3::ERROR, "Cannot import: no such table: " + _table);
+    }
+    _begin = _db.createStatement("BEGIN;");
+    _commit = _db.createStatement("COMMIT;");
+}
+
+Importer::~Importer() {
+    abort();
+}
+
+std::size_t Importer::importFd(int fd) {
+    begin();
+    try{
+        std::vector<char> chunk(_options.chunkSize);
+        for(;;){
+            ssize_t n = ::read(fd, chunk.data(), chunk.size());
+            if(n < 0){
+                if(errno == EINTR) continue;
+                throw DatabaseException(SQ3::IOERR, std::string("Failed to read input: ") + std::strerror(errno));
+            }
+            if(n == 0) break;
+            feed(chunk.data(), static_cast<std::size_t>(n));
+        }
+        return finish();
+    } catch(...) {
+        abort();
+        throw;
+    }
+}
+
+std::size_t Importer::importFile(const std::string& path, bool useMmap) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        throw DatabaseException(SQ3::CANTOPEN, "Cannot open " + path + ": " + std::strerror(errno));
+    }
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    struct stat st;
+    if(useMmap && ::fstat(fd, &st) == 0 && st.st_size > 0){
+        std::size_t size = static_cast<std::size_t>(st.st_size);
+        void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(mapped == MAP_FAILED){
+            throw DatabaseException(SQ3::IOERR, "Cannot map " + path + ": " + std::strerror(errno));
+        }
+#ifdef HAVE_MADVISE
+        ::madvise(mapped, size, MADV_SEQUENTIAL);
+#endif
+        try{
+            std::size_t rows = importBuffer(static_cast<const char*>(mapped), size);
+            ::munmap(mapped, size);
+            return rows;
+        } catch(...) {
+            ::munmap(mapped, size);
+            throw;
+        }
+    }
+#else
+    (void)useMmap; // No mmap: always read through importFd
+#endif
+    try{
+        std::size_t rows = importFd(fd);
+        ::close(fd);
+        return rows;
+    } catch(...) {
+        ::close(fd);
+        throw;
+    }
+}
+
+std::size_t Importer::importBuffer(const char* data, std::size_t size) {
+    begin();
+    try{
+        // Feed in chunks so batches are committed while parsing large buffers
+        while(size > 0){
+            std::size_t n = size < _options.chunkSize ? size : _options.chunkSize;
+            feed(data, n);
+            data += n;
+            size -= n;
+        }
+        return finish();
+    } catch(...) {
+        abort();
+        throw;
+    }
+}
+
+void Importer::abort() {
+    if(_ownTransaction){
+        // Drop the uncommitted batch, earlier batches stay committed
+        _ownTransaction = false;
+        sqlite3_exec(_db.getHandle(), "ROLLBACK;", nullptr, nullptr, nullptr);
+    }
+}
+
+void Importer::begin() {
+    _rows = 0;
+    _rowsInBatch = 0;
+    _buffer.clear();
+    _fields.clear();
+    _fieldStart = 0;
+    _inQuotes = _quoted = _pendingQuote = false;
+    _headerDone = false;
+    _jsonKeys.clear();
+
+    if(_options.format == DataFormat::NDJSON){
+        prepareInsert(_tableColumns);
+        _jsonColumnIndex.clear();
+    } else if(!_options.header){
+        prepareInsert(_tableColumns);
+        _headerDone = true;
+    }
+
+    _ownTransaction = sqlite3_get_autocommit(_db.getHandle()) != 0;
+    if(_ownTransaction){
+        run(_begin);
+    }
+}
+
+std::size_t Importer::finish() {
+    if(_options.format == DataFormat::CSV){
+        if(_pendingQuote){
+            _pendingQuote = false;
+            _inQuotes = false;
+        }
+        if(_inQuotes){
+            throw DatabaseException(SQ3::FORMAT, "Unterminated quoted CSV field.");
+        }
+        if(!_buffer.empty() || !_fields.empty() || _quoted){
+            endCsvField(_quoted);
+            endCsvRecord();
+        }
+    } else if(!_buffer.empty()){
+        std::string line;
+        line.swap(_buffer);
+        parseJsonLine(line.data(), line.size());
+    }
+    if(_ownTransaction){
+        commitBatch(false);
+    }
+    return _rows;
+}
+
+void Importer::feed(const char* data, std::size_t size) {
+    if(_options.format == DataFormat::CSV){
+        feedCsv(data, size);
+    } else {
+        feedJson(data, size);
+    }
+}
+
+void Importer::feedCsv(const char* data, std::size_t size) {
+    const char* p = data;
+    const char* end = data + size;
+    const char delimiter = _options.delimiter;
+
+    while(p < end){
+        if(_pendingQuote){
+            // Previous chunk ended on a quote inside a quoted field
+            _pendingQuote = false;
+            if(*p == '"'){
+                _buffer += '"';
+                ++p;
+                continue;
+            }
+            _inQuotes = false;
+        }
+
+        if(_inQuotes){
+            const char* q = static_cast<const char*>(std::memchr(p, '"', static_cast<std::size_t>(end - p)));
+            if(!q){
+                _buffer.append(p, end);
+                return;
+            }
+            _buffer.append(p, q);
+            p = q + 1;
+            if(p == end){
+                _pendingQuote = true;
+                return;
+            }
+            if(*p == '"'){
+                _buffer += '"';
+                ++p;
+            } else {
+                _inQuotes = false;
+            }
+            continue;
+        }
+
+        // Copy the plain run up to the next special character
+        const char* q = p;
+        while(q < end && *q != delimiter && *q != '\n' && *q != '\r' && *q != '"'){
+            ++q;
+        }
+        _buffer.append(p, q);
+        p = q;
+        if(p == end){
+            return;
+        }
+
+        char c = *p++;
+        if(c == '"'){
+            _inQuotes = true;
+            _quoted = true;
+        } else if(c == delimiter){
+            endCsvField(_quoted);
+        } else if(c == '\n'){
+            if(_buffer.empty() && _fields.empty() && !_quoted){
+                continue; // Blank line
+            }
+            endCsvField(_quoted);
+            endCsvRecord();
+        }
+        // '\r' outside quotes is dropped
+    }
+}
+
+void Importer::endCsvField(bool quoted) {
+    std::size_t length = _buffer.size() - _fieldStart;
+    FieldType type = (!quoted && length == 0 && _options.emptyAsNull) ? FieldType::NULLTYPE : FieldType::TEXT;
+    _fields.push_back(Field{_fieldStart, length, type});
+    _buffer += '\0';
+    _fieldStart = _buffer.size();
+    _quoted = false;
+}
+
+void Importer::endCsvRecord() {
+    if(!_headerDone){
+        std::vector<std::string> columns;
+        for(const Field& field : _fields){
+            columns.emplace_back(_buffer.data() + field.offset, field.length);
+        }
+        prepareInsert(columns);
+        _headerDone = true;
+    } else {
+        insertRow(_buffer.data());
+    }
+    _buffer.clear();
+    _fields.clear();
+    _fieldStart = 0;
+}
+
+void Importer::feedJson(const char* data, std::size_t size) {
+    const char* p = data;
+    const char* end = data + size;
+    while(p < end){
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+        if(!nl){
+            _buffer.append(p, end);
+            return;
+        }
+        if(_buffer.empty()){
+            // Whole line inside the chunk: parse in place
+            parseJsonLine(p, static_cast<std::size_t>(nl - p));
+        } else {
+            _buffer.append(p, nl);
+            std::string line;
+            line.swap(_buffer);
+            parseJsonLine(line.data(), line.size());
+            line.clear();
+            _buffer.swap(line); // Keep the capacity
+        }
+        p = nl + 1;
+    }
+}
+
+void Importer::parseJsonLine(const char* line, std::size_t size) {
+    const char* p = line;
+    const char* end = line + size;
+    auto skipSpace = [&](){
+        while(p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+    };
+    auto fail = [&](const char* what){
+        throw DatabaseException(SQ3::FORMAT, std::string("Invalid NDJSON at row ") + std::to_string(_rows + 1) + ": " + what);
+    };
+    // Unescape a JSON string starting after the opening quote into out
+    auto readString = [&](std::string& out){
+        for(;;){
+            const char* q = p;
+            while(q < end && *q != '"' && *q != '\\') ++q;
+            out.append(p, q);
+            p = q;
+            if(p >= end) fail("unterminated string");
+            if(*p++ == '"') return;
+            if(p >= end) fail("unterminated escape");
+            char e = *p++;
+            switch(e){
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'u': {
+                    if(end - p < 4) fail("truncated \\u escape");
+                    unsigned int cp = parseHex4(p);
+                    p += 4;
+                    if(cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u'){
+                        unsigned int low = parseHex4(p + 2);
+                        if(low >= 0xDC00 && low < 0xE000){
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                            p += 6;
+                        }
+                    }
+                    appendUtf8(out, cp);
+                    break;
+                }
+                default: out += e; break;
+            }
+        }
+    };
+
+    skipSpace();
+    if(p == end){
+        return; // Blank line
+    }
+    if(*p++ != '{') fail("expected an object");
+
+    _fields.assign(_tableColumns.size(), Field{0, 0, FieldType::NULLTYPE});
+    std::string& values = _values;
+    std::string& key = _key;
+    values.clear();
+    std::size_t keyPosition = 0;
+
+    skipSpace();
+    if(p < end && *p == '}'){
+        ++p;
+    } else {
+        for(;;){
+            skipSpace();
+            if(p >= end || *p++ != '"') fail("expected a key");
+            key.clear();
+            readString(key);
+            skipSpace();
+            if(p >= end || *p++ != ':') fail("expected ':'");
+            skipSpace();
+            if(p >= end) fail("expected a value");
+
+            // Objects usually repeat the key order of the previous line
+            int column = -1;
+            if(keyPosition < _jsonKeys.size() && _jsonKeys[keyPosition] == key){
+                column = _jsonColumnIndex[keyPosition];
+            } else {
+                for(std::size_t i = 0; i < _tableColumns.size(); ++i){
+                    if(_tableColumns[i] == key){
+                        column = static_cast<int>(i);
+                        break;
+                    }
+                }
+                if(keyPosition < _jsonKeys.size()){
+                    _jsonKeys.resize(keyPosition);
+                    _jsonColumnIndex.resize(keyPosition);
+                }
+                _jsonKeys.push_back(key);
+                _jsonColumnIndex.push_back(column);
+            }
+            ++keyPosition;
+
+            std::size_t offset = values.size();
+            FieldType type = FieldType::TEXT;
+            char c = *p;
+            if(c == '"'){
+                ++p;
+                readString(values);
+            } else if(c == '-' || (c >= '0' && c <= '9')){
+                const char* q = p;
+                type = FieldType::INTEGER;
+                while(q < end && (std::strchr("+-0123456789.eE", *q) != nullptr)){
+                    if(*q == '.' || *q == 'e' || *q == 'E') type = FieldType::REAL;
+                    ++q;
+                }
+                values.append(p, q);
+                p = q;
+            } else if(c == 't' && end - p >= 4 && std::strncmp(p, "true", 4) == 0){
+                type = FieldType::INTEGER;
+                values += '1';
+                p += 4;
+            } else if(c == 'f' && end - p >= 5 && std::strncmp(p, "false", 5) == 0){
+                type = FieldType::INTEGER;
+                values += '0';
+                p += 5;
+            } else if(c == 'n' && end - p >= 4 && std::strncmp(p, "null", 4) == 0){
+                type = FieldType::NULLTYPE;
+                p += 4;
+            } else if(c == '{' || c == '['){
+                // Keep nested values as JSON text
+                const char* q = p;
+                int depth = 0;
+                bool inString = false;
+                for(; q < end; ++q){
+                    if(inString){
+                        if(*q == '\\') ++q;
+                        else if(*q == '"') inString = false;
+                    } else if(*q == '"'){
+                        inString = true;
+                    } else if(*q == '{' || *q == '['){
+                        ++depth;
+                    } else if(*q == '}' || *q == ']'){
+                        if(--depth == 0){
+                            ++q;
+                            break;
+                        }
+                    }
+                }
+                if(depth != 0) fail("unterminated nested value");
+                values.append(p, q);
+                p = q;
+            } else {
+                fail("unexpected value");
+            }
+
+            if(column >= 0){
+                _fields[static_cast<std::size_t>(column)] = Field{offset, values.size() - offset, type};
+            }
+            values += '\0';
+
+            skipSpace();
+            if(p >= end) fail("unterminated object");
+            if(*p == ','){
+                ++p;
+                continue;
+            }
+            if(*p++ != '}') fail("expected ',' or '}'");
+            break;
+        }
+    }
+
+    insertRow(_values.data());
+}
+
+void Importer::prepareInsert(const std::vector<std::string>& columns) {
+    if(columns.empty()){
+        throw DatabaseException(SQ3::FORMAT, "Cannot import: no columns.");
+    }
+    std::string sql = "INSERT INTO " + quoteIdentifier(_table) + " (";
+    std::string params;
+    for(std::size_t i = 0; i < columns.size(); ++i){
+        if(i){
+            sql += ", ";
+            params += ", ";
+        }
+        sql += quoteIdentifier(columns[i]);
+        params += "?";
+    }
+    sql += ") VALUES (" + params + ");";
+
+    _insert = _db.createStatement(sql);
+    if(!_insert.isValid()){
+        throw DatabaseException(static_cast<SQ3>(sqlite3_errcode(_db.getHandle())), sqlite3_errmsg(_db.getHandle()));
+    }
+}
+
+void Importer::insertRow(const char* base) {
+    sqlite3_stmt* stmt = _insert.getHandle();
+    int paramCount = sqlite3_bind_parameter_count(stmt);
+    if(static_cast<int>(_fields.size()) > paramCount){
+        throw DatabaseException(SQ3::MISMATCH, "Too many fields at row " + std::to_string(_rows + 1) + ".");
+    }
+
+    for(int i = 0; i < paramCount; ++i){
+        int rc = SQLITE_OK;
+        if(i >= static_cast<int>(_fields.size())){
+            rc = sqlite3_bind_null(stmt, i + 1);
+        } else {
+            const Field& field = _fields[static_cast<std::size_t>(i)];
+            const char* text = base + field.offset;
+            switch(field.type){
+                case FieldType::INTEGER: {
+                    errno = 0;
+                    long long value = std::strtoll(text, nullptr, 10);
+                    // Too large for 64 bits: keep the magnitude as REAL, like SQLite does
+                    rc = errno == ERANGE ? sqlite3_bind_double(stmt, i + 1, std::strtod(text, nullptr))
+                                         : sqlite3_bind_int64(stmt, i + 1, value);
+                    break;
+                }
+                case FieldType::REAL:
+                    rc = sqlite3_bind_double(stmt, i + 1, std::strtod(text, nullptr));
+                    break;
+                case FieldType::NULLTYPE:
+                    rc = sqlite3_bind_null(stmt, i + 1);
+                    break;
+                case FieldType::TEXT:
+                default:
+                    // The row buffer is untouched until the step below completes
+                    rc = sqlite3_bind_text(stmt, i + 1, text, static_cast<int>(field.length), SQLITE_STATIC);
+                    break;
+            }
+        }
+        if(rc != SQLITE_OK){
+            throwStepError(stmt, rc);
+        }
+    }
+
+    int rc = sqlite3_step(stmt);
+    if(rc != SQLITE_DONE){
+        std::string errMsg = sqlite3_errmsg(sqlite3_db_handle(stmt));
+        sqlite3_reset(stmt);
+        throw DatabaseException(static_cast<SQ3>(rc), errMsg + " (row " + std::to_string(_rows + 1) + ")");
+    }
+    sqlite3_reset(stmt);
+    ++_rows;
+    if(_ownTransaction && ++_rowsInBatch >= _options.batchSize){
+        commitBatch(true);
+    }
+}
+
+void Importer::commitBatch(bool reopen) {
+    // Cleared only once committed: after a failed COMMIT the transaction is
+    // still open and abort() must roll it back
+    run(_commit);
+    _ownTransaction = false;
+    _rowsInBatch = 0;
+    if(reopen){
+        run(_begin);
+        _ownTransaction = true;
+    }
+}
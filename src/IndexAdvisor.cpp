@@ -0,0 +1,1025 @@
+#include <sq3pp/IndexAdvisor.h>
+#include <sq3pp/Exception.h>
+#include <sq3pp/QueryPlanGuard.h>
+#include <sq3pp/Statement.h>
+#include "SqlText.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <set>
+#include <sstream>
+
+using namespace sq3pp;
+using detail::quoteIdentifier;
+using detail::quoteString;
+
+// Prefix of the indexes tried on the scratch schema
+static const std::string CANDIDATE = "sq3pp_advisor_";
+
+namespace{
+
+std::string lower(std::string text) {
+    for(char& c : text){
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return text;
+}
+
+std::string upper(std::string text) {
+    for(char& c : text){
+        c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    return text;
+}
+
+bool startsWith(const std::string& text, const char* prefix) {
+    return text.compare(0, std::char_traits<char>::length(prefix), prefix) == 0;
+}
+
+// --- Tokenizer --------------------------------------------------------------
+
+struct Token{
+    enum Kind{WORD, QUOTED, STRING, NUMBER, PARAMETER, SYMBOL};
+    Kind kind;
+    std::string text;       // Upper case for words, unquoted for quoted names
+    std::size_t begin;      // Position in the statement
+    std::size_t end;
+};
+
+bool isNameChar(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$' || static_cast<unsigned char>(c) >= 0x80;
+}
+
+std::vector<Token> tokenize(const std::string& sql) {
+    std::vector<Token> tokens;
+    std::size_t i = 0;
+    const std::size_t length = sql.size();
+    while(i < length){
+        char c = sql[i];
+        if(std::isspace(static_cast<unsigned char>(c))){
+            ++i;
+        }else if(c == '-' && i + 1 < length && sql[i + 1] == '-'){
+            i = sql.find('\n', i);
+            if(i == std::string::npos) break;
+        }else if(c == '/' && i + 1 < length && sql[i + 1] == '*'){
+            i = sql.find("*/", i + 2);
+            if(i == std::string::npos) break;
+            i += 2;
+        }else if(c == '\'' || c == '"' || c == '`' || c == '['){
+            char close = c == '[' ? ']' : c;
+            std::string text;
+            std::size_t j = i + 1;
+            while(j < length){
+                if(sql[j] == close){
+                    if(close != ']' && j + 1 < length && sql[j + 1] == close){
+                        text += close;
+                        j += 2;
+                        continue;
+                    }
+                    break;
+                }
+                text += sql[j++];
+            }
+            tokens.push_back(Token{c == '\'' ? Token::STRING : Token::QUOTED, text, i, std::min(j + 1, length)});
+            i = j + 1;
+        }else if(std::isdigit(static_cast<unsigned char>(c)) || (c == '.' && i + 1 < length && std::isdigit(static_cast<unsigned char>(sql[i + 1])))){
+            std::size_t j = i;
+            while(j < length && (isNameChar(sql[j]) || sql[j] == '.')) ++j;
+            tokens.push_back(Token{Token::NUMBER, sql.substr(i, j - i), i, j});
+            i = j;
+        }else if(c == '?' || c == ':' || c == '@' || (c == '$' && i + 1 < length && isNameChar(sql[i + 1]))){
+            std::size_t j = i + 1;
+            while(j < length && isNameChar(sql[j])) ++j;
+            tokens.push_back(Token{Token::PARAMETER, sql.substr(i, j - i), i, j});
+            i = j;
+        }else if(isNameChar(c)){
+            std::size_t j = i;
+            while(j < length && isNameChar(sql[j])) ++j;
+            tokens.push_back(Token{Token::WORD, upper(sql.substr(i, j - i)), i, j});
+            i = j;
+        }else{
+            static const char* const pairs[] = {"==", "!=", "<>", "<=", ">=", "||", "<<", ">>", "->"};
+            std::string symbol(1, c);
+            for(const char* pair : pairs){
+                if(sql.compare(i, 2, pair) == 0){
+                    symbol = pair;
+                    break;
+                }
+            }
+            tokens.push_back(Token{Token::SYMBOL, symbol, i, i + symbol.size()});
+            i += symbol.size();
+        }
+    }
+    return tokens;
+}
+
+// The statement with its literals replaced by parameters, so that runs
+// differing only in constants count as one statement. ORDER BY 1 and the
+// like keep their numbers.
+std::string normalize(const std::string& sql) {
+    std::vector<Token> tokens = tokenize(sql);
+    std::string out;
+    std::size_t copied = 0;
+    std::string lastWord;
+    for(std::size_t i = 0; i < tokens.size(); ++i){
+        const Token& token = tokens[i];
+        if(token.kind == Token::WORD){
+            lastWord = token.text;
+            continue;
+        }
+        if(token.kind != Token::STRING && (token.kind != Token::NUMBER || lastWord == "BY")){
+            continue;
+        }
+        std::size_t begin = token.begin;
+        if(token.kind == Token::STRING && i > 0 && tokens[i - 1].text == "X" && tokens[i - 1].end == begin){
+            begin = tokens[i - 1].begin; // Blob literal x'...'
+        }
+        out.append(sql, copied, begin - copied);
+        out += '?';
+        copied = token.end;
+    }
+    out.append(sql, copied, std::string::npos);
+    return out;
+}
+
+bool isKeyword(const std::string& word) {
+    static const std::set<std::string> keywords = {
+        "ABORT", "ALL", "AND", "AS", "ASC", "BETWEEN", "BY", "CASE", "CAST", "COLLATE", "CROSS", "CURRENT_DATE",
+        "CURRENT_TIME", "CURRENT_TIMESTAMP", "DEFAULT", "DELETE", "DESC", "DISTINCT", "DO", "ELSE", "END", "ESCAPE",
+        "EXCEPT", "EXISTS", "FAIL", "FALSE", "FILTER", "FIRST", "FROM", "FULL", "GLOB", "GROUP", "HAVING", "IGNORE",
+        "IN", "INDEXED", "INNER", "INSERT", "INTERSECT", "INTO", "IS", "ISNULL", "JOIN", "LAST", "LEFT", "LIKE",
+        "LIMIT", "MATCH", "NATURAL", "NOT", "NOTHING", "NOTNULL", "NULL", "NULLS", "OFFSET", "ON", "OR", "ORDER",
+        "OUTER", "OVER", "PARTITION", "RAISE", "RECURSIVE", "REGEXP", "REPLACE", "RETURNING", "RIGHT", "ROLLBACK",
+        "SELECT", "SET", "THEN", "TRUE", "UNION", "UPDATE", "USING", "VALUES", "WHEN", "WHERE", "WINDOW", "WITH"
+    };
+    return keywords.count(word) > 0;
+}
+
+// --- Column usage of one statement ------------------------------------------
+
+enum class Role{EQUAL, RANGE, ORDER, GROUP};
+
+struct Reference{
+    std::string qualifier;
+    std::string column;
+    Role role;
+};
+
+struct Usage{
+    std::map<std::string, std::string> aliases;    // Lower-case alias or name -> table
+    std::string target;                             // Table written by INSERT, UPDATE or DELETE
+    std::vector<Reference> references;
+    bool plainOrder = true;                         // ORDER BY lists bare columns only
+};
+
+bool isName(const Token& token) {
+    return token.kind == Token::QUOTED || (token.kind == Token::WORD && !isKeyword(token.text));
+}
+
+bool isSymbol(const Token* token, const char* symbol) {
+    return token && token->kind == Token::SYMBOL && token->text == symbol;
+}
+
+bool isWord(const Token* token, const char* word) {
+    return token && token->kind == Token::WORD && token->text == word;
+}
+
+bool isEqualOperator(const Token* token) {
+    return isSymbol(token, "=") || isSymbol(token, "==") || isWord(token, "IN") || isWord(token, "IS");
+}
+
+bool isRangeOperator(const Token* token) {
+    return isSymbol(token, "<") || isSymbol(token, "<=") || isSymbol(token, ">") || isSymbol(token, ">=") || isWord(token, "BETWEEN");
+}
+
+// Which columns a statement filters, joins, sorts and groups on. A token scan,
+// not a parser: it only has to find column references next to comparison
+// operators in WHERE and ON clauses and the plain terms of ORDER BY and GROUP BY.
+Usage parseUsage(const std::string& sql) {
+    enum class Clause{NONE, TABLES, PREDICATE, ORDER, GROUP};
+    std::vector<Token> tokens = tokenize(sql);
+    auto at = [&tokens](std::size_t index) -> const Token* {
+        return index < tokens.size() ? &tokens[index] : nullptr;
+    };
+
+    Usage usage;
+    Clause clause = Clause::NONE;
+    bool expectTable = false;
+    bool targetNext = false;
+    bool deleting = false;
+    std::string lastTable;
+    for(std::size_t i = 0; i < tokens.size(); ++i){
+        const Token& token = tokens[i];
+        if(token.kind == Token::WORD && isKeyword(token.text)){
+            const std::string& word = token.text;
+            if(word == "FROM" || word == "JOIN"){
+                clause = Clause::TABLES;
+                expectTable = true;
+                targetNext = deleting && usage.target.empty();
+                deleting = false;
+            }else if(word == "INTO" || word == "UPDATE"){
+                clause = Clause::TABLES;
+                expectTable = true;
+                targetNext = usage.target.empty();
+            }else if(word == "DELETE"){
+                deleting = true;
+            }else if(word == "WHERE" || word == "ON"){
+                clause = Clause::PREDICATE;
+            }else if(word == "ORDER"){
+                clause = Clause::ORDER;
+            }else if(word == "GROUP"){
+                clause = Clause::GROUP;
+            }else if(word == "SELECT" || word == "SET" || word == "HAVING" || word == "LIMIT" || word == "VALUES"
+                      || word == "RETURNING" || word == "UNION" || word == "EXCEPT" || word == "INTERSECT"
+                      || word == "WINDOW" || word == "USING" || word == "INDEXED" || word == "DO"){
+                clause = Clause::NONE;
+                lastTable.clear();
+            }
+            continue;
+        }
+
+        if(clause == Clause::TABLES){
+            if(isName(token)){
+                if(expectTable){
+                    std::string name = token.text;
+                    if(isSymbol(at(i + 1), ".") && at(i + 2) && isName(*at(i + 2))){
+                        name = tokens[i + 2].text; // schema.table
+                        i += 2;
+                    }
+                    lastTable = name;
+                    usage.aliases[lower(name)] = name;
+                    if(targetNext){
+                        usage.target = name;
+                        targetNext = false;
+                    }
+                    expectTable = false;
+                }else if(!lastTable.empty()){
+                    usage.aliases[lower(token.text)] = lastTable;
+                    lastTable.clear();
+                }
+            }else if(isSymbol(&token, ",")){
+                expectTable = true;
+                lastTable.clear();
+            }else if(isSymbol(&token, "(")){
+                expectTable = false; // Subquery or table-valued function
+                lastTable.clear();
+            }
+            continue;
+        }
+
+        if(clause == Clause::NONE){
+            continue;
+        }
+        if(!isName(token) || isSymbol(at(i + 1), "(")){
+            if(clause == Clause::ORDER && !isSymbol(&token, ",") && !isSymbol(&token, ")") && !isSymbol(&token, ";")){
+                usage.plainOrder = false; // An expression, not a column
+            }
+            continue;
+        }
+
+        Reference reference;
+        std::size_t last = i;
+        reference.column = token.text;
+        while(isSymbol(at(last + 1), ".") && at(last + 2) && isName(*at(last + 2))){
+            reference.qualifier = tokens[last].text;
+            reference.column = tokens[last + 2].text;
+            last += 2;
+        }
+        const Token* previous = i > 0 ? at(i - 1) : nullptr;
+        const Token* next = at(last + 1);
+        i = last;
+
+        if(clause == Clause::PREDICATE){
+            if(isWord(next, "IS") && isWord(at(last + 2), "NOT")){
+                continue;
+            }
+            if(isEqualOperator(next) || isSymbol(previous, "=") || isSymbol(previous, "==")){
+                reference.role = Role::EQUAL;
+            }else if(isRangeOperator(next) || isSymbol(previous, "<") || isSymbol(previous, "<=")
+                     || isSymbol(previous, ">") || isSymbol(previous, ">=")){
+                reference.role = Role::RANGE;
+            }else{
+                continue;
+            }
+        }else{
+            bool startsTerm = isWord(previous, "BY") || isSymbol(previous, ",");
+            bool endsTerm = !next || isSymbol(next, ",") || isSymbol(next, ")") || isSymbol(next, ";")
+                            || (next->kind == Token::WORD && isKeyword(next->text));
+            if(!startsTerm || !endsTerm){
+                if(clause == Clause::ORDER){
+                    usage.plainOrder = false;
+                }
+                continue;
+            }
+            reference.role = clause == Clause::ORDER ? Role::ORDER : Role::GROUP;
+        }
+        usage.references.push_back(reference);
+    }
+    return usage;
+}
+
+// --- Scratch schema and statistics ------------------------------------------
+
+struct TableInfo{
+    std::string name;
+    std::map<std::string, std::string> columns;         // Lower-case -> declared name
+    std::string rowidColumn;                            // Lower-case INTEGER PRIMARY KEY, if any
+    std::vector<std::vector<std::string>> indexes;      // Lower-case columns, "" for expressions
+};
+
+using Schema = std::map<std::string, TableInfo>;        // By lower-case name
+
+struct Statistics{
+    std::map<std::string, double> rows;                 // By lower-case table
+    std::map<std::string, std::vector<double>> average; // Rows per key prefix, by lower-case index
+};
+
+Schema readSchema(Database& scratch) {
+    Schema schema;
+    std::vector<std::string> tables;
+    scratch.execute("SELECT name FROM sqlite_master WHERE type = 'table' AND name NOT LIKE 'sqlite_%';", [&tables](Row& row){
+        tables.push_back(row[0].valueAs<std::string>());
+    });
+    for(const std::string& table : tables){
+        TableInfo info;
+        info.name = table;
+        int keys = 0;
+        std::string integerKey;
+        scratch.execute("PRAGMA table_info(" + quoteIdentifier(table) + ");", [&](Row& row){
+            std::string column = row[1].valueAs<std::string>();
+            info.columns[lower(column)] = column;
+            if(row[5].valueAs<int>() > 0){
+                ++keys;
+                if(upper(row[2].valueAs<std::string>()) == "INTEGER"){
+                    integerKey = lower(column);
+                }
+            }
+        });
+        if(keys == 1){
+            info.rowidColumn = integerKey;
+        }
+        std::vector<std::string> indexes;
+        scratch.execute("PRAGMA index_list(" + quoteIdentifier(table) + ");", [&indexes](Row& row){
+            if(row[4].valueAs<int>() == 0){ // Partial indexes only cover some rows
+                indexes.push_back(row[1].valueAs<std::string>());
+            }
+        });
+        for(const std::string& index : indexes){
+            std::vector<std::string> columns;
+            scratch.execute("SELECT coalesce(name, '') FROM pragma_index_info(" + quoteString(index) + ");", [&columns](Row& row){
+                columns.push_back(lower(row[0].valueAs<std::string>()));
+            });
+            info.indexes.push_back(columns);
+        }
+        schema[lower(table)] = info;
+    }
+    return schema;
+}
+
+Statistics readStatistics(Database& scratch) {
+    Statistics statistics;
+    scratch.execute("SELECT tbl, coalesce(idx, ''), stat FROM sqlite_stat1;", [&statistics](Row& row){
+        std::istringstream in(row[2].valueAs<std::string>());
+        std::vector<double> numbers;
+        double number;
+        while(in >> number){
+            numbers.push_back(number);
+        }
+        if(numbers.empty()){
+            return;
+        }
+        double& rows = statistics.rows[lower(row[0].valueAs<std::string>())];
+        rows = std::max(rows, numbers[0]);
+        std::string index = row[1].valueAs<std::string>();
+        if(!index.empty()){
+            numbers.erase(numbers.begin());
+            statistics.average[lower(index)] = numbers;
+        }
+    });
+    return statistics;
+}
+
+// sqlite_stat1 line for an index on columns of table, from up to sample rows.
+// Keys that repeat a lot in the sample are assumed to cover the whole table;
+// otherwise the sample is taken as representative of rows per key.
+std::string sampleStatistics(Database& db, const std::string& table, const std::vector<std::string>& columns,
+                             double rows, int64_t sample) {
+    std::string list;
+    std::string source = "(SELECT ";
+    for(std::size_t i = 0; i < columns.size(); ++i){
+        source += (i ? ", " : "") + quoteIdentifier(columns[i]);
+    }
+    source += " FROM " + quoteIdentifier(table) + " LIMIT " + std::to_string(sample) + ")";
+    double sampled = static_cast<double>(db.queryOne<int64_t>("SELECT count(*) FROM " + source + ";").value_or(0));
+
+    std::string stat = std::to_string(static_cast<int64_t>(rows));
+    for(std::size_t i = 0; i < columns.size(); ++i){
+        list += (i ? ", " : "") + quoteIdentifier(columns[i]);
+        double distinct = static_cast<double>(db.queryOne<int64_t>(
+            "SELECT count(*) FROM (SELECT DISTINCT " + list + " FROM " + source + ");").value_or(0));
+        double average = 1.0;
+        if(distinct > 0){
+            average = distinct * 10 <= sampled ? rows / distinct : sampled / distinct;
+        }
+        stat += " " + std::to_string(static_cast<int64_t>(std::ceil(std::max(1.0, average))));
+    }
+    return stat;
+}
+
+// --- Cost estimate ----------------------------------------------------------
+
+// Number of equality and range terms in "(a=? AND b>? AND b<?)"
+void countTerms(const std::string& detail, int& equal, int& range) {
+    equal = 0;
+    range = 0;
+    std::size_t open = detail.rfind('(');
+    if(open == std::string::npos){
+        return;
+    }
+    std::string terms = detail.substr(open + 1);
+    std::size_t start = 0;
+    while(start < terms.size()){
+        std::size_t end = terms.find(" AND ", start);
+        std::string term = terms.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        if(term.find('<') != std::string::npos || term.find('>') != std::string::npos){
+            ++range;
+        }else if(term.find('=') != std::string::npos){
+            ++equal;
+        }
+        if(end == std::string::npos) break;
+        start = end + 5;
+    }
+}
+
+// Rows visited by a plan, from the row counts and index statistics the
+// planner itself sees: nested loops multiply, sorts add n log n.
+double planCost(const QueryPlan& plan, const Usage& usage, const Schema& schema, const Statistics& statistics) {
+    struct Loops{
+        double rows = 1.0;
+        int sorts = 0;
+    };
+    std::map<int, Loops> groups;
+    double cost = 0.0;
+    for(const QueryPlan::Node& node : plan.nodes){
+        const std::string& detail = node.detail;
+        if(startsWith(detail, "USE TEMP B-TREE")){
+            ++groups[node.parent].sorts;
+            continue;
+        }
+        bool search = startsWith(detail, "SEARCH ");
+        if((!search && !startsWith(detail, "SCAN ")) || detail == "SCAN CONSTANT ROW"){
+            continue;
+        }
+        std::size_t nameStart = detail.find(' ') + 1;
+        std::string name = lower(detail.substr(nameStart, detail.find(' ', nameStart) - nameStart));
+        auto alias = usage.aliases.find(name);
+        if(alias != usage.aliases.end()){
+            name = lower(alias->second);
+        }
+        auto known = statistics.rows.find(name);
+        double tableRows = schema.count(name) ? (known != statistics.rows.end() ? known->second : 1000000.0) : 1.0;
+
+        double rows = tableRows;
+        double loopCost = tableRows;
+        double once = 0.0;
+        if(search){
+            int equal = 0;
+            int range = 0;
+            countTerms(detail, equal, range);
+            double seek = std::log2(tableRows + 1.0);
+            if(detail.find("AUTOMATIC") != std::string::npos){
+                // Built for every run of the statement, then probed
+                once = tableRows + tableRows * seek;
+                rows = 10.0;
+            }else if(detail.find("INTEGER PRIMARY KEY") != std::string::npos){
+                rows = equal ? 1.0 : tableRows;
+            }else{
+                std::size_t index = detail.find("INDEX ");
+                std::vector<double> average;
+                if(index != std::string::npos){
+                    std::size_t start = index + 6;
+                    auto found = statistics.average.find(lower(detail.substr(start, detail.find(' ', start) - start)));
+                    if(found != statistics.average.end()){
+                        average = found->second;
+                    }
+                }
+                if(equal > 0){
+                    rows = static_cast<std::size_t>(equal) <= average.size() ? average[equal - 1] : tableRows / std::pow(10.0, equal);
+                }
+            }
+            rows /= std::pow(4.0, std::min(range, 2));
+            rows = std::max(1.0, std::min(rows, tableRows));
+            loopCost = seek + rows;
+        }
+        Loops& loops = groups[node.parent];
+        cost += loops.rows * loopCost + once;
+        loops.rows *= rows;
+    }
+    for(const auto& group : groups){
+        if(group.second.sorts > 0){
+            double rows = std::max(1.0, group.second.rows);
+            cost += group.second.sorts * rows * std::log2(rows + 1.0);
+        }
+    }
+    return cost;
+}
+
+// --- Candidates -------------------------------------------------------------
+
+struct Analysis{
+    IndexAdvisor::Observed observed;
+    Usage usage;
+    std::set<std::string> tables;           // Lower-case tables referenced
+    bool writes = false;                    // INSERT, UPDATE or DELETE of usage.target
+    double cost = 0.0;                      // One execution with the current indexes
+};
+
+struct Candidate{
+    std::string table;                      // Lower-case
+    std::vector<std::string> columns;       // Declared names
+    std::set<std::size_t> statements;       // Analyses that led to it
+    std::string stat;                       // Sampled sqlite_stat1 line, once computed
+};
+
+std::string columnList(const std::vector<std::string>& columns) {
+    std::string list;
+    for(const std::string& column : columns){
+        list += (list.empty() ? "" : ", ") + quoteIdentifier(column);
+    }
+    return list;
+}
+
+bool usesIndex(const QueryPlan& plan, const std::string& index) {
+    for(const QueryPlan::Node& node : plan.nodes){
+        std::size_t found = node.detail.find("INDEX ");
+        if(found == std::string::npos){
+            continue;
+        }
+        std::size_t start = found + 6;
+        if(node.detail.compare(start, node.detail.find(' ', start) - start, index) == 0){
+            return true;
+        }
+    }
+    return false;
+}
+
+void dropCandidate(Database& scratch, const std::string& name) {
+    scratch.execute("DROP INDEX IF EXISTS " + quoteIdentifier(name) + ";");
+    scratch.exec("DELETE FROM sqlite_stat1 WHERE idx = ?;", name);
+}
+
+void addUnique(std::vector<std::string>& columns, const std::string& column) {
+    for(const std::string& existing : columns){
+        if(lower(existing) == lower(column)){
+            return;
+        }
+    }
+    columns.push_back(column);
+}
+
+bool covered(const TableInfo& table, const std::vector<std::string>& columns) {
+    for(const std::vector<std::string>& index : table.indexes){
+        if(index.size() < columns.size()){
+            continue;
+        }
+        bool prefix = true;
+        for(std::size_t i = 0; i < columns.size() && prefix; ++i){
+            prefix = index[i] == lower(columns[i]);
+        }
+        if(prefix){
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string candidateKey(const std::string& table, const std::vector<std::string>& columns) {
+    std::string key = table;
+    for(const std::string& column : columns){
+        key += '\x1f' + lower(column);
+    }
+    return key;
+}
+
+// Index candidates of one statement: its equality columns followed by one
+// range column, and its equality columns followed by its ORDER BY (or
+// GROUP BY) columns when they all belong to one table
+void proposeCandidates(const Analysis& analysis, std::size_t position, const Schema& schema,
+                       std::map<std::string, Candidate>& candidates) {
+    struct Columns{
+        std::vector<std::string> equal, range, order, group;
+    };
+    std::map<std::string, Columns> byTable;
+    std::set<std::string> orderTables;
+    std::set<std::string> groupTables;
+    bool resolved = true;
+    for(const Reference& reference : analysis.usage.references){
+        std::string table;
+        std::string column = lower(reference.column);
+        if(!reference.qualifier.empty()){
+            auto alias = analysis.usage.aliases.find(lower(reference.qualifier));
+            table = lower(alias != analysis.usage.aliases.end() ? alias->second : reference.qualifier);
+            auto info = schema.find(table);
+            if(info == schema.end() || !info->second.columns.count(column)){
+                table.clear();
+            }
+        }else{
+            for(const std::string& name : analysis.tables){
+                auto info = schema.find(name);
+                if(info != schema.end() && info->second.columns.count(column)){
+                    if(!table.empty()){
+                        table.clear(); // Ambiguous
+                        break;
+                    }
+                    table = name;
+                }
+            }
+        }
+        if(table.empty()){
+            if(reference.role == Role::ORDER || reference.role == Role::GROUP){
+                resolved = false;
+            }
+            continue;
+        }
+        const std::string& declared = schema.at(table).columns.at(column);
+        Columns& columns = byTable[table];
+        switch(reference.role){
+            case Role::EQUAL: addUnique(columns.equal, declared); break;
+            case Role::RANGE: addUnique(columns.range, declared); break;
+            case Role::ORDER: addUnique(columns.order, declared); orderTables.insert(table); break;
+            case Role::GROUP: addUnique(columns.group, declared); groupTables.insert(table); break;
+        }
+    }
+
+    auto propose = [&](const std::string& table, const std::vector<std::string>& columns){
+        const TableInfo& info = schema.at(table);
+        if(columns.empty() || startsWith(table, "sqlite_") || covered(info, columns)){
+            return;
+        }
+        Candidate& candidate = candidates[candidateKey(table, columns)];
+        candidate.table = table;
+        candidate.columns = columns;
+        candidate.statements.insert(position);
+    };
+
+    for(const auto& entry : byTable){
+        const TableInfo& info = schema.at(entry.first);
+        const Columns& columns = entry.second;
+        bool byRowid = false;
+        for(const std::string& column : columns.equal){
+            byRowid = byRowid || lower(column) == info.rowidColumn;
+        }
+        if(byRowid){
+            continue; // Already a rowid lookup
+        }
+        std::vector<std::string> filter = columns.equal;
+        for(const std::string& column : columns.range){
+            if(lower(column) != info.rowidColumn && std::find(filter.begin(), filter.end(), column) == filter.end()){
+                filter.push_back(column);
+                break;
+            }
+        }
+        propose(entry.first, filter);
+
+        const std::vector<std::string>& sorted = !columns.order.empty() ? columns.order : columns.group;
+        const std::set<std::string>& sortTables = !columns.order.empty() ? orderTables : groupTables;
+        bool sortable = resolved && (columns.order.empty() || analysis.usage.plainOrder);
+        if(!sorted.empty() && sortable && sortTables.size() == 1 && lower(sorted[0]) != info.rowidColumn){
+            std::vector<std::string> ordered = columns.equal;
+            for(const std::string& column : sorted){
+                addUnique(ordered, column);
+            }
+            propose(entry.first, ordered);
+        }
+    }
+}
+
+// Data statements, leaving out those on the schema and statistics tables,
+// which SQLite itself also runs, e.g. when loading sqlite_stat1
+bool isWorkload(const char* sql) {
+    const char* start = sql;
+    while(*start && (std::isspace(static_cast<unsigned char>(*start)) || *start == '(')){
+        ++start;
+    }
+    std::string word;
+    while(std::isalpha(static_cast<unsigned char>(*start))){
+        word += static_cast<char>(std::toupper(static_cast<unsigned char>(*start++)));
+    }
+    if(word != "SELECT" && word != "WITH" && word != "INSERT" && word != "REPLACE" && word != "UPDATE" && word != "DELETE"){
+        return false;
+    }
+    return lower(sql).find("sqlite_") == std::string::npos;
+}
+
+std::string indexName(const std::string& table, const std::vector<std::string>& columns) {
+    std::string name = table;
+    for(const std::string& column : columns){
+        name += "_" + column;
+    }
+    for(char& c : name){
+        if(!std::isalnum(static_cast<unsigned char>(c))){
+            c = '_';
+        }
+    }
+    return name;
+}
+
+}
+
+IndexAdvisor::IndexAdvisor(Database& db) : IndexAdvisor(db, Options()) {}
+
+IndexAdvisor::IndexAdvisor(Database& db, const Options& options) : _db(db), _options(options), _recording(true) {
+    if(!_db.isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot start index advisor: database is not open.");
+    }
+    _db.setProfileHook([this](sqlite3_stmt* stmt, std::chrono::nanoseconds elapsed){
+        onProfile(stmt, elapsed);
+    });
+}
+
+IndexAdvisor::~IndexAdvisor() {
+    if(_db.isOpen()){
+        try{
+            _db.setProfileHook(nullptr);
+        } catch(...) {
+            // Suppress all exceptions in destructor
+        }
+    }
+}
+
+void IndexAdvisor::onProfile(sqlite3_stmt* stmt, std::chrono::nanoseconds elapsed) {
+    if(!_recording){
+        return;
+    }
+    const char* sql = sqlite3_sql(stmt);
+    if(!sql || !isWorkload(sql)){
+        return;
+    }
+    // Reset so a cached statement only reports its latest run
+    uint64_t fullScanSteps = static_cast<uint64_t>(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1));
+    uint64_t sorts = static_cast<uint64_t>(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1));
+    uint64_t autoIndexes = static_cast<uint64_t>(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1));
+
+    std::string text = normalize(sql);
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto found = _statements.find(text);
+    if(found == _statements.end()){
+        if(_statements.size() >= _options.maxStatements){
+            return;
+        }
+        found = _statements.emplace(text, Observed{text, 0, 0, 0, 0, std::chrono::nanoseconds(0)}).first;
+    }
+    Observed& observed = found->second;
+    ++observed.executions;
+    observed.fullScanSteps += fullScanSteps;
+    observed.sorts += sorts;
+    observed.autoIndexes += autoIndexes;
+    observed.time += elapsed;
+}
+
+void IndexAdvisor::record(const std::string& sql, uint64_t executions) {
+    std::string text = normalize(sql);
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto found = _statements.find(text);
+    if(found == _statements.end()){
+        if(_statements.size() >= _options.maxStatements){
+            return;
+        }
+        found = _statements.emplace(text, Observed{text, 0, 0, 0, 0, std::chrono::nanoseconds(0)}).first;
+    }
+    found->second.executions += executions;
+}
+
+std::vector<IndexAdvisor::Observed> IndexAdvisor::workload() const {
+    std::vector<Observed> statements;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for(const auto& statement : _statements){
+            statements.push_back(statement.second);
+        }
+    }
+    std::stable_sort(statements.begin(), statements.end(), [](const Observed& a, const Observed& b){
+        return a.time > b.time;
+    });
+    return statements;
+}
+
+void IndexAdvisor::clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _statements.clear();
+}
+
+std::vector<IndexAdvisor::Recommendation> IndexAdvisor::analyze() {
+    if(!_db.isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot analyze: database is not open.");
+    }
+    // Our own queries are not part of the workload
+    struct Pause{
+        std::atomic<bool>& recording;
+        bool previous;
+        ~Pause() {recording = previous;}
+    } pause{_recording, _recording.exchange(false)};
+    std::vector<Observed> statements = workload();
+
+    // Scratch copy of the schema, without data
+    Database scratch(":memory:");
+    _db.execute("SELECT sql FROM sqlite_master WHERE sql IS NOT NULL AND type IN ('table', 'index', 'view')"
+                " AND name NOT LIKE 'sqlite_%' ORDER BY CASE type WHEN 'table' THEN 0 WHEN 'index' THEN 1 ELSE 2 END, rowid;",
+                [&scratch](Row& row){
+        try{
+            scratch.execute(row[0].valueAs<std::string>());
+        } catch(const DatabaseException&) {
+            // e.g. a virtual table whose module is not loaded here
+        }
+    });
+    Schema schema = readSchema(scratch);
+
+    // Row counts and index statistics: the real ones where ANALYZE has run,
+    // counted and sampled for the other tables
+    scratch.execute("ANALYZE; DELETE FROM sqlite_stat1;");
+    std::set<std::string> analyzed;
+    if(_db.queryOne<int>("SELECT count(*) FROM sqlite_master WHERE name = 'sqlite_stat1';").value_or(0) > 0){
+        _db.execute("SELECT tbl, coalesce(idx, ''), stat FROM sqlite_stat1;", [&](Row& row){
+            std::string table = row[0].valueAs<std::string>();
+            if(!schema.count(lower(table))){
+                return;
+            }
+            std::optional<std::string> index;
+            if(!row[1].valueAs<std::string>().empty()){
+                index = row[1].valueAs<std::string>();
+            }
+            scratch.exec("INSERT INTO sqlite_stat1 VALUES (?, ?, ?);", table, index, row[2].valueAs<std::string>());
+            analyzed.insert(lower(table));
+        });
+    }
+    for(const auto& entry : schema){
+        const TableInfo& info = entry.second;
+        if(analyzed.count(entry.first)){
+            continue;
+        }
+        int64_t rows = 0;
+        try{
+            rows = _db.queryOne<int64_t>("SELECT count(*) FROM " + quoteIdentifier(info.name) + ";").value_or(0);
+        } catch(const DatabaseException&) {
+            continue;
+        }
+        scratch.exec("INSERT INTO sqlite_stat1 VALUES (?, NULL, ?);", info.name, std::to_string(rows));
+        std::vector<std::string> indexes;
+        scratch.execute("PRAGMA index_list(" + quoteIdentifier(info.name) + ");", [&indexes](Row& row){
+            indexes.push_back(row[1].valueAs<std::string>());
+        });
+        for(const std::string& index : indexes){
+            std::vector<std::string> columns;
+            bool plain = true;
+            scratch.execute("SELECT coalesce(name, '') FROM pragma_index_info(" + quoteString(index) + ");", [&](Row& row){
+                std::string column = row[0].valueAs<std::string>();
+                plain = plain && !column.empty(); // Empty for expressions
+                columns.push_back(column);
+            });
+            if(plain && !columns.empty()){
+                scratch.exec("INSERT INTO sqlite_stat1 VALUES (?, ?, ?);", info.name, index,
+                             sampleStatistics(_db, info.name, columns, static_cast<double>(rows), _options.sampleRows));
+            }
+        }
+    }
+    scratch.execute("ANALYZE sqlite_master;");
+    Statistics statistics = readStatistics(scratch);
+
+    // Current plans and the candidates they suggest
+    std::vector<Analysis> analyses;
+    std::map<std::string, Candidate> candidates;
+    for(const Observed& observed : statements){
+        Analysis analysis;
+        analysis.observed = observed;
+        analysis.usage = parseUsage(observed.sql);
+        for(const auto& alias : analysis.usage.aliases){
+            if(schema.count(lower(alias.second))){
+                analysis.tables.insert(lower(alias.second));
+            }
+        }
+        std::vector<Token> tokens = tokenize(observed.sql);
+        analysis.writes = !analysis.usage.target.empty() && !tokens.empty() && tokens[0].kind == Token::WORD
+                          && tokens[0].text != "SELECT" && tokens[0].text != "WITH";
+        try{
+            analysis.cost = planCost(QueryPlan::explain(scratch, observed.sql), analysis.usage, schema, statistics);
+        } catch(const DatabaseException&) {
+            continue; // e.g. refers to temporary or attached tables
+        }
+        analyses.push_back(analysis);
+        proposeCandidates(analyses.back(), analyses.size() - 1, schema, candidates);
+    }
+
+    // Greedy: try every remaining candidate against the indexes accepted so
+    // far, keep the best one, repeat until nothing helps any more
+    std::vector<Recommendation> recommendations;
+    std::vector<Candidate> remaining;
+    for(const auto& entry : candidates){
+        remaining.push_back(entry.second);
+    }
+    int trials = 0;
+    while(!remaining.empty()){
+        std::size_t best = remaining.size();
+        Recommendation bestRecommendation{};
+        std::vector<double> bestCosts;
+        for(std::size_t i = 0; i < remaining.size(); ++i){
+            Candidate& candidate = remaining[i];
+            const TableInfo& info = schema.at(candidate.table);
+            std::string name = CANDIDATE + std::to_string(++trials);
+            Recommendation recommendation{info.name, candidate.columns, "", {}, 0.0, 0.0, 0.0, 0, 0, 0};
+            std::vector<double> costs(analyses.size(), -1.0);
+            try{
+                double rows = statistics.rows.count(candidate.table) ? statistics.rows.at(candidate.table) : 0.0;
+                if(candidate.stat.empty()){
+                    candidate.stat = sampleStatistics(_db, info.name, candidate.columns, rows, _options.sampleRows);
+                }
+                scratch.execute("CREATE INDEX " + quoteIdentifier(name) + " ON " + quoteIdentifier(info.name)
+                                + " (" + columnList(candidate.columns) + ");");
+                scratch.exec("INSERT INTO sqlite_stat1 VALUES (?, ?, ?);", info.name, name, candidate.stat);
+                scratch.execute("ANALYZE sqlite_master;");
+                Statistics candidateStatistics = readStatistics(scratch);
+
+                for(std::size_t a = 0; a < analyses.size(); ++a){
+                    const Analysis& analysis = analyses[a];
+                    bool writes = analysis.writes && lower(analysis.usage.target) == candidate.table;
+                    if(!analysis.tables.count(candidate.table) && !writes){
+                        continue;
+                    }
+                    QueryPlan plan = QueryPlan::explain(scratch, analysis.observed.sql);
+                    double after = planCost(plan, analysis.usage, schema, candidateStatistics);
+                    if(writes){
+                        after += std::log2(rows + 1.0); // Keeping the index up to date
+                    }
+                    costs[a] = after;
+                    double executions = static_cast<double>(std::max<uint64_t>(analysis.observed.executions, 1));
+                    recommendation.costBefore += executions * analysis.cost;
+                    recommendation.costAfter += executions * after;
+                    if(usesIndex(plan, name) && after < analysis.cost){
+                        recommendation.statements.push_back(analysis.observed.sql);
+                        recommendation.fullScanSteps += analysis.observed.fullScanSteps;
+                        recommendation.sorts += analysis.observed.sorts;
+                        recommendation.autoIndexes += analysis.observed.autoIndexes;
+                    }
+                }
+            } catch(const DatabaseException&) {
+                recommendation.statements.clear(); // e.g. a virtual table
+            }
+            recommendation.benefit = recommendation.costBefore - recommendation.costAfter;
+            bool better = !recommendation.statements.empty() && recommendation.benefit > 0.0
+                          && recommendation.benefit >= _options.minSaving * recommendation.costBefore
+                          && (best == remaining.size() || recommendation.benefit > bestRecommendation.benefit);
+            if(better){
+                best = i;
+                bestRecommendation = recommendation;
+                bestCosts = costs;
+            }
+            dropCandidate(scratch, name);
+        }
+        if(best == remaining.size()){
+            break;
+        }
+        // The winner stays on the scratch schema for the next round
+        const Candidate& winner = remaining[best];
+        std::string name = CANDIDATE + std::to_string(++trials);
+        scratch.execute("CREATE INDEX " + quoteIdentifier(name) + " ON " + quoteIdentifier(bestRecommendation.table)
+                        + " (" + columnList(winner.columns) + ");");
+        scratch.exec("INSERT INTO sqlite_stat1 VALUES (?, ?, ?);", bestRecommendation.table, name, winner.stat);
+        scratch.execute("ANALYZE sqlite_master;");
+        statistics = readStatistics(scratch);
+        for(std::size_t a = 0; a < analyses.size(); ++a){
+            if(bestCosts[a] >= 0.0){
+                analyses[a].cost = bestCosts[a];
+            }
+        }
+        bestRecommendation.sql = "CREATE INDEX " + quoteIdentifier(indexName(bestRecommendation.table, winner.columns)) + " ON "
+                                 + quoteIdentifier(bestRecommendation.table) + " (" + columnList(winner.columns) + ");";
+        recommendations.push_back(bestRecommendation);
+        remaining.erase(remaining.begin() + static_cast<std::ptrdiff_t>(best));
+    }
+    return recommendations;
+}
+
+std::string IndexAdvisor::report(const std::vector<Recommendation>& recommendations) {
+    if(recommendations.empty()){
+        return "No index recommendations.\n";
+    }
+    std::string out = std::to_string(recommendations.size()) + " index recommendation(s), highest benefit first:\n";
+    char line[256];
+    int rank = 0;
+    for(const Recommendation& recommendation : recommendations){
+        double saved = recommendation.costBefore > 0 ? 100.0 * recommendation.benefit / recommendation.costBefore : 0.0;
+        out += std::to_string(++rank) + ". " + recommendation.sql + "\n";
+        std::snprintf(line, sizeof(line), "   estimated rows visited %.0f -> %.0f (-%.1f%%), %zu statement(s) improved\n",
+                      recommendation.costBefore, recommendation.costAfter, saved, recommendation.statements.size());
+        out += line;
+        std::snprintf(line, sizeof(line), "   observed %llu full scan steps, %llu sorts, %llu automatic index rows\n",
+                      static_cast<unsigned long long>(recommendation.fullScanSteps),
+                      static_cast<unsigned long long>(recommendation.sorts),
+                      static_cast<unsigned long long>(recommendation.autoIndexes));
+        out += line;
+        for(const std::string& sql : recommendation.statements){
+            out += "     " + sql + "\n";
+        }
+    }
+    return out;
+}
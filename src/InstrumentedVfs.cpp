@@ -0,0 +1,336 @@
+#include <sq3pp/InstrumentedVfs.h>
+#include <sq3pp/Exception.h>
+#include <sqlite3.h>
+#include "VfsShim.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+
+using namespace sq3pp;
+using Clock = std::chrono::steady_clock;
+
+namespace{
+
+struct AtomicHistogram{
+    std::atomic<uint64_t> buckets[InstrumentedVfs::Histogram::BUCKETS];
+
+    void record(uint64_t micros) {
+        std::size_t bucket = 0;
+        while(micros > 0 && bucket + 1 < InstrumentedVfs::Histogram::BUCKETS){
+            micros >>= 1;
+            ++bucket;
+        }
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+struct Counters{
+    std::atomic<uint64_t> opens;
+    std::atomic<uint64_t> reads;
+    std::atomic<uint64_t> readBytes;
+    std::atomic<uint64_t> writes;
+    std::atomic<uint64_t> writeBytes;
+    std::atomic<uint64_t> syncs;
+    std::atomic<uint64_t> truncates;
+    std::atomic<uint64_t> readMicros;
+    std::atomic<uint64_t> writeMicros;
+    std::atomic<uint64_t> syncMicros;
+    AtomicHistogram readLatency;
+    AtomicHistogram writeLatency;
+    AtomicHistogram syncLatency;
+};
+
+struct Shim : detail::VfsShim{
+    std::string name;
+    Counters counters[InstrumentedVfs::FILE_TYPES];
+};
+
+struct ShimFile : detail::ShimFile{
+    Counters* counters;
+};
+
+std::mutex shimsMutex;
+std::map<std::string, std::unique_ptr<Shim>> shims;
+
+Shim* shimOf(sqlite3_vfs* vfs) {
+    return static_cast<Shim*>(detail::vfsShimOf(vfs));
+}
+
+InstrumentedVfs::FileType typeOf(int flags) {
+    if(flags & SQLITE_OPEN_MAIN_DB) return InstrumentedVfs::FileType::MAIN_DB;
+    if(flags & SQLITE_OPEN_MAIN_JOURNAL) return InstrumentedVfs::FileType::JOURNAL;
+    if(flags & SQLITE_OPEN_WAL) return InstrumentedVfs::FileType::WAL;
+    if(flags & (SQLITE_OPEN_TEMP_DB | SQLITE_OPEN_TEMP_JOURNAL | SQLITE_OPEN_TRANSIENT_DB | SQLITE_OPEN_SUBJOURNAL)){
+        return InstrumentedVfs::FileType::TEMP;
+    }
+    return InstrumentedVfs::FileType::OTHER;
+}
+
+uint64_t microsSince(Clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+}
+
+// sqlite3_io_methods
+
+int shimRead(sqlite3_file* file, void* buffer, int amount, sqlite3_int64 offset) {
+    ShimFile* shim = reinterpret_cast<ShimFile*>(file);
+    Clock::time_point start = Clock::now();
+    int rc = shim->real->pMethods->xRead(shim->real, buffer, amount, offset);
+    uint64_t micros = microsSince(start);
+    Counters& counters = *shim->counters;
+    counters.reads.fetch_add(1, std::memory_order_relaxed);
+    if(rc == SQLITE_OK){
+        counters.readBytes.fetch_add(static_cast<uint64_t>(amount), std::memory_order_relaxed);
+    }
+    counters.readMicros.fetch_add(micros, std::memory_order_relaxed);
+    counters.readLatency.record(micros);
+    return rc;
+}
+
+int shimWrite(sqlite3_file* file, const void* buffer, int amount, sqlite3_int64 offset) {
+    ShimFile* shim = reinterpret_cast<ShimFile*>(file);
+    Clock::time_point start = Clock::now();
+    int rc = shim->real->pMethods->xWrite(shim->real, buffer, amount, offset);
+    uint64_t micros = microsSince(start);
+    Counters& counters = *shim->counters;
+    counters.writes.fetch_add(1, std::memory_order_relaxed);
+    if(rc == SQLITE_OK){
+        counters.writeBytes.fetch_add(static_cast<uint64_t>(amount), std::memory_order_relaxed);
+    }
+    counters.writeMicros.fetch_add(micros, std::memory_order_relaxed);
+    counters.writeLatency.record(micros);
+    return rc;
+}
+
+int shimTruncate(sqlite3_file* file, sqlite3_int64 size) {
+    ShimFile* shim = reinterpret_cast<ShimFile*>(file);
+    shim->counters->truncates.fetch_add(1, std::memory_order_relaxed);
+    return shim->real->pMethods->xTruncate(shim->real, size);
+}
+
+int shimSync(sqlite3_file* file, int flags) {
+    ShimFile* shim = reinterpret_cast<ShimFile*>(file);
+    Clock::time_point start = Clock::now();
+    int rc = shim->real->pMethods->xSync(shim->real, flags);
+    uint64_t micros = microsSince(start);
+    Counters& counters = *shim->counters;
+    counters.syncs.fetch_add(1, std::memory_order_relaxed);
+    counters.syncMicros.fetch_add(micros, std::memory_order_relaxed);
+    counters.syncLatency.record(micros);
+    return rc;
+}
+
+// One table per io_methods version, so SQLite never calls a method the
+// wrapped file does not have
+const sqlite3_io_methods shimMethods[3] = {
+    {1, detail::forwardClose, shimRead, shimWrite, shimTruncate, shimSync, detail::forwardFileSize,
+     detail::forwardLock, detail::forwardUnlock, detail::forwardCheckReservedLock, detail::forwardFileControl,
+     detail::forwardSectorSize, detail::forwardDeviceCharacteristics,
+     nullptr, nullptr, nullptr, nullptr, nullptr, nullptr},
+    {2, detail::forwardClose, shimRead, shimWrite, shimTruncate, shimSync, detail::forwardFileSize,
+     detail::forwardLock, detail::forwardUnlock, detail::forwardCheckReservedLock, detail::forwardFileControl,
+     detail::forwardSectorSize, detail::forwardDeviceCharacteristics,
+     detail::forwardShmMap, detail::forwardShmLock, detail::forwardShmBarrier, detail::forwardShmUnmap, nullptr, nullptr},
+    {3, detail::forwardClose, shimRead, shimWrite, shimTruncate, shimSync, detail::forwardFileSize,
+     detail::forwardLock, detail::forwardUnlock, detail::forwardCheckReservedLock, detail::forwardFileControl,
+     detail::forwardSectorSize, detail::forwardDeviceCharacteristics,
+     detail::forwardShmMap, detail::forwardShmLock, detail::forwardShmBarrier, detail::forwardShmUnmap,
+     detail::forwardFetch, detail::forwardUnfetch},
+};
+
+// sqlite3_vfs
+
+int shimOpen(sqlite3_vfs* vfs, const char* name, sqlite3_file* file, int flags, int* outFlags) {
+    Shim* shim = shimOf(vfs);
+    ShimFile* shimFile = reinterpret_cast<ShimFile*>(file);
+    shimFile->real = reinterpret_cast<sqlite3_file*>(shimFile + 1);
+    shimFile->real->pMethods = nullptr;
+    shimFile->counters = &shim->counters[static_cast<std::size_t>(typeOf(flags))];
+    int rc = shim->base->xOpen(shim->base, name, shimFile->real, flags, outFlags);
+    const sqlite3_io_methods* methods = shimFile->real->pMethods;
+    if(methods){
+        int version = methods->iVersion < 1 ? 1 : (methods->iVersion > 3 ? 3 : methods->iVersion);
+        file->pMethods = &shimMethods[version - 1];
+    }else{
+        file->pMethods = nullptr;
+    }
+    if(rc == SQLITE_OK){
+        shimFile->counters->opens.fetch_add(1, std::memory_order_relaxed);
+    }
+    return rc;
+}
+
+Shim* findShim(const std::string& name) {
+    std::lock_guard<std::mutex> lock(shimsMutex);
+    auto it = shims.find(name);
+    if(it == shims.end()){
+        throw DatabaseException(SQ3::MISUSE, "No instrumented VFS named " + name);
+    }
+    return it->second.get();
+}
+
+void copyHistogram(const AtomicHistogram& from, InstrumentedVfs::Histogram& to) {
+    for(std::size_t i = 0; i < InstrumentedVfs::Histogram::BUCKETS; ++i){
+        to.buckets[i] = from.buckets[i].load(std::memory_order_relaxed);
+    }
+}
+
+void subtractHistogram(InstrumentedVfs::Histogram& from, const InstrumentedVfs::Histogram& earlier) {
+    for(std::size_t i = 0; i < InstrumentedVfs::Histogram::BUCKETS; ++i){
+        from.buckets[i] -= earlier.buckets[i];
+    }
+}
+
+void addHistogram(InstrumentedVfs::Histogram& to, const InstrumentedVfs::Histogram& other) {
+    for(std::size_t i = 0; i < InstrumentedVfs::Histogram::BUCKETS; ++i){
+        to.buckets[i] += other.buckets[i];
+    }
+}
+
+}
+
+uint64_t InstrumentedVfs::Histogram::count() const {
+    uint64_t total = 0;
+    for(uint64_t bucket : buckets){
+        total += bucket;
+    }
+    return total;
+}
+
+std::chrono::microseconds InstrumentedVfs::Histogram::upperBound(std::size_t bucket) {
+    return std::chrono::microseconds(bucket + 1 >= BUCKETS ? INT64_MAX : (int64_t(1) << bucket));
+}
+
+std::chrono::microseconds InstrumentedVfs::Histogram::percentile(double fraction) const {
+    uint64_t total = count();
+    if(total == 0){
+        return std::chrono::microseconds(0);
+    }
+    uint64_t target = static_cast<uint64_t>(fraction * static_cast<double>(total));
+    uint64_t seen = 0;
+    for(std::size_t i = 0; i < BUCKETS; ++i){
+        seen += buckets[i];
+        if(seen > target || seen == total){
+            return upperBound(i);
+        }
+    }
+    return upperBound(BUCKETS - 1);
+}
+
+InstrumentedVfs::FileStats InstrumentedVfs::Stats::total() const {
+    FileStats sum{};
+    for(const FileStats& file : files){
+        sum.opens += file.opens;
+        sum.reads += file.reads;
+        sum.readBytes += file.readBytes;
+        sum.writes += file.writes;
+        sum.writeBytes += file.writeBytes;
+        sum.syncs += file.syncs;
+        sum.truncates += file.truncates;
+        sum.readTime += file.readTime;
+        sum.writeTime += file.writeTime;
+        sum.syncTime += file.syncTime;
+        addHistogram(sum.readLatency, file.readLatency);
+        addHistogram(sum.writeLatency, file.writeLatency);
+        addHistogram(sum.syncLatency, file.syncLatency);
+    }
+    return sum;
+}
+
+InstrumentedVfs::Stats InstrumentedVfs::Stats::operator-(const Stats& earlier) const {
+    Stats delta = *this;
+    for(std::size_t i = 0; i < FILE_TYPES; ++i){
+        FileStats& file = delta.files[i];
+        const FileStats& before = earlier.files[i];
+        file.opens -= before.opens;
+        file.reads -= before.reads;
+        file.readBytes -= before.readBytes;
+        file.writes -= before.writes;
+        file.writeBytes -= before.writeBytes;
+        file.syncs -= before.syncs;
+        file.truncates -= before.truncates;
+        file.readTime -= before.readTime;
+        file.writeTime -= before.writeTime;
+        file.syncTime -= before.syncTime;
+        subtractHistogram(file.readLatency, before.readLatency);
+        subtractHistogram(file.writeLatency, before.writeLatency);
+        subtractHistogram(file.syncLatency, before.syncLatency);
+    }
+    return delta;
+}
+
+const char* InstrumentedVfs::install(const std::string& name, const std::string& base, bool makeDefault) {
+    std::lock_guard<std::mutex> lock(shimsMutex);
+    auto it = shims.find(name);
+    if(it != shims.end()){
+        return it->second->name.c_str();
+    }
+    sqlite3_initialize();
+    sqlite3_vfs* baseVfs = sqlite3_vfs_find(base.empty() ? nullptr : base.c_str());
+    if(!baseVfs){
+        throw DatabaseException(SQ3::ERROR, "Cannot install instrumented VFS: no VFS named " + base);
+    }
+
+    std::unique_ptr<Shim> shim(new Shim());
+    shim->name = name;
+    detail::initVfsShim(*shim, baseVfs, shim->name.c_str(), static_cast<int>(sizeof(ShimFile)) + baseVfs->szOsFile, shimOpen);
+    sqlite3_vfs& vfs = shim->vfs;
+
+    int rc = sqlite3_vfs_register(&vfs, makeDefault ? 1 : 0);
+    if(rc != SQLITE_OK){
+        throw DatabaseException(static_cast<SQ3>(rc), std::string("Cannot register instrumented VFS: ") + sqlite3_errstr(rc));
+    }
+    const char* registered = shim->name.c_str();
+    shims.emplace(name, std::move(shim));
+    return registered;
+}
+
+InstrumentedVfs::Stats InstrumentedVfs::stats(const std::string& name) {
+    Shim* shim = findShim(name);
+    Stats stats{};
+    for(std::size_t i = 0; i < FILE_TYPES; ++i){
+        const Counters& counters = shim->counters[i];
+        FileStats& file = stats.files[i];
+        file.opens = counters.opens.load(std::memory_order_relaxed);
+        file.reads = counters.reads.load(std::memory_order_relaxed);
+        file.readBytes = counters.readBytes.load(std::memory_order_relaxed);
+        file.writes = counters.writes.load(std::memory_order_relaxed);
+        file.writeBytes = counters.writeBytes.load(std::memory_order_relaxed);
+        file.syncs = counters.syncs.load(std::memory_order_relaxed);
+        file.truncates = counters.truncates.load(std::memory_order_relaxed);
+        file.readTime = std::chrono::microseconds(counters.readMicros.load(std::memory_order_relaxed));
+        file.writeTime = std::chrono::microseconds(counters.writeMicros.load(std::memory_order_relaxed));
+        file.syncTime = std::chrono::microseconds(counters.syncMicros.load(std::memory_order_relaxed));
+        copyHistogram(counters.readLatency, file.readLatency);
+        copyHistogram(counters.writeLatency, file.writeLatency);
+        copyHistogram(counters.syncLatency, file.syncLatency);
+    }
+    return stats;
+}
+
+void InstrumentedVfs::reset(const std::string& name) {
+    Shim* shim = findShim(name);
+    for(Counters& counters : shim->counters){
+        for(std::atomic<uint64_t>* value : {&counters.opens, &counters.reads, &counters.readBytes, &counters.writes,
+                                            &counters.writeBytes, &counters.syncs, &counters.truncates,
+                                            &counters.readMicros, &counters.writeMicros, &counters.syncMicros}){
+            value->store(0, std::memory_order_relaxed);
+        }
+        for(AtomicHistogram* histogram : {&counters.readLatency, &counters.writeLatency, &counters.syncLatency}){
+            for(std::atomic<uint64_t>& bucket : histogram->buckets){
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+const char* InstrumentedVfs::typeName(FileType type) {
+    switch(type){
+        case FileType::MAIN_DB: return "main";
+        case FileType::JOURNAL: return "journal";
+        case FileType::WAL: return "wal";
+        case FileType::TEMP: return "temp";
+        default: return "other";
+    }
+}
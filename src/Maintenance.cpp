@@ -0,0 +1,223 @@
+#include <sq3pp/Maintenance.h>
+#include <sq3pp/Exception.h>
+#include <sq3pp/Statement.h>
+#include "Reopen.h"
+#include "SqlText.h"
+#include <algorithm>
+#include <vector>
+
+using namespace sq3pp;
+using detail::quoteIdentifier;
+using Clock = std::chrono::steady_clock;
+
+Maintenance::Maintenance(Database& db) : Maintenance(db, Options()) {}
+
+Maintenance::Maintenance(Database& db, const Options& options, std::function<void(const Report& report)> onReport)
+    : _db(db), _options(options), _onReport(std::move(onReport)), _lastActivity(Clock::now().time_since_epoch().count()),
+      _running(false), _interrupted(false), _runs(0), _nextTable(0),
+      _stopping(false), _requested(false), _pending(true), _lastRun(Clock::now()), _lastReport{} {
+    if(!_db.isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot start maintenance: database is not open.");
+    }
+    const char* file = sqlite3_db_filename(_db.getHandle(), "main");
+    if(!file || !*file){
+        throw DatabaseException(SQ3::MISUSE, "Cannot start maintenance: it needs a file database.");
+    }
+    // Same VFS and URI parameters as the watched connection
+    int rc = detail::reopen(_db.getHandle(), _maintenanceDb, SQLITE_OPEN_READWRITE);
+    if(rc != SQLITE_OK){
+        throw DatabaseException(static_cast<SQ3>(rc), std::string("Cannot open maintenance connection: ") + sqlite3_errstr(rc));
+    }
+    sqlite3_busy_timeout(_maintenanceDb.getHandle(), static_cast<int>(_options.busyTimeout.count()));
+
+    _db.setStatementHook([this](const char*){
+        onStatement();
+    });
+    _thread = std::thread(&Maintenance::run, this);
+}
+
+Maintenance::~Maintenance() {
+    if(_db.isOpen()){
+        try{
+            _db.setStatementHook(nullptr);
+        } catch(...) {
+            // Suppress all exceptions in destructor
+        }
+    }
+    stop();
+}
+
+void Maintenance::request() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _requested = true;
+    }
+    _wakeup.notify_one();
+}
+
+void Maintenance::stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _interrupted = true;
+    if(_running){
+        _maintenanceDb.interrupt();
+    }
+    _wakeup.notify_all();
+    if(_thread.joinable()){
+        _thread.join();
+    }
+}
+
+Maintenance::Report Maintenance::lastReport() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _lastReport;
+}
+
+void Maintenance::onStatement() {
+    // Runs on every statement of the watched connection: one clock read, and
+    // an interrupt only while a run is in progress
+    _lastActivity.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    if(_running.load(std::memory_order_relaxed) && !_interrupted.exchange(true)){
+        _maintenanceDb.interrupt();
+    }
+}
+
+void Maintenance::run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while(!_stopping){
+        _wakeup.wait_for(lock, _options.checkInterval, [this]{ return _stopping || _requested; });
+        if(_stopping){
+            break;
+        }
+        Clock::time_point now = Clock::now();
+        Clock::time_point lastActivity{Clock::duration(_lastActivity.load(std::memory_order_relaxed))};
+        bool idle = now - lastActivity >= _options.idleAfter;
+        bool due = _pending || now - _lastRun >= _options.runEvery;
+        if(!_requested && !(idle && due)){
+            continue;
+        }
+        _requested = false;
+        lock.unlock();
+        Report report = runTasks();
+        lock.lock();
+        _lastReport = report;
+        _pending = !report.completed;
+        if(report.completed){
+            _lastRun = Clock::now();
+        }
+        ++_runs;
+        if(_onReport){
+            lock.unlock();
+            try{
+                _onReport(report);
+            } catch(...) {
+                // Keep running, a background thread has nowhere to report to
+            }
+            lock.lock();
+        }
+    }
+}
+
+bool Maintenance::shouldStop(Clock::time_point deadline) const {
+    return _interrupted.load() || Clock::now() >= deadline;
+}
+
+int64_t Maintenance::pragmaValue(const std::string& pragma) {
+    int64_t value = 0;
+    _maintenanceDb.execute("PRAGMA " + pragma + ";", [&value](Row& row){
+        value = row[0].valueAs<int64_t>();
+    });
+    return value;
+}
+
+Maintenance::Report Maintenance::runTasks() {
+    Report report{};
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + _options.budget;
+    _interrupted = false;
+    _running = true;
+    {
+        // stop() may have come before _running was set
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(_stopping){
+            _interrupted = true;
+        }
+    }
+    _maintenanceDb.setDeadline(deadline);
+
+    int64_t freelistBefore = -1;
+    bool done = false;
+    try{
+        if(_options.analysisLimit > 0){
+            _maintenanceDb.execute("PRAGMA analysis_limit = " + std::to_string(_options.analysisLimit) + ";");
+        }
+        // 0x10002: analyze where useful, looking at all tables rather than
+        // only those this (idle) connection has queried
+        if(_options.optimize && !shouldStop(deadline)){
+            _maintenanceDb.execute("PRAGMA optimize(0x10002);");
+            report.optimized = true;
+        }
+
+        bool analyzed = !_options.analyze;
+        if(_options.analyze){
+            std::vector<std::string> tables;
+            _maintenanceDb.execute("SELECT name FROM sqlite_master WHERE type = 'table' AND name NOT LIKE 'sqlite_%' ORDER BY name;",
+                [&tables](Row& row){
+                    tables.push_back(row[0].valueAs<std::string>());
+                });
+            while(_nextTable < tables.size() && !shouldStop(deadline)){
+                _maintenanceDb.execute("ANALYZE " + quoteIdentifier(tables[_nextTable]) + ";");
+                ++_nextTable;
+                ++report.analyzedTables;
+            }
+            if(_nextTable >= tables.size()){
+                _nextTable = 0;
+                analyzed = true;
+            }
+        }
+
+        bool vacuumed = true;
+        if(_options.vacuumPages > 0 && pragmaValue("auto_vacuum") == 2){
+            // Only INCREMENTAL auto_vacuum keeps free pages for us to release
+            freelistBefore = pragmaValue("freelist_count");
+            int64_t freelist = freelistBefore;
+            while(freelist > 0 && !shouldStop(deadline)){
+                _maintenanceDb.execute("PRAGMA incremental_vacuum(" + std::to_string(_options.vacuumPages) + ");");
+                freelist = pragmaValue("freelist_count");
+            }
+            vacuumed = freelist == 0;
+        }
+        done = analyzed && vacuumed && (report.optimized || !_options.optimize);
+    } catch(const DatabaseException& e) {
+        if(e.code() == SQ3::TIMEOUT){
+            report.timedOut = true;
+        }else if(e.code() == SQ3::INTERRUPT || _interrupted){
+            report.interrupted = true;
+        }else{
+            report.error = e.what();
+        }
+    }
+    _running = false;
+    _maintenanceDb.clearDeadline();
+    if(!done && report.error.empty() && !report.timedOut && !report.interrupted){
+        if(_interrupted){
+            report.interrupted = true;
+        }else{
+            report.timedOut = true;
+        }
+    }
+    report.completed = done;
+
+    try{
+        report.freelistPages = pragmaValue("freelist_count");
+        if(freelistBefore >= 0){
+            report.freedPages = std::max<int64_t>(0, freelistBefore - report.freelistPages);
+        }
+    } catch(const DatabaseException&) {
+        // Counts are informational
+    }
+    report.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+    return report;
+}
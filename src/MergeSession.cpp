@@ -0,0 +1,274 @@
+#include <sq3pp/MergeSession.h>
+#include <sq3pp/Exception.h>
+#include "SqlText.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+
+using namespace sq3pp;
+using detail::quoteIdentifier;
+using Clock = std::chrono::steady_clock;
+
+static std::chrono::microseconds since(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+}
+
+static bool sameName(const std::string& a, const std::string& b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y){
+        return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+    });
+}
+
+static std::string list(const std::vector<std::string>& columns, const std::string& prefix = "") {
+    std::string out;
+    for(const std::string& column : columns){
+        out += (out.empty() ? "" : ", ") + prefix + quoteIdentifier(column);
+    }
+    return out;
+}
+
+// Key columns of the staging table equal to those of the target row
+static std::string keyMatch(const std::vector<std::string>& keys, const std::string& left, const std::string& right) {
+    std::string out;
+    for(const std::string& key : keys){
+        out += (out.empty() ? "" : " AND ") + left + "." + quoteIdentifier(key) + " = " + right + "." + quoteIdentifier(key);
+    }
+    return out;
+}
+
+MergeSession::MergeSession(Database& db, const std::string& table, const std::vector<std::string>& keyColumns)
+    : MergeSession(db, table, keyColumns, MergeOptions()) {}
+
+MergeSession::MergeSession(Database& db, const std::string& table, const std::vector<std::string>& keyColumns,
+                           const MergeOptions& options)
+    : _db(&db), _table(table), _options(options), _finished(false), _added(0), _start(Clock::now()) {
+    if(!_db->isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot merge: database is not open.");
+    }
+    if(keyColumns.empty()){
+        throw DatabaseException(SQ3::MISUSE, "Cannot merge: no key columns.");
+    }
+
+    // Declared names and types of the table's columns
+    std::vector<std::pair<std::string, std::string>> tableColumns;
+    _db->execute("PRAGMA table_info(" + quoteIdentifier(_table) + ");", [&tableColumns](Row& row){
+        tableColumns.emplace_back(row[1].valueAs<std::string>(), row[2].valueAs<std::string>());
+    });
+    if(tableColumns.empty()){
+        throw DatabaseException(SQ3::ERROR, "Cannot merge: no such table: " + _table);
+    }
+    auto declared = [&tableColumns, this](const std::string& name) -> const std::pair<std::string, std::string>& {
+        for(const auto& column : tableColumns){
+            if(sameName(column.first, name)){
+                return column;
+            }
+        }
+        throw DatabaseException(SQ3::ERROR, "Cannot merge: no such column: " + _table + "." + name);
+    };
+    auto contains = [](const std::vector<std::string>& names, const std::string& name){
+        return std::any_of(names.begin(), names.end(), [&name](const std::string& other){return sameName(other, name);});
+    };
+
+    if(_options.columns.empty()){
+        for(const auto& column : tableColumns){
+            _columns.push_back(column.first);
+        }
+    }else{
+        for(const std::string& column : _options.columns){
+            _columns.push_back(declared(column).first);
+        }
+    }
+    for(const std::string& key : keyColumns){
+        _keys.push_back(declared(key).first);
+        if(!contains(_columns, key)){
+            throw DatabaseException(SQ3::MISUSE, "Cannot merge: key column " + key + " is not among the merged columns.");
+        }
+    }
+    std::vector<std::string> updates;
+    if(_options.updateColumns.empty()){
+        for(const std::string& column : _columns){
+            if(!contains(_keys, column)){
+                updates.push_back(column);
+            }
+        }
+    }else{
+        for(const std::string& column : _options.updateColumns){
+            if(!contains(_columns, column)){
+                throw DatabaseException(SQ3::MISUSE, "Cannot merge: update column " + column + " is not among the merged columns.");
+            }
+            if(!contains(_keys, column)){
+                updates.push_back(declared(column).first);
+            }
+        }
+    }
+
+    static std::atomic<unsigned> sessions(0);
+    _staging = "sq3pp_merge_" + std::to_string(++sessions);
+    std::string staging = "temp." + quoteIdentifier(_staging);
+
+    // Clustered on the key, so the staging table is sorted as it fills and a
+    // repeated key replaces the earlier row. Columns keep the declared types
+    // to get the same affinity as the table.
+    std::string create = "CREATE TEMP TABLE " + quoteIdentifier(_staging) + " (";
+    for(const std::string& column : _columns){
+        create += quoteIdentifier(column) + " " + declared(column).second + ", ";
+    }
+    create += "PRIMARY KEY (" + list(_keys) + ")) WITHOUT ROWID;";
+
+    std::string placeholders;
+    for(std::size_t i = 0; i < _columns.size(); ++i){
+        placeholders += i ? ", ?" : "?";
+    }
+
+    // WHERE true keeps ON CONFLICT from parsing as a join constraint
+    std::string apply = "INSERT INTO main." + quoteIdentifier(_table) + " (" + list(_columns) + ") SELECT " + list(_columns)
+                        + " FROM " + staging + " WHERE true ORDER BY " + list(_keys) + " ON CONFLICT (" + list(_keys) + ") DO ";
+    if(updates.empty()){
+        apply += "NOTHING;";
+    }else{
+        apply += "UPDATE SET ";
+        std::string changed;
+        for(std::size_t i = 0; i < updates.size(); ++i){
+            std::string column = quoteIdentifier(updates[i]);
+            apply += (i ? ", " : "") + column + " = excluded." + column;
+            changed += (i ? " OR " : "") + column + " IS NOT excluded." + column;
+        }
+        apply += _options.skipUnchanged ? " WHERE " + changed + ";" : ";";
+    }
+
+    _db->execute(create);
+    try{
+        _insert = prepare("INSERT OR REPLACE INTO " + staging + " (" + list(_columns) + ") VALUES (" + placeholders + ");");
+        // Prepared now so a key without a matching UNIQUE index fails before any row is staged
+        _apply = prepare(apply);
+    } catch(...) {
+        _finished = true;
+        _insert.finalize();
+        _apply.finalize();
+        sqlite3_exec(_db->getHandle(), ("DROP TABLE IF EXISTS " + staging + ";").c_str(), nullptr, nullptr, nullptr);
+        throw;
+    }
+}
+
+MergeSession::MergeSession(MergeSession&& other) noexcept
+    : _db(other._db), _table(std::move(other._table)), _staging(std::move(other._staging)), _keys(std::move(other._keys)),
+      _columns(std::move(other._columns)), _options(std::move(other._options)), _insert(std::move(other._insert)),
+      _apply(std::move(other._apply)), _finished(other._finished), _added(other._added), _start(other._start) {
+    other._finished = true;
+}
+
+MergeSession::~MergeSession() {
+    if(!_finished){
+        try{
+            abort();
+        } catch(...) {
+            // Suppress all exceptions in destructor
+        }
+    }
+}
+
+Statement MergeSession::prepare(const std::string& sql) {
+    Statement stmt = _db->createStatement(sql, SQLITE_PREPARE_PERSISTENT);
+    if(!stmt.isValid()){
+        throw DatabaseException(static_cast<SQ3>(sqlite3_errcode(_db->getHandle())),
+                                "Cannot merge into " + _table + ": " + sqlite3_errmsg(_db->getHandle()));
+    }
+    return stmt;
+}
+
+void MergeSession::checkActive() const {
+    if(_finished){
+        throw DatabaseException(SQ3::MISUSE, "Cannot add rows: merge is finished.");
+    }
+}
+
+void MergeSession::add(const std::vector<CellValue>& row) {
+    checkActive();
+    if(row.size() != _columns.size()){
+        throw DatabaseException(SQ3::RANGE, "Cannot add row: " + std::to_string(row.size()) + " values for "
+                                + std::to_string(_columns.size()) + " columns.");
+    }
+    _insert.reset(true);
+    for(std::size_t i = 0; i < row.size(); ++i){
+        _insert.bind(row[i], static_cast<int>(i));
+    }
+    try{
+        _insert.execute();
+    } catch(...) {
+        _insert.reset(true);
+        throw;
+    }
+    _insert.reset(true);
+    ++_added;
+}
+
+MergeResult MergeSession::finish() {
+    checkActive();
+    if(!_db->isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot finish merge: database is not open.");
+    }
+    MergeResult result{};
+    result.staging = since(_start);
+    Clock::time_point start = Clock::now();
+    std::string staging = "temp." + quoteIdentifier(_staging);
+    std::string table = "main." + quoteIdentifier(_table);
+    // Named after the staging table: RELEASE and ROLLBACK TO act on the
+    // latest savepoint of a name, which may belong to another session
+    std::string savepoint = quoteIdentifier(_staging);
+    bool open = false;
+    try{
+        _db->execute("SAVEPOINT " + savepoint + ";");
+        open = true;
+        result.rows = _db->queryOne<int64_t>("SELECT count(*) FROM " + staging + ";").value_or(0);
+        // Rows without a match become inserts; sqlite3_changes() counts
+        // inserts and the updates that changed something together
+        result.inserted = _db->queryOne<int64_t>("SELECT count(*) FROM " + staging + " AS s WHERE NOT EXISTS (SELECT 1 FROM "
+                                                 + table + " AS t WHERE " + keyMatch(_keys, "t", "s") + ");").value_or(0);
+        int64_t changes = _apply.execute();
+        _apply.reset(true);
+        result.updated = std::max<int64_t>(0, changes - result.inserted);
+        result.unchanged = std::max<int64_t>(0, result.rows - result.inserted - result.updated);
+
+        if(_options.deleteMissing){
+            std::string condition = "NOT EXISTS (SELECT 1 FROM " + staging + " AS s WHERE " + keyMatch(_keys, "s", table) + ")";
+            if(!_options.deleteWhere.empty()){
+                condition = "(" + _options.deleteWhere + ") AND " + condition;
+            }
+            // A Statement counts only the rows it deletes, not those of triggers
+            Statement remove = prepare("DELETE FROM " + table + " WHERE " + condition + ";");
+            result.deleted = remove.execute();
+        }
+        _db->execute("RELEASE " + savepoint + ";");
+    } catch(...) {
+        if(open){
+            sqlite3_exec(_db->getHandle(), ("ROLLBACK TO " + savepoint + "; RELEASE " + savepoint + ";").c_str(),
+                         nullptr, nullptr, nullptr);
+        }
+        try{
+            abort();
+        } catch(...) {
+            // Report the original error
+        }
+        throw;
+    }
+    try{
+        abort(); // Drops the staging table
+    } catch(...) {
+        // The merge is written; a leftover TEMP table goes with the connection
+    }
+    result.apply = since(start);
+    return result;
+}
+
+void MergeSession::abort() {
+    if(_finished){
+        return;
+    }
+    _finished = true;
+    _insert.finalize();
+    _apply.finalize();
+    if(!_db->isOpen()){
+        return;
+    }
+    _db->execute("DROP TABLE IF EXISTS temp." + quoteIdentifier(_staging) + ";");
+}
@@ -0,0 +1,238 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include "MmapVfs.h"
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+
+#include "VfsShim.h"
+#include <cstring>
+#include <mutex>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sq3pp{
+namespace detail{
+
+namespace{
+
+// One read-only mapping per file (device and inode), shared by every
+// connection of the process
+struct Mapping{
+    dev_t device;
+    ino_t inode;
+    const char* data;
+    sqlite3_int64 size;
+    int references;
+    Mapping* next;
+};
+
+std::mutex mappingsMutex;
+Mapping* mappings = nullptr;
+
+Mapping* acquireMapping(const char* path, bool preload) {
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        return nullptr;
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size <= 0 || static_cast<uint64_t>(info.st_size) > SIZE_MAX){
+        ::close(fd);
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(mappingsMutex);
+    for(Mapping* mapping = mappings; mapping; mapping = mapping->next){
+        if(mapping->device == info.st_dev && mapping->inode == info.st_ino && mapping->size == info.st_size){
+            ++mapping->references;
+            ::close(fd);
+            return mapping;
+        }
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // The mapping keeps the file referenced
+    if(data == MAP_FAILED){
+        return nullptr;
+    }
+#ifdef HAVE_MADVISE
+    // B-tree lookups jump around the file: no read-ahead unless preloading
+    madvise(data, static_cast<size_t>(info.st_size), preload ? MADV_WILLNEED : MADV_RANDOM);
+#else
+    (void)preload;
+#endif
+    Mapping* mapping = new Mapping{info.st_dev, info.st_ino, static_cast<const char*>(data), info.st_size, 1, mappings};
+    mappings = mapping;
+    return mapping;
+}
+
+void releaseMapping(Mapping* mapping) {
+    std::lock_guard<std::mutex> lock(mappingsMutex);
+    if(--mapping->references > 0){
+        return;
+    }
+    for(Mapping** link = &mappings; *link; link = &(*link)->next){
+        if(*link == mapping){
+            *link = mapping->next;
+            break;
+        }
+    }
+    munmap(const_cast<char*>(mapping->data), static_cast<size_t>(mapping->size));
+    delete mapping;
+}
+
+struct MappedFile : ShimFile{
+    Mapping* mapping;
+};
+
+Mapping* mappingOf(sqlite3_file* file) {
+    return reinterpret_cast<MappedFile*>(file)->mapping;
+}
+
+int mappedClose(sqlite3_file* file) {
+    MappedFile* mapped = reinterpret_cast<MappedFile*>(file);
+    if(mapped->mapping){
+        releaseMapping(mapped->mapping);
+        mapped->mapping = nullptr;
+    }
+    return forwardClose(file);
+}
+
+int mappedRead(sqlite3_file* file, void* buffer, int amount, sqlite3_int64 offset) {
+    Mapping* mapping = mappingOf(file);
+    if(!mapping){
+        return forwardRead(file, buffer, amount, offset);
+    }
+    sqlite3_int64 available = offset < mapping->size ? mapping->size - offset : 0;
+    if(available >= amount){
+        std::memcpy(buffer, mapping->data + offset, static_cast<size_t>(amount));
+        return SQLITE_OK;
+    }
+    // SQLite expects the missing tail zeroed on a short read
+    if(available > 0){
+        std::memcpy(buffer, mapping->data + offset, static_cast<size_t>(available));
+    }
+    std::memset(static_cast<char*>(buffer) + available, 0, static_cast<size_t>(amount - available));
+    return SQLITE_IOERR_SHORT_READ;
+}
+
+int mappedFileSize(sqlite3_file* file, sqlite3_int64* size) {
+    Mapping* mapping = mappingOf(file);
+    if(!mapping){
+        return forwardFileSize(file, size);
+    }
+    *size = mapping->size;
+    return SQLITE_OK;
+}
+
+int mappedShmMap(sqlite3_file* file, int region, int size, int extend, void volatile** memory) {
+    // Immutable databases never use shared memory; guard against old base VFSes
+    if(realFile(file)->pMethods->iVersion < 2){
+        return SQLITE_IOERR_SHMMAP;
+    }
+    return forwardShmMap(file, region, size, extend, memory);
+}
+
+int mappedShmLock(sqlite3_file* file, int offset, int n, int flags) {
+    if(realFile(file)->pMethods->iVersion < 2){
+        return SQLITE_IOERR_SHMLOCK;
+    }
+    return forwardShmLock(file, offset, n, flags);
+}
+
+void mappedShmBarrier(sqlite3_file* file) {
+    if(realFile(file)->pMethods->iVersion >= 2){
+        forwardShmBarrier(file);
+    }
+}
+
+int mappedShmUnmap(sqlite3_file* file, int deleteFlag) {
+    if(realFile(file)->pMethods->iVersion < 2){
+        return SQLITE_OK;
+    }
+    return forwardShmUnmap(file, deleteFlag);
+}
+
+// Pages are handed out straight from the shared mapping, so they are not
+// copied into each connection's page cache
+int mappedFetch(sqlite3_file* file, sqlite3_int64 offset, int amount, void** page) {
+    Mapping* mapping = mappingOf(file);
+    if(mapping && offset >= 0 && offset + amount <= mapping->size){
+        *page = const_cast<char*>(mapping->data + offset);
+    }else{
+        *page = nullptr; // SQLite falls back to xRead
+    }
+    return SQLITE_OK;
+}
+
+int mappedUnfetch(sqlite3_file*, sqlite3_int64, void*) {
+    return SQLITE_OK; // The mapping lives until the file is closed
+}
+
+const sqlite3_io_methods mappedMethods = {
+    3, mappedClose, mappedRead, forwardWrite, forwardTruncate, forwardSync, mappedFileSize,
+    forwardLock, forwardUnlock, forwardCheckReservedLock, forwardFileControl,
+    forwardSectorSize, forwardDeviceCharacteristics,
+    mappedShmMap, mappedShmLock, mappedShmBarrier, mappedShmUnmap, mappedFetch, mappedUnfetch
+};
+
+VfsShim mmapShim;
+
+int mappedOpen(sqlite3_vfs* vfs, const char* name, sqlite3_file* file, int flags, int* outFlags) {
+    sqlite3_vfs* base = vfsShimOf(vfs)->base;
+    if(!(flags & SQLITE_OPEN_MAIN_DB) || !(flags & SQLITE_OPEN_READONLY) || !name){
+        // Everything else goes to the base VFS untouched; the file object we
+        // get is larger than the base needs
+        return base->xOpen(base, name, file, flags, outFlags);
+    }
+    MappedFile* mapped = reinterpret_cast<MappedFile*>(file);
+    mapped->real = reinterpret_cast<sqlite3_file*>(mapped + 1);
+    mapped->real->pMethods = nullptr;
+    mapped->mapping = nullptr;
+    int rc = base->xOpen(base, name, mapped->real, flags, outFlags);
+    if(!mapped->real->pMethods){
+        file->pMethods = nullptr;
+        return rc;
+    }
+    file->pMethods = &mappedMethods;
+    if(rc == SQLITE_OK){
+        mapped->mapping = acquireMapping(name, sqlite3_uri_boolean(name, "preload", 0) != 0);
+    }
+    return rc;
+}
+
+}
+
+const char* immutableVfs() {
+    static std::once_flag registered;
+    static const char* registeredName = nullptr;
+    std::call_once(registered, []{
+        sqlite3_initialize();
+        sqlite3_vfs* base = sqlite3_vfs_find(nullptr);
+        if(!base){
+            return;
+        }
+        initVfsShim(mmapShim, base, "sq3pp-mmap", static_cast<int>(sizeof(MappedFile)) + base->szOsFile, mappedOpen);
+        if(sqlite3_vfs_register(&mmapShim.vfs, 0) == SQLITE_OK){
+            registeredName = mmapShim.vfs.zName;
+        }
+    });
+    return registeredName;
+}
+
+}
+}
+
+#else
+
+namespace sq3pp{
+namespace detail{
+
+const char* immutableVfs() {
+    return nullptr;
+}
+
+}
+}
+
+#endif
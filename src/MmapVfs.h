@@ -0,0 +1,16 @@
+#ifndef SQ3PP_MMAPVFS_H
+#define SQ3PP_MMAPVFS_H
+
+namespace sq3pp{
+namespace detail{
+
+// Name of the VFS behind Database::openImmutable, registered on first use,
+// or nullptr where memory mapping is not available. Read-only main database
+// files opened through it are mapped once per process and shared by all
+// connections; reads and xFetch are served from the mapping. The URI
+// parameter preload=1 asks the kernel to read the whole file ahead.
+const char* immutableVfs();
+
+}
+}
+#endif // SQ3PP_MMAPVFS_H
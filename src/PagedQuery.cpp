@@ -0,0 +1,391 @@
+#include <sq3pp/PagedQuery.h>
+#include <sq3pp/Exception.h>
+#include "SqlText.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace sq3pp;
+using detail::quoteIdentifier;
+
+namespace{
+
+const char* const BASE64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// URL-safe base64 without padding, so tokens can go into query strings as is
+std::string toBase64(const std::string& data) {
+    std::string out;
+    uint32_t buffer = 0;
+    int bits = 0;
+    for(unsigned char c : data){
+        buffer = (buffer << 8) | c;
+        bits += 8;
+        while(bits >= 6){
+            bits -= 6;
+            out += BASE64[(buffer >> bits) & 0x3F];
+        }
+    }
+    if(bits > 0){
+        out += BASE64[(buffer << (6 - bits)) & 0x3F];
+    }
+    return out;
+}
+
+bool fromBase64(const std::string& text, std::string& data) {
+    uint32_t buffer = 0;
+    int bits = 0;
+    for(char c : text){
+        const char* found = c ? std::strchr(BASE64, c) : nullptr;
+        if(!found){
+            return false;
+        }
+        buffer = (buffer << 6) | static_cast<uint32_t>(found - BASE64);
+        bits += 6;
+        if(bits >= 8){
+            bits -= 8;
+            data += static_cast<char>((buffer >> bits) & 0xFF);
+        }
+    }
+    return true;
+}
+
+uint64_t fnv1a(const std::string& text, uint64_t hash = 14695981039346656037ULL) {
+    for(unsigned char c : text){
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::string parameterName(const char* prefix, std::size_t index) {
+    return std::string("sq3pp_") + prefix + std::to_string(index);
+}
+
+DatabaseException invalidToken() {
+    return DatabaseException(SQ3::MISUSE, "Invalid page token.");
+}
+
+}
+
+PagedQuery::PagedQuery(Database& db, const std::string& table, const std::vector<Key>& keys)
+    : PagedQuery(db, table, keys, Options()) {}
+
+PagedQuery::PagedQuery(Database& db, const std::string& table, const std::vector<Key>& keys, const Options& options)
+    : _db(db), _table(table), _keys(keys), _options(options) {
+    if(!_db.isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot page: database is not open.");
+    }
+    if(_keys.empty()){
+        throw DatabaseException(SQ3::MISUSE, "Cannot page: no key columns.");
+    }
+    if(_options.select.empty()){
+        _options.select = "*";
+    }
+    // Tokens only fit queries ordering the same rows the same way
+    std::string definition = _table + '\0' + _options.where;
+    for(const Key& key : _keys){
+        definition += '\0' + key.column + (key.descending ? "-" : "+");
+    }
+    char fingerprint[17];
+    std::snprintf(fingerprint, sizeof(fingerprint), "%016llx", static_cast<unsigned long long>(fnv1a(definition)));
+    _fingerprint = fingerprint;
+}
+
+// Rows after (or before) the bound in key order. Row values compare the whole
+// key at once when all columns run in the same direction; mixed directions
+// need the expanded form a > ? OR (a = ? AND b < ?) ...
+std::string PagedQuery::condition(const char* prefix, bool after, bool inclusive) const {
+    bool uniform = true;
+    for(const Key& key : _keys){
+        uniform = uniform && key.descending == _keys[0].descending;
+    }
+    auto comparison = [after](const Key& key, bool orEqual){
+        return std::string(after != key.descending ? " >" : " <") + (orEqual ? "= " : " ");
+    };
+    if(uniform){
+        std::string columns;
+        std::string values;
+        for(std::size_t i = 0; i < _keys.size(); ++i){
+            columns += (i ? ", " : "") + quoteIdentifier(_keys[i].column);
+            values += (i ? ", :" : ":") + parameterName(prefix, i);
+        }
+        if(_keys.size() > 1){
+            columns = "(" + columns + ")";
+            values = "(" + values + ")";
+        }
+        return columns + comparison(_keys[0], inclusive) + values;
+    }
+    std::string out;
+    for(std::size_t i = 0; i < _keys.size(); ++i){
+        out += i ? " OR (" : "((";
+        for(std::size_t j = 0; j < i; ++j){
+            out += quoteIdentifier(_keys[j].column) + " = :" + parameterName(prefix, j) + " AND ";
+        }
+        out += quoteIdentifier(_keys[i].column) + comparison(_keys[i], inclusive && i + 1 == _keys.size())
+               + ":" + parameterName(prefix, i) + ")";
+    }
+    return out + ")";
+}
+
+std::string PagedQuery::query(int variant) const {
+    bool backward = variant & BACKWARD;
+    std::string keys;
+    std::string order;
+    for(std::size_t i = 0; i < _keys.size(); ++i){
+        keys += (i ? ", " : "") + quoteIdentifier(_keys[i].column);
+        order += (i ? ", " : "") + quoteIdentifier(_keys[i].column) + (_keys[i].descending != backward ? " DESC" : "");
+    }
+    std::vector<std::string> conditions;
+    if(!_options.where.empty()){
+        conditions.push_back("(" + _options.where + ")");
+    }
+    if(variant & AFTER){
+        conditions.push_back(condition("lo", true, false));
+    }
+    if(variant & FROM){
+        conditions.push_back(condition("lo", true, true));
+    }
+    if(variant & BEFORE){
+        conditions.push_back(condition("hi", false, false));
+    }
+    std::string sql = "SELECT " + (backward ? keys : _options.select + ", " + keys) + " FROM " + quoteIdentifier(_table);
+    for(std::size_t i = 0; i < conditions.size(); ++i){
+        sql += (i ? " AND " : " WHERE ") + conditions[i];
+    }
+    return sql + " ORDER BY " + order + " LIMIT :sq3pp_limit;";
+}
+
+Statement& PagedQuery::statement(int variant) {
+    auto found = _statements.find(variant);
+    if(found != _statements.end()){
+        return found->second;
+    }
+    Statement stmt = _db.createStatement(query(variant), SQLITE_PREPARE_PERSISTENT);
+    if(!stmt.isValid()){
+        throw DatabaseException(static_cast<SQ3>(sqlite3_errcode(_db.getHandle())), sqlite3_errmsg(_db.getHandle()));
+    }
+    return _statements.emplace(variant, std::move(stmt)).first->second;
+}
+
+void PagedQuery::bindParameters(Statement& stmt) {
+    for(std::size_t i = 0; i < _parameters.size(); ++i){
+        stmt.bind(_parameters[i], static_cast<int>(i));
+    }
+}
+
+std::vector<CellValue> PagedQuery::readKey(sqlite3_stmt* stmt) const {
+    std::vector<CellValue> key;
+    int first = sqlite3_column_count(stmt) - static_cast<int>(_keys.size());
+    for(std::size_t i = 0; i < _keys.size(); ++i){
+        int column = first + static_cast<int>(i);
+        switch(sqlite3_column_type(stmt, column)){
+            case SQLITE_INTEGER:
+                key.emplace_back(static_cast<int64_t>(sqlite3_column_int64(stmt, column)));
+                break;
+            case SQLITE_FLOAT:
+                key.emplace_back(sqlite3_column_double(stmt, column));
+                break;
+            case SQLITE_TEXT:
+                key.emplace_back(std::string(reinterpret_cast<const char*>(sqlite3_column_text(stmt, column)),
+                                             static_cast<std::size_t>(sqlite3_column_bytes(stmt, column))));
+                break;
+            case SQLITE_BLOB:
+                key.emplace_back(const_cast<void*>(sqlite3_column_blob(stmt, column)), sqlite3_column_bytes(stmt, column));
+                break;
+            default:
+                throw DatabaseException(SQ3::MISUSE, "Cannot page: key column " + _keys[i].column + " is NULL.");
+        }
+    }
+    return key;
+}
+
+// Token layout before base64: the query fingerprint, then per key column a
+// type letter, the length of the value text, ':' and the value text
+std::string PagedQuery::encode(const std::vector<CellValue>& key) const {
+    std::string data = _fingerprint;
+    for(const CellValue& value : key){
+        std::string text;
+        char type = 'i';
+        if(value.isInteger()){
+            text = std::to_string(value.valueAs<int64_t>());
+        }else if(value.isDouble()){
+            char number[32];
+            std::snprintf(number, sizeof(number), "%.17g", value.valueAs<double>());
+            text = number;
+            type = 'f';
+        }else if(value.isText()){
+            text = value.valueAs<std::string>();
+            type = 't';
+        }else{
+            std::vector<uint8_t> blob = value.valueAs<std::vector<uint8_t>>();
+            text.assign(blob.begin(), blob.end());
+            type = 'b';
+        }
+        data += type + std::to_string(text.size()) + ':' + text;
+    }
+    return toBase64(data);
+}
+
+std::vector<CellValue> PagedQuery::decode(const std::string& token) const {
+    std::string data;
+    if(!fromBase64(token, data) || data.size() < _fingerprint.size()){
+        throw invalidToken();
+    }
+    if(data.compare(0, _fingerprint.size(), _fingerprint) != 0){
+        throw DatabaseException(SQ3::MISUSE, "Page token was made for a different query.");
+    }
+    std::vector<CellValue> key;
+    std::size_t position = _fingerprint.size();
+    while(position < data.size()){
+        char type = data[position++];
+        std::size_t colon = data.find(':', position);
+        if(colon == std::string::npos || colon == position){
+            throw invalidToken();
+        }
+        char* end = nullptr;
+        unsigned long long length = std::strtoull(data.c_str() + position, &end, 10);
+        if(end != data.c_str() + colon || length > data.size() - colon - 1){
+            throw invalidToken();
+        }
+        std::string text = data.substr(colon + 1, static_cast<std::size_t>(length));
+        position = colon + 1 + static_cast<std::size_t>(length);
+        switch(type){
+            case 'i': key.emplace_back(static_cast<int64_t>(std::strtoll(text.c_str(), nullptr, 10))); break;
+            case 'f': key.emplace_back(std::strtod(text.c_str(), nullptr)); break;
+            case 't': key.emplace_back(text); break;
+            case 'b': key.emplace_back(static_cast<void*>(&text[0]), static_cast<int>(text.size())); break;
+            default: throw invalidToken();
+        }
+    }
+    if(key.size() != _keys.size()){
+        throw invalidToken();
+    }
+    return key;
+}
+
+PagedQuery::Page PagedQuery::readForward(int variant, const std::vector<CellValue>* lower, const std::vector<CellValue>* upper,
+                                         std::size_t pageSize, const std::function<void(Row& row)>& onRow) {
+    Statement& stmt = statement(variant);
+    stmt.reset(true);
+    bindParameters(stmt);
+    for(std::size_t i = 0; lower && i < _keys.size(); ++i){
+        stmt.bindById(parameterName("lo", i), (*lower)[i]);
+    }
+    for(std::size_t i = 0; upper && i < _keys.size(); ++i){
+        stmt.bindById(parameterName("hi", i), (*upper)[i]);
+    }
+    // One row more than asked for tells whether another page follows
+    stmt.bindById("sq3pp_limit", static_cast<int64_t>(pageSize) + 1);
+
+    Page page{0, "", "", false, false};
+    std::vector<CellValue> lastKey;
+    try{
+        stmt.execute([&](Row& row){
+            if(page.rows == pageSize){
+                page.hasNext = true;
+                return;
+            }
+            lastKey = readKey(stmt.getHandle());
+            if(page.rows == 0){
+                page.first = encode(lastKey);
+            }
+            ++page.rows;
+            if(onRow){
+                onRow(row);
+            }
+        });
+    } catch(...) {
+        stmt.reset(true);
+        throw;
+    }
+    stmt.reset(true);
+    if(page.rows > 0){
+        page.last = encode(lastKey);
+    }
+    return page;
+}
+
+bool PagedQuery::seekBackward(const std::vector<CellValue>* upper, std::size_t pageSize, std::vector<CellValue>& key, bool& found) {
+    Statement& stmt = statement(BACKWARD | (upper ? BEFORE : 0));
+    stmt.reset(true);
+    bindParameters(stmt);
+    for(std::size_t i = 0; upper && i < _keys.size(); ++i){
+        stmt.bindById(parameterName("hi", i), (*upper)[i]);
+    }
+    stmt.bindById("sq3pp_limit", static_cast<int64_t>(pageSize) + 1);
+
+    std::size_t rows = 0;
+    bool more = false;
+    try{
+        stmt.execute([&](Row&){
+            if(rows == pageSize){
+                more = true;
+                return;
+            }
+            key = readKey(stmt.getHandle());
+            ++rows;
+        });
+    } catch(...) {
+        stmt.reset(true);
+        throw;
+    }
+    stmt.reset(true);
+    found = rows > 0;
+    return more;
+}
+
+PagedQuery::Page PagedQuery::first(std::size_t pageSize, const std::function<void(Row& row)>& onRow) {
+    if(pageSize == 0){
+        throw DatabaseException(SQ3::MISUSE, "Cannot page: page size is 0.");
+    }
+    return readForward(FORWARD, nullptr, nullptr, pageSize, onRow);
+}
+
+PagedQuery::Page PagedQuery::last(std::size_t pageSize, const std::function<void(Row& row)>& onRow) {
+    if(pageSize == 0){
+        throw DatabaseException(SQ3::MISUSE, "Cannot page: page size is 0.");
+    }
+    // Find where the last page starts, then read it in key order
+    std::vector<CellValue> start;
+    bool found = false;
+    bool more = seekBackward(nullptr, pageSize, start, found);
+    if(!found){
+        return Page{0, "", "", false, false};
+    }
+    Page page = readForward(FORWARD | FROM, &start, nullptr, pageSize, onRow);
+    page.hasPrevious = more;
+    return page;
+}
+
+PagedQuery::Page PagedQuery::next(const std::string& token, std::size_t pageSize, const std::function<void(Row& row)>& onRow) {
+    if(token.empty()){
+        return first(pageSize, onRow);
+    }
+    if(pageSize == 0){
+        throw DatabaseException(SQ3::MISUSE, "Cannot page: page size is 0.");
+    }
+    std::vector<CellValue> lower = decode(token);
+    Page page = readForward(FORWARD | AFTER, &lower, nullptr, pageSize, onRow);
+    page.hasPrevious = true;
+    return page;
+}
+
+PagedQuery::Page PagedQuery::previous(const std::string& token, std::size_t pageSize, const std::function<void(Row& row)>& onRow) {
+    if(token.empty()){
+        return last(pageSize, onRow);
+    }
+    if(pageSize == 0){
+        throw DatabaseException(SQ3::MISUSE, "Cannot page: page size is 0.");
+    }
+    std::vector<CellValue> upper = decode(token);
+    std::vector<CellValue> start;
+    bool found = false;
+    bool more = seekBackward(&upper, pageSize, start, found);
+    if(!found){
+        return Page{0, "", "", false, true};
+    }
+    Page page = readForward(FORWARD | FROM | BEFORE, &start, &upper, pageSize, onRow);
+    page.hasPrevious = more;
+    page.hasNext = true;
+    return page;
+}
@@ -0,0 +1,124 @@
+#include <sq3pp/ParallelScan.h>
+#include <sq3pp/Database.h>
+#include <sq3pp/Exception.h>
+#include <sq3pp/ThreadPool.h>
+#include <sq3pp/Transaction.h>
+#include "SqlText.h"
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <thread>
+
+using namespace sq3pp;
+using detail::quoteIdentifier;
+
+static void openReader(Database& db, const std::string& file) {
+    int rc = db.open(file, SQLITE_OPEN_READONLY);
+    if(rc != SQLITE_OK){
+        throw DatabaseException(static_cast<SQ3>(rc), "Cannot open " + file + " for reading: " + sqlite3_errstr(rc));
+    }
+}
+
+ParallelScan::ParallelScan(const std::string& file, const std::string& table)
+    : ParallelScan(file, table, Options()) {}
+
+ParallelScan::ParallelScan(const std::string& file, const std::string& table, const Options& options)
+    : _file(file), _options(options) {
+    if(_options.connections == 0){
+        _options.connections = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if(_options.partitions == 0){
+        _options.partitions = _options.connections * 4;
+    }
+    if(_options.column.empty()){
+        _options.column = "rowid";
+    }
+    if(_options.select.empty()){
+        _options.select = "*";
+    }
+
+    std::string filter = _options.where.empty() ? "" : " AND (" + _options.where + ")";
+    std::string column = quoteIdentifier(_options.column);
+    _query = "SELECT " + _options.select + " FROM " + quoteIdentifier(table)
+           + " WHERE " + column + " BETWEEN ?1 AND ?2" + filter + ";";
+
+    // min() and max() of an indexed column are single b-tree seeks
+    Database db;
+    openReader(db, _file);
+    std::unique_ptr<Transaction> read;
+    if(_options.snapshot.isValid()){
+        read.reset(new Transaction(db.beginRead(_options.snapshot)));
+    }
+    Statement bounds = db.createStatement("SELECT min(" + column + "), max(" + column + ") FROM " + quoteIdentifier(table) + ";");
+    bool empty = true;
+    int64_t low = 0;
+    int64_t high = 0;
+    bounds.execute([&empty, &low, &high](Row& row){
+        if(!row[0].isNull()){
+            empty = false;
+            low = row[0].valueAs<int64_t>();
+            high = row[1].valueAs<int64_t>();
+        }
+    });
+    if(empty){
+        return;
+    }
+
+    // Equal-width key ranges; dense keys such as rowids give balanced partitions
+    uint64_t span = static_cast<uint64_t>(high) - static_cast<uint64_t>(low);
+    uint64_t parts = std::min<uint64_t>(_options.partitions, span + 1 == 0 ? _options.partitions : span + 1);
+    uint64_t width = span / parts + 1;
+    uint64_t offset = 0;
+    for(uint64_t i = 0; i < parts && offset <= span; ++i){
+        uint64_t last = std::min(span, offset + width - 1);
+        _ranges.push_back(Range{static_cast<int64_t>(static_cast<uint64_t>(low) + offset),
+                                static_cast<int64_t>(static_cast<uint64_t>(low) + last)});
+        if(last == span){
+            break;
+        }
+        offset = last + 1;
+    }
+}
+
+void ParallelScan::run(const std::function<void(Row& row, std::size_t partition)>& onRow) {
+    if(_ranges.empty()){
+        return;
+    }
+    std::size_t workers = std::min(_options.connections, _ranges.size());
+    std::atomic<std::size_t> next(0);
+    std::atomic<bool> failed(false);
+
+    ThreadPool pool(workers);
+    std::vector<std::future<void>> pending;
+    pending.reserve(workers);
+    for(std::size_t i = 0; i < workers; ++i){
+        pending.push_back(pool.submit([this, &onRow, &next, &failed](){
+            try{
+                Database db;
+                openReader(db, _file);
+                std::unique_ptr<Transaction> read;
+                if(_options.snapshot.isValid()){
+                    read.reset(new Transaction(db.beginRead(_options.snapshot)));
+                }
+                Statement stmt = db.createStatement(_query);
+                for(std::size_t partition = next++; partition < _ranges.size() && !failed; partition = next++){
+                    stmt.reset();
+                    stmt.bind(_ranges[partition].first, 0).bind(_ranges[partition].last, 1);
+                    stmt.execute([&onRow, partition](Row& row){
+                        onRow(row, partition);
+                    });
+                }
+            }catch(...){
+                failed = true;
+                throw;
+            }
+        }));
+    }
+    for(std::future<void>& result : pending){
+        result.wait();
+    }
+    for(std::future<void>& result : pending){
+        result.get();
+    }
+}
@@ -0,0 +1,363 @@
+#include <sq3pp/PartitionedTable.h>
+#include <sq3pp/Exception.h>
+#include "SqlText.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+
+using namespace sq3pp;
+using detail::quoteIdentifier;
+using detail::quoteString;
+
+static bool sameName(const std::string& a, const std::string& b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y){
+        return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+    });
+}
+
+PartitionedTable::PartitionedTable(Database& db, const std::string& table, const std::string& columns,
+                                   const std::string& timeColumn)
+    : PartitionedTable(db, table, columns, timeColumn, Options()) {}
+
+PartitionedTable::PartitionedTable(Database& db, const std::string& table, const std::string& columns,
+                                   const std::string& timeColumn, const Options& options)
+    : _db(db), _table(table), _columns(columns), _timeColumn(timeColumn), _options(options), _timeIndex(0), _uses(0) {
+    if(!_db.isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot partition table: database is not open.");
+    }
+    if(_options.window <= 0 || _options.maxAttached == 0){
+        throw DatabaseException(SQ3::MISUSE, "Cannot partition table: window and maxAttached must be positive.");
+    }
+    sqlite3* handle = _db.getHandle();
+
+    // main and temp do not count against the limit, other attached databases do
+    std::size_t attached = 0;
+    _db.execute("PRAGMA database_list;", [&attached](Row& row){
+        std::string name = row[1].valueAs<std::string>();
+        if(name != "main" && name != "temp"){
+            ++attached;
+        }
+    });
+    std::size_t limit = static_cast<std::size_t>(sqlite3_limit(handle, SQLITE_LIMIT_ATTACHED, -1));
+    _options.maxAttached = std::min(_options.maxAttached, limit > attached ? limit - attached : 0);
+    if(_options.maxAttached == 0){
+        throw DatabaseException(SQ3::RANGE, "Cannot partition table: no database can be attached.");
+    }
+
+    if(_options.directory.empty()){
+        const char* file = sqlite3_db_filename(handle, "main");
+        if(!file || !*file){
+            throw DatabaseException(SQ3::MISUSE, "Cannot partition table: set a directory for an in-memory database.");
+        }
+        std::string path(file);
+        std::size_t slash = path.find_last_of('/');
+        _options.directory = slash == std::string::npos ? "." : path.substr(0, std::max<std::size_t>(slash, 1));
+    }
+
+    // The columns of the partitions, and the view while none is attached
+    _template = "sq3pp_partition_" + _table;
+    _db.execute("CREATE TEMP TABLE IF NOT EXISTS " + quoteIdentifier(_template) + " (" + _columns + ");");
+    bool found = false;
+    _db.execute("PRAGMA temp.table_info(" + quoteIdentifier(_template) + ");", [this, &found](Row& row){
+        std::string name = row[1].valueAs<std::string>();
+        if(sameName(name, _timeColumn)){
+            _timeIndex = _columnNames.size();
+            _timeColumn = name;
+            found = true;
+        }
+        _columnNames.push_back(name);
+    });
+    if(!found){
+        _db.execute("DROP TABLE temp." + quoteIdentifier(_template) + ";");
+        throw DatabaseException(SQ3::ERROR, "Cannot partition table: no such column: " + _table + "." + _timeColumn);
+    }
+
+    _db.execute("CREATE TABLE IF NOT EXISTS main.sq3pp_partitions (name TEXT NOT NULL, start_time INTEGER NOT NULL, "
+                "end_time INTEGER NOT NULL, file TEXT NOT NULL, PRIMARY KEY (name, start_time)) WITHOUT ROWID;");
+    Statement list = _db.createStatement("SELECT start_time, end_time, file FROM main.sq3pp_partitions WHERE name = ?1;");
+    list.bind(_table).execute([this](Row& row){
+        int64_t start = row[0].valueAs<int64_t>();
+        State& state = _partitions[start];
+        state.partition = Partition{start, row[1].valueAs<int64_t>(), row[2].valueAs<std::string>(), false};
+        state.schema = _table + "@" + std::to_string(start);
+        state.lastUse = 0;
+    });
+    list.finalize();
+
+    // The newest partitions are the likeliest to be queried
+    if(sqlite3_get_autocommit(handle)){
+        std::size_t count = 0;
+        for(auto it = _partitions.rbegin(); it != _partitions.rend() && count < _options.maxAttached; ++it, ++count){
+            attach(it->second, {it->first});
+        }
+    }
+    rebuildView();
+}
+
+PartitionedTable::~PartitionedTable() {
+    try{
+        _db.execute("DROP VIEW IF EXISTS temp." + quoteIdentifier(_table) + ";");
+        for(auto& entry : _partitions){
+            if(entry.second.partition.attached){
+                detach(entry.second);
+            }
+        }
+        _db.execute("DROP TABLE IF EXISTS temp." + quoteIdentifier(_template) + ";");
+    } catch(...) {
+        // Suppress all exceptions in destructor
+    }
+}
+
+std::vector<PartitionedTable::Partition> PartitionedTable::partitions() const {
+    std::vector<Partition> out;
+    for(const auto& entry : _partitions){
+        out.push_back(entry.second.partition);
+    }
+    return out;
+}
+
+int64_t PartitionedTable::partitionStart(int64_t time) const {
+    int64_t start = time - time % _options.window;
+    return time % _options.window < 0 ? start - _options.window : start;
+}
+
+int64_t PartitionedTable::timeOf(const std::vector<CellValue>& row) const {
+    const CellValue& value = row[_timeIndex];
+    if(value.isInteger()){
+        return value.valueAs<int64_t>();
+    }
+    if(value.isDouble()){
+        return static_cast<int64_t>(std::floor(value.valueAs<double>()));
+    }
+    throw DatabaseException(SQ3::MISUSE, "Cannot insert row: " + _timeColumn + " is not a number.");
+}
+
+PartitionedTable::State& PartitionedTable::partitionFor(int64_t time) {
+    int64_t start = partitionStart(time);
+    auto it = _partitions.find(start);
+    if(it == _partitions.end()){
+        State& state = _partitions[start];
+        state.partition = Partition{start, start + _options.window,
+                                    _options.directory + "/" + _table + "_" + std::to_string(start) + ".db", false};
+        state.schema = _table + "@" + std::to_string(start);
+        state.lastUse = 0;
+        try{
+            attach(state, {start});
+            _db.exec("INSERT OR IGNORE INTO main.sq3pp_partitions VALUES (?, ?, ?, ?);",
+                     _table, start, state.partition.end, state.partition.file);
+        } catch(...) {
+            if(state.partition.attached){
+                detach(state);
+            }
+            _partitions.erase(start);
+            rebuildView();
+            throw;
+        }
+        return state;
+    }
+    attach(it->second, {start});
+    return it->second;
+}
+
+void PartitionedTable::attach(State& state, const std::set<int64_t>& pinned) {
+    state.lastUse = ++_uses;
+    if(state.partition.attached){
+        return;
+    }
+    std::size_t attached = 0;
+    for(const auto& entry : _partitions){
+        attached += entry.second.partition.attached ? 1 : 0;
+    }
+    while(attached >= _options.maxAttached){
+        State* victim = nullptr;
+        for(auto& entry : _partitions){
+            State& other = entry.second;
+            if(other.partition.attached && !pinned.count(entry.first) && (!victim || other.lastUse < victim->lastUse)){
+                victim = &other;
+            }
+        }
+        if(!victim){
+            throw DatabaseException(SQ3::RANGE, "Cannot attach more than " + std::to_string(_options.maxAttached)
+                                    + " partitions of " + _table + ".");
+        }
+        detach(*victim);
+        --attached;
+    }
+
+    std::string schema = quoteIdentifier(state.schema);
+    _db.execute("ATTACH DATABASE " + quoteString(state.partition.file) + " AS " + schema + ";");
+    state.partition.attached = true;
+    // Also recreates a partition whose file went missing
+    std::string script = "CREATE TABLE IF NOT EXISTS " + schema + "." + quoteIdentifier(_table) + " (" + _columns + ");";
+    if(_options.indexTime){
+        script += "CREATE INDEX IF NOT EXISTS " + schema + "." + quoteIdentifier(_table + "_time") + " ON "
+                  + quoteIdentifier(_table) + " (" + quoteIdentifier(_timeColumn) + ");";
+    }
+    for(std::size_t i = 0; i < _options.indexes.size(); ++i){
+        script += "CREATE INDEX IF NOT EXISTS " + schema + "." + quoteIdentifier(_table + "_" + std::to_string(i + 1))
+                  + " ON " + quoteIdentifier(_table) + " (" + _options.indexes[i] + ");";
+    }
+    try{
+        _db.execute(script);
+    } catch(...) {
+        detach(state);
+        throw;
+    }
+    rebuildView();
+}
+
+void PartitionedTable::detach(State& state) {
+    state.insert.finalize();
+    _db.execute("DETACH DATABASE " + quoteIdentifier(state.schema) + ";");
+    state.partition.attached = false;
+}
+
+void PartitionedTable::rebuildView() {
+    std::string select;
+    for(const auto& entry : _partitions){
+        if(entry.second.partition.attached){
+            select += (select.empty() ? "SELECT * FROM " : " UNION ALL SELECT * FROM ")
+                      + quoteIdentifier(entry.second.schema) + "." + quoteIdentifier(_table);
+        }
+    }
+    if(select.empty()){
+        select = "SELECT * FROM temp." + quoteIdentifier(_template);
+    }
+    _db.execute("DROP VIEW IF EXISTS temp." + quoteIdentifier(_table) + "; CREATE TEMP VIEW "
+                + quoteIdentifier(_table) + " AS " + select + ";");
+}
+
+void PartitionedTable::insertInto(State& state, const std::vector<CellValue>& row) {
+    if(!state.insert.isValid()){
+        std::string placeholders;
+        for(std::size_t i = 0; i < _columnNames.size(); ++i){
+            placeholders += i ? ", ?" : "?";
+        }
+        state.insert = _db.createStatement("INSERT INTO " + quoteIdentifier(state.schema) + "." + quoteIdentifier(_table)
+                                           + " VALUES (" + placeholders + ");", SQLITE_PREPARE_PERSISTENT);
+        if(!state.insert.isValid()){
+            throw DatabaseException(static_cast<SQ3>(sqlite3_errcode(_db.getHandle())), sqlite3_errmsg(_db.getHandle()));
+        }
+    }
+    state.insert.reset(true);
+    for(std::size_t i = 0; i < row.size(); ++i){
+        state.insert.bind(row[i], static_cast<int>(i));
+    }
+    try{
+        state.insert.execute();
+    } catch(...) {
+        state.insert.reset(true);
+        throw;
+    }
+    state.insert.reset(true);
+}
+
+void PartitionedTable::insert(const std::vector<CellValue>& row) {
+    if(row.size() != _columnNames.size()){
+        throw DatabaseException(SQ3::RANGE, "Cannot insert row: " + std::to_string(row.size()) + " values for "
+                                + std::to_string(_columnNames.size()) + " columns.");
+    }
+    insertInto(partitionFor(timeOf(row)), row);
+}
+
+void PartitionedTable::insertRows(const std::vector<std::vector<CellValue>>& rows) {
+    std::map<int64_t, std::vector<const std::vector<CellValue>*>> byPartition;
+    for(const std::vector<CellValue>& row : rows){
+        if(row.size() != _columnNames.size()){
+            throw DatabaseException(SQ3::RANGE, "Cannot insert row: " + std::to_string(row.size()) + " values for "
+                                    + std::to_string(_columnNames.size()) + " columns.");
+        }
+        byPartition[partitionStart(timeOf(row))].push_back(&row);
+    }
+    for(const auto& entry : byPartition){
+        State& state = partitionFor(entry.first);
+        bool own = sqlite3_get_autocommit(_db.getHandle()) != 0;
+        if(own){
+            _db.execute("BEGIN;");
+        }
+        try{
+            for(const std::vector<CellValue>* row : entry.second){
+                insertInto(state, *row);
+            }
+            if(own){
+                _db.execute("COMMIT;");
+            }
+        } catch(...) {
+            if(own){
+                sqlite3_exec(_db.getHandle(), "ROLLBACK;", nullptr, nullptr, nullptr);
+            }
+            throw;
+        }
+    }
+}
+
+int PartitionedTable::select(int64_t from, int64_t to, const std::string& columns, const std::string& where,
+                             const std::vector<CellValue>& params, const std::function<void(Row& row)>& onRow) {
+    int rows = 0;
+    for(auto& entry : _partitions){
+        State& state = entry.second;
+        if(state.partition.end <= from || state.partition.start >= to){
+            continue;
+        }
+        attach(state, {entry.first});
+        std::string sql = "SELECT " + columns + " FROM " + quoteIdentifier(state.schema) + "." + quoteIdentifier(_table)
+                          + " WHERE " + quoteIdentifier(_timeColumn) + " >= ? AND " + quoteIdentifier(_timeColumn) + " < ?";
+        if(!where.empty()){
+            sql += " AND (" + where + ")";
+        }
+        Statement stmt = _db.createStatement(sql + ";");
+        if(!stmt.isValid()){
+            throw DatabaseException(static_cast<SQ3>(sqlite3_errcode(_db.getHandle())), sqlite3_errmsg(_db.getHandle()));
+        }
+        stmt.bind(CellValue(from), 0);
+        stmt.bind(CellValue(to), 1);
+        for(std::size_t i = 0; i < params.size(); ++i){
+            stmt.bind(params[i], static_cast<int>(i + 2));
+        }
+        rows += stmt.execute(onRow);
+    }
+    return rows;
+}
+
+std::size_t PartitionedTable::attachRange(int64_t from, int64_t to) {
+    std::set<int64_t> overlapping;
+    for(const auto& entry : _partitions){
+        if(entry.second.partition.end > from && entry.second.partition.start < to){
+            overlapping.insert(entry.first);
+        }
+    }
+    if(overlapping.size() > _options.maxAttached){
+        throw DatabaseException(SQ3::RANGE, std::to_string(overlapping.size()) + " partitions of " + _table
+                                + " overlap the range, at most " + std::to_string(_options.maxAttached) + " can be attached.");
+    }
+    for(int64_t start : overlapping){
+        attach(_partitions[start], overlapping);
+    }
+    return overlapping.size();
+}
+
+std::size_t PartitionedTable::retireBefore(int64_t time) {
+    std::vector<int64_t> retired;
+    for(auto& entry : _partitions){
+        if(entry.second.partition.end <= time){
+            if(entry.second.partition.attached){
+                detach(entry.second);
+            }
+            retired.push_back(entry.first);
+        }
+    }
+    if(retired.empty()){
+        return 0;
+    }
+    rebuildView();
+    _db.exec("DELETE FROM main.sq3pp_partitions WHERE name = ? AND end_time <= ?;", _table, time);
+    for(int64_t start : retired){
+        const std::string& file = _partitions[start].partition.file;
+        for(const char* suffix : {"", "-wal", "-shm", "-journal"}){
+            std::remove((file + suffix).c_str());
+        }
+        _partitions.erase(start);
+    }
+    return retired.size();
+}
@@ -0,0 +1,469 @@
+#include "PoolAllocator.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+using namespace sq3pp;
+
+namespace{
+
+const std::size_t HEADER_SIZE = 16;
+const std::size_t MAX_POOLED = 16384;
+const std::size_t SLAB_SIZE = 1 << 20;
+const uint32_t LARGE_CLASS = 0xFFFFFFFFu;
+
+// Precedes every block handed to SQLite, keeps the payload 16-byte aligned
+struct Header{
+    uint32_t sizeClass;
+    uint32_t reserved;
+    uint64_t size;
+};
+static_assert(sizeof(Header) == HEADER_SIZE, "unexpected header size");
+
+struct FreeBlock{
+    FreeBlock* next;
+};
+
+// Steps of 16 bytes up to 128, then each class about a quarter larger,
+// ending at MAX_POOLED
+class SizeClasses{
+public:
+    SizeClasses() {
+        std::size_t size = 16;
+        while(size <= MAX_POOLED){
+            _sizes.push_back(size);
+            std::size_t step = size < 128 ? 16 : (size >> 2) & ~static_cast<std::size_t>(15);
+            size += step;
+        }
+        // The steps do not land on MAX_POOLED; the last class must cover it
+        if(_sizes.back() < MAX_POOLED){
+            _sizes.push_back(MAX_POOLED);
+        }
+        _lookup.resize(MAX_POOLED / 16 + 1);
+        std::size_t cls = 0;
+        for(std::size_t i = 0; i < _lookup.size(); ++i){
+            while(_sizes[cls] < i * 16) ++cls;
+            _lookup[i] = static_cast<uint8_t>(cls);
+        }
+    }
+
+    std::size_t count() const {return _sizes.size();}
+    std::size_t size(std::size_t cls) const {return _sizes[cls];}
+    std::size_t classFor(std::size_t n) const {return _lookup[(n + 15) / 16];}
+
+private:
+    std::vector<std::size_t> _sizes;
+    std::vector<uint8_t> _lookup;
+};
+
+struct SharedClass{
+    std::mutex mutex;
+    FreeBlock* head = nullptr;
+    std::size_t count = 0;
+};
+
+struct Counters{
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> frees{0};
+    std::atomic<uint64_t> reallocations{0};
+    std::atomic<int64_t> bytesInUse{0};
+    std::atomic<uint64_t> cacheHits{0};
+    std::atomic<uint64_t> cacheMisses{0};
+    std::atomic<uint64_t> largeAllocations{0};
+
+    void addTo(AllocatorStats& stats) const {
+        stats.allocations += allocations.load(std::memory_order_relaxed);
+        stats.frees += frees.load(std::memory_order_relaxed);
+        stats.reallocations += reallocations.load(std::memory_order_relaxed);
+        stats.bytesInUse += bytesInUse.load(std::memory_order_relaxed);
+        stats.cacheHits += cacheHits.load(std::memory_order_relaxed);
+        stats.cacheMisses += cacheMisses.load(std::memory_order_relaxed);
+        stats.largeAllocations += largeAllocations.load(std::memory_order_relaxed);
+    }
+};
+
+inline void bump(std::atomic<uint64_t>& counter) {
+    // Only the owning thread writes its counters: no contention
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+inline void bump(std::atomic<int64_t>& counter, int64_t delta) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+class ThreadCache;
+
+// Process-wide part of the allocator. Intentionally leaked so blocks freed
+// during static destruction or late thread exit stay valid.
+class SharedPool{
+public:
+    static SharedPool& instance() {
+        static SharedPool* pool = new SharedPool();
+        return *pool;
+    }
+
+    const SizeClasses& classes() const {return _classes;}
+
+    // Move up to n blocks of a class into a chain, carving a slab when empty
+    FreeBlock* take(std::size_t cls, std::size_t n, std::size_t& taken) {
+        SharedClass& shared = _shared[cls];
+        {
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            if(shared.head){
+                FreeBlock* head = shared.head;
+                FreeBlock* tail = head;
+                taken = 1;
+                while(taken < n && tail->next){
+                    tail = tail->next;
+                    ++taken;
+                }
+                shared.head = tail->next;
+                shared.count -= taken;
+                tail->next = nullptr;
+                return head;
+            }
+        }
+        return carve(cls, n, taken);
+    }
+
+    void give(std::size_t cls, FreeBlock* head, FreeBlock* tail, std::size_t n) {
+        SharedClass& shared = _shared[cls];
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        tail->next = shared.head;
+        shared.head = head;
+        shared.count += n;
+    }
+
+    void registerCache(Counters* counters) {
+        std::lock_guard<std::mutex> lock(_registryMutex);
+        _caches.push_back(counters);
+    }
+
+    void unregisterCache(Counters* counters) {
+        std::lock_guard<std::mutex> lock(_registryMutex);
+        for(std::size_t i = 0; i < _caches.size(); ++i){
+            if(_caches[i] == counters){
+                _caches[i] = _caches.back();
+                _caches.pop_back();
+                break;
+            }
+        }
+        AllocatorStats retired{};
+        counters->addTo(retired);
+        bump(_retired.allocations, retired.allocations);
+        bump(_retired.frees, retired.frees);
+        bump(_retired.reallocations, retired.reallocations);
+        bump(_retired.bytesInUse, retired.bytesInUse);
+        bump(_retired.cacheHits, retired.cacheHits);
+        bump(_retired.cacheMisses, retired.cacheMisses);
+        bump(_retired.largeAllocations, retired.largeAllocations);
+    }
+
+    AllocatorStats stats() {
+        AllocatorStats stats{};
+        std::lock_guard<std::mutex> lock(_registryMutex);
+        _retired.addTo(stats);
+        for(Counters* counters : _caches){
+            counters->addTo(stats);
+        }
+        _orphans.addTo(stats);
+        return stats;
+    }
+
+    // Counters of threads whose cache is already gone
+    Counters& orphans() {return _orphans;}
+    std::mutex& orphansMutex() {return _orphansMutex;}
+
+private:
+    SharedPool() : _shared(_classes.count()), _slab(nullptr), _slabLeft(0) {}
+
+    static void bump(std::atomic<uint64_t>& counter, uint64_t delta) {
+        counter.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    static void bump(std::atomic<int64_t>& counter, int64_t delta) {
+        counter.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    FreeBlock* carve(std::size_t cls, std::size_t n, std::size_t& taken) {
+        std::size_t blockSize = HEADER_SIZE + _classes.size(cls);
+        std::lock_guard<std::mutex> lock(_slabMutex);
+        FreeBlock* head = nullptr;
+        taken = 0;
+        while(taken < n){
+            if(_slabLeft < blockSize){
+                if(taken > 0) break;
+                _slab = static_cast<char*>(std::malloc(SLAB_SIZE));
+                if(!_slab){
+                    _slabLeft = 0;
+                    return nullptr;
+                }
+                _slabLeft = SLAB_SIZE;
+            }
+            Header* header = reinterpret_cast<Header*>(_slab);
+            header->sizeClass = static_cast<uint32_t>(cls);
+            header->size = _classes.size(cls);
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(_slab + HEADER_SIZE);
+            block->next = head;
+            head = block;
+            _slab += blockSize;
+            _slabLeft -= blockSize;
+            ++taken;
+        }
+        return head;
+    }
+
+    SizeClasses _classes;
+    std::vector<SharedClass> _shared;
+    std::mutex _slabMutex;
+    char* _slab;
+    std::size_t _slabLeft;
+
+    std::mutex _registryMutex;
+    std::vector<Counters*> _caches;
+    Counters _retired;
+    std::mutex _orphansMutex;
+    Counters _orphans;
+};
+
+class ThreadCache{
+public:
+    ThreadCache() : _pool(SharedPool::instance()), _lists(_pool.classes().count()) {
+        for(std::size_t cls = 0; cls < _lists.size(); ++cls){
+            std::size_t limit = 32768 / _pool.classes().size(cls);
+            _lists[cls].limit = limit < 8 ? 8 : (limit > 256 ? 256 : limit);
+        }
+        _pool.registerCache(&_counters);
+    }
+
+    ~ThreadCache() {
+        for(std::size_t cls = 0; cls < _lists.size(); ++cls){
+            List& list = _lists[cls];
+            if(list.head){
+                FreeBlock* tail = list.head;
+                while(tail->next) tail = tail->next;
+                _pool.give(cls, list.head, tail, list.count);
+            }
+        }
+        _pool.unregisterCache(&_counters);
+    }
+
+    void* allocate(std::size_t cls) {
+        List& list = _lists[cls];
+        if(!list.head){
+            bump(_counters.cacheMisses);
+            std::size_t taken = 0;
+            list.head = _pool.take(cls, list.limit / 2 + 1, taken);
+            list.count = taken;
+            if(!list.head){
+                return nullptr;
+            }
+        } else {
+            bump(_counters.cacheHits);
+        }
+        FreeBlock* block = list.head;
+        list.head = block->next;
+        --list.count;
+        bump(_counters.allocations);
+        bump(_counters.bytesInUse, static_cast<int64_t>(_pool.classes().size(cls)));
+        return block;
+    }
+
+    void release(std::size_t cls, void* payload) {
+        List& list = _lists[cls];
+        FreeBlock* block = static_cast<FreeBlock*>(payload);
+        block->next = list.head;
+        list.head = block;
+        ++list.count;
+        bump(_counters.frees);
+        bump(_counters.bytesInUse, -static_cast<int64_t>(_pool.classes().size(cls)));
+
+        if(list.count > list.limit){
+            // Spill half of the list to the shared pool
+            std::size_t keep = list.limit / 2;
+            FreeBlock* last = list.head;
+            for(std::size_t i = 1; i < keep; ++i) last = last->next;
+            FreeBlock* spill = last->next;
+            FreeBlock* tail = spill;
+            std::size_t n = 1;
+            while(tail->next){
+                tail = tail->next;
+                ++n;
+            }
+            last->next = nullptr;
+            list.count = keep;
+            _pool.give(cls, spill, tail, n);
+        }
+    }
+
+    Counters& counters() {return _counters;}
+
+private:
+    struct List{
+        FreeBlock* head = nullptr;
+        std::size_t count = 0;
+        std::size_t limit = 0;
+    };
+
+    SharedPool& _pool;
+    std::vector<List> _lists;
+    Counters _counters;
+};
+
+// Trivially destructible, so still readable while thread_locals are torn down
+thread_local bool t_cacheDestroyed = false;
+
+struct CacheHolder{
+    ThreadCache cache;
+    ~CacheHolder() {
+        t_cacheDestroyed = true;
+    }
+};
+
+ThreadCache* threadCache() {
+    if(t_cacheDestroyed){
+        return nullptr;
+    }
+    thread_local CacheHolder holder;
+    return &holder.cache;
+}
+
+void* poolMalloc(int n) {
+    if(n <= 0){
+        return nullptr;
+    }
+    std::size_t size = static_cast<std::size_t>(n);
+    SharedPool& pool = SharedPool::instance();
+    ThreadCache* cache = threadCache();
+
+    if(size > MAX_POOLED || !cache){
+        Header* header = static_cast<Header*>(std::malloc(HEADER_SIZE + size));
+        if(!header){
+            return nullptr;
+        }
+        header->sizeClass = LARGE_CLASS;
+        header->size = size;
+        if(cache){
+            bump(cache->counters().largeAllocations);
+            bump(cache->counters().allocations);
+            bump(cache->counters().bytesInUse, static_cast<int64_t>(size));
+        } else {
+            std::lock_guard<std::mutex> lock(pool.orphansMutex());
+            bump(pool.orphans().largeAllocations);
+            bump(pool.orphans().allocations);
+            bump(pool.orphans().bytesInUse, static_cast<int64_t>(size));
+        }
+        return reinterpret_cast<char*>(header) + HEADER_SIZE;
+    }
+    return cache->allocate(pool.classes().classFor(size));
+}
+
+Header* headerOf(void* p) {
+    return reinterpret_cast<Header*>(static_cast<char*>(p) - HEADER_SIZE);
+}
+
+void poolFree(void* p) {
+    if(!p){
+        return;
+    }
+    Header* header = headerOf(p);
+    ThreadCache* cache = threadCache();
+    SharedPool& pool = SharedPool::instance();
+
+    if(header->sizeClass == LARGE_CLASS){
+        int64_t size = static_cast<int64_t>(header->size);
+        if(cache){
+            bump(cache->counters().frees);
+            bump(cache->counters().bytesInUse, -size);
+        } else {
+            std::lock_guard<std::mutex> lock(pool.orphansMutex());
+            bump(pool.orphans().frees);
+            bump(pool.orphans().bytesInUse, -size);
+        }
+        std::free(header);
+        return;
+    }
+
+    std::size_t cls = header->sizeClass;
+    if(cache){
+        cache->release(cls, p);
+    } else {
+        FreeBlock* block = static_cast<FreeBlock*>(p);
+        block->next = nullptr;
+        pool.give(cls, block, block, 1);
+        std::lock_guard<std::mutex> lock(pool.orphansMutex());
+        bump(pool.orphans().frees);
+        bump(pool.orphans().bytesInUse, -static_cast<int64_t>(pool.classes().size(cls)));
+    }
+}
+
+int poolSize(void* p) {
+    return p ? static_cast<int>(headerOf(p)->size) : 0;
+}
+
+void* poolRealloc(void* p, int n) {
+    if(!p){
+        return poolMalloc(n);
+    }
+    if(n <= 0){
+        poolFree(p);
+        return nullptr;
+    }
+    std::size_t current = static_cast<std::size_t>(poolSize(p));
+    std::size_t wanted = static_cast<std::size_t>(n);
+    if(headerOf(p)->sizeClass != LARGE_CLASS && wanted <= current){
+        return p; // Still fits its size class
+    }
+    void* fresh = poolMalloc(n);
+    if(!fresh){
+        return nullptr;
+    }
+    std::memcpy(fresh, p, current < wanted ? current : wanted);
+    poolFree(p);
+    if(ThreadCache* cache = threadCache()){
+        bump(cache->counters().reallocations);
+    }
+    return fresh;
+}
+
+int poolRoundup(int n) {
+    if(n <= 0){
+        return 0;
+    }
+    std::size_t size = static_cast<std::size_t>(n);
+    if(size > MAX_POOLED){
+        return static_cast<int>((size + 15) & ~static_cast<std::size_t>(15));
+    }
+    const SizeClasses& classes = SharedPool::instance().classes();
+    return static_cast<int>(classes.size(classes.classFor(size)));
+}
+
+int poolInit(void*) {
+    SharedPool::instance();
+    return SQLITE_OK;
+}
+
+void poolShutdown(void*) {}
+
+}
+
+const sqlite3_mem_methods* detail::poolMemMethods() {
+    static const sqlite3_mem_methods methods = {
+        poolMalloc,
+        poolFree,
+        poolRealloc,
+        poolSize,
+        poolRoundup,
+        poolInit,
+        poolShutdown,
+        nullptr
+    };
+    return &methods;
+}
+
+AllocatorStats detail::poolAllocatorStats() {
+    return SharedPool::instance().stats();
+}
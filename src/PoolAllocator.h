@@ -0,0 +1,20 @@
+#ifndef SQ3PP_POOLALLOCATOR_H
+#define SQ3PP_POOLALLOCATOR_H
+
+#include <sqlite3.h>
+#include <sq3pp/Config.h>
+
+namespace sq3pp{
+namespace detail{
+
+// sqlite3_mem_methods backed by size-class pools.
+// Small allocations are served from per-thread free lists that refill from
+// (and spill into) shared per-class lists, so threads rarely touch a shared
+// lock. Pooled memory is kept for reuse and not returned to the system.
+const sqlite3_mem_methods* poolMemMethods();
+
+AllocatorStats poolAllocatorStats();
+
+}
+}
+#endif // SQ3PP_POOLALLOCATOR_H
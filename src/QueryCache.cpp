@@ -0,0 +1,200 @@
+#include <sq3pp/QueryCache.h>
+#include <sq3pp/ChangeFeed.h>
+#include <sq3pp/Exception.h>
+#include "ConnectionContext.h"
+#include <algorithm>
+#include <cctype>
+
+using namespace sq3pp;
+
+static std::string lowerCase(const char* str) {
+    std::string out(str ? str : "");
+    std::transform(out.begin(), out.end(), out.begin(), [](unsigned char c){ return static_cast<char>(std::tolower(c)); });
+    return out;
+}
+
+static void appendKey(std::string& key, const CellValue& value) {
+    switch(value.valueType()){
+        case CellValue::Type::INTEGER: {
+            int64_t v = value.valueAs<int64_t>();
+            key += 'i';
+            key.append(reinterpret_cast<const char*>(&v), sizeof(v));
+            break;
+        }
+        case CellValue::Type::DOUBLE: {
+            double v = value.valueAs<double>();
+            key += 'd';
+            key.append(reinterpret_cast<const char*>(&v), sizeof(v));
+            break;
+        }
+        case CellValue::Type::TEXT: {
+            std::string v = value.valueAs<std::string>();
+            uint32_t n = static_cast<uint32_t>(v.size());
+            key += 't';
+            key.append(reinterpret_cast<const char*>(&n), sizeof(n));
+            key += v;
+            break;
+        }
+        case CellValue::Type::BLOB: {
+            std::vector<uint8_t> v = value.valueAs<std::vector<uint8_t>>();
+            uint32_t n = static_cast<uint32_t>(v.size());
+            key += 'b';
+            key.append(reinterpret_cast<const char*>(&n), sizeof(n));
+            key.append(reinterpret_cast<const char*>(v.data()), v.size());
+            break;
+        }
+        case CellValue::Type::NULLTYPE:
+        default:
+            key += 'n';
+            break;
+    }
+}
+
+QueryCache::QueryCache(Database& db, std::size_t maxEntries)
+    : _db(db), _maxEntries(maxEntries), _listenerId(0), _hits(0), _misses(0), _dataVersion(-1), _schemaVersion(-1) {
+    if(!_db.isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot create query cache: database is not open.");
+    }
+    _versionStmt = _db.createStatement("SELECT data_version, schema_version FROM pragma_data_version, pragma_schema_version;");
+    _listenerId = _db.changeFeed().subscribe([this](const ChangeFeed::Batch& batch){
+        std::vector<std::string> tables;
+        for(const ChangeFeed::Event& event : batch){
+            tables.push_back(lowerCase(event.table.c_str()));
+        }
+        onChanges(tables);
+    });
+}
+
+QueryCache::~QueryCache() {
+    if(_db.isOpen()){
+        _db.changeFeed().unsubscribe(_listenerId);
+    }
+}
+
+std::shared_ptr<const QueryCache::Result> QueryCache::query(const std::string& sql, const std::vector<CellValue>& params) {
+    checkExternalChanges();
+
+    std::string key = sql;
+    key += '\0';
+    for(const CellValue& param : params){
+        appendKey(key, param);
+    }
+
+    // Inside a transaction the results may include uncommitted writes, or
+    // miss them: neither served from nor stored into the cache
+    bool cacheable = sqlite3_get_autocommit(_db.getHandle()) != 0;
+    auto found = cacheable ? _index.find(key) : _index.end();
+    if(found != _index.end()){
+        ++_hits;
+        _entries.splice(_entries.begin(), _entries, found->second);
+        return found->second->result;
+    }
+    ++_misses;
+
+    Prepared& prepared = prepare(sql);
+    prepared.stmt.reset();
+    for(std::size_t i = 0; i < params.size(); ++i){
+        prepared.stmt.bind(params[i], static_cast<int>(i));
+    }
+    auto result = std::make_shared<Result>();
+    try{
+        prepared.stmt.execute(result->rows, &result->columns);
+    } catch(...) {
+        prepared.stmt.reset();
+        throw;
+    }
+    prepared.stmt.reset();
+
+    if(!cacheable || !prepared.readOnly || _maxEntries == 0){
+        return result;
+    }
+
+    _entries.push_front(Entry{key, sql, result});
+    _index[key] = _entries.begin();
+    while(_entries.size() > _maxEntries){
+        erase(std::prev(_entries.end()));
+    }
+    return result;
+}
+
+void QueryCache::invalidate(const std::string& table) {
+    onChanges({lowerCase(table.c_str())});
+}
+
+void QueryCache::clear() {
+    _entries.clear();
+    _index.clear();
+}
+
+QueryCache::Prepared& QueryCache::prepare(const std::string& sql) {
+    auto found = _prepared.find(sql);
+    if(found != _prepared.end()){
+        return *found->second;
+    }
+
+    std::unique_ptr<Prepared> prepared(new Prepared{Statement(), {}, false});
+    sqlite3* handle = _db.getHandle();
+    // The connection's authorizer reports the tables the statement reads
+    std::set<std::string> tables;
+    _db._context->readTables = &tables;
+    try{
+        prepared->stmt = _db.createStatement(sql);
+    } catch(...) {
+        _db._context->readTables = nullptr;
+        throw;
+    }
+    _db._context->readTables = nullptr;
+    for(const std::string& table : tables){
+        prepared->tables.insert(lowerCase(table.c_str()));
+    }
+    if(!prepared->stmt.isValid()){
+        throw DatabaseException(static_cast<SQ3>(sqlite3_errcode(handle)), sqlite3_errmsg(handle));
+    }
+    prepared->readOnly = sqlite3_stmt_readonly(prepared->stmt.getHandle()) != 0;
+
+    Prepared& ref = *prepared;
+    _prepared[sql] = std::move(prepared);
+    return ref;
+}
+
+void QueryCache::checkExternalChanges() {
+    int64_t dataVersion = -1;
+    int64_t schemaVersion = -1;
+    _versionStmt.reset();
+    _versionStmt.execute([&](Row& row){
+        dataVersion = row[0].valueAs<int64_t>();
+        schemaVersion = row[1].valueAs<int64_t>();
+    });
+    _versionStmt.reset();
+
+    if(dataVersion != _dataVersion || schemaVersion != _schemaVersion){
+        if(schemaVersion != _schemaVersion){
+            _prepared.clear();
+        }
+        clear();
+        _dataVersion = dataVersion;
+        _schemaVersion = schemaVersion;
+    }
+}
+
+void QueryCache::onChanges(const std::vector<std::string>& tables) {
+    for(auto it = _entries.begin(); it != _entries.end();){
+        auto current = it++;
+        auto prepared = _prepared.find(current->sql);
+        if(prepared == _prepared.end()){
+            erase(current);
+            continue;
+        }
+        for(const std::string& table : tables){
+            if(prepared->second->tables.count(table)){
+                erase(current);
+                break;
+            }
+        }
+    }
+}
+
+void QueryCache::erase(std::list<Entry>::iterator it) {
+    _index.erase(it->key);
+    _entries.erase(it);
+}
@@ -0,0 +1,202 @@
+#include <sq3pp/QueryPlanGuard.h>
+#include <sq3pp/Exception.h>
+#include <sq3pp/Statement.h>
+#include <sq3pp/StatementRegistry.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+using namespace sq3pp;
+
+// Baseline file layout: a "== name" line, then the plan lines of that statement
+static const char* const HEADER = "== ";
+
+QueryPlan QueryPlan::explain(Database& db, const std::string& sql) {
+    if(!db.isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot explain: database is not open.");
+    }
+    Statement stmt = db.createStatement("EXPLAIN QUERY PLAN " + sql);
+    if(!stmt.isValid()){
+        throw DatabaseException(static_cast<SQ3>(sqlite3_errcode(db.getHandle())), sqlite3_errmsg(db.getHandle()));
+    }
+    QueryPlan plan;
+    std::map<int, int> depths;
+    stmt.execute([&plan, &depths](Row& row){
+        Node node;
+        node.id = row[0].valueAs<int>();
+        node.parent = row[1].valueAs<int>();
+        auto parent = depths.find(node.parent);
+        node.depth = parent == depths.end() ? 0 : parent->second + 1;
+        node.detail = row[3].valueAs<std::string>();
+        depths[node.id] = node.depth;
+        plan.nodes.push_back(node);
+    });
+    return plan;
+}
+
+std::string QueryPlan::text() const {
+    std::string out;
+    for(const Node& node : nodes){
+        out.append(static_cast<std::size_t>(node.depth) * 2, ' ');
+        out += node.detail;
+        out += '\n';
+    }
+    return out;
+}
+
+static std::vector<std::string> planLines(const std::string& text) {
+    std::vector<std::string> lines;
+    std::istringstream in(text);
+    std::string line;
+    while(std::getline(in, line)){
+        std::size_t start = line.find_first_not_of(' ');
+        if(start != std::string::npos){
+            lines.push_back(line.substr(start));
+        }
+    }
+    return lines;
+}
+
+// Kind of regression a plan node stands for, false if it is harmless
+static bool classify(const std::string& detail, QueryPlanGuard::Issue& issue) {
+    if(detail.find("AUTOMATIC") != std::string::npos){
+        issue = QueryPlanGuard::Issue::AUTOMATIC_INDEX;
+        return true;
+    }
+    if(detail.find("USE TEMP B-TREE") != std::string::npos){
+        issue = QueryPlanGuard::Issue::TEMP_BTREE;
+        return true;
+    }
+    if(detail.compare(0, 5, "SCAN ") == 0 && detail != "SCAN CONSTANT ROW"){
+        issue = QueryPlanGuard::Issue::FULL_SCAN;
+        return true;
+    }
+    return false;
+}
+
+void QueryPlanGuard::add(const std::string& name, const std::string& sql) {
+    _statements[name] = sql;
+}
+
+void QueryPlanGuard::add(const StatementRegistry& registry) {
+    for(StatementRegistry::Id id = 0; id < registry.size(); ++id){
+        add(registry.name(id), registry.sql(id));
+    }
+}
+
+std::map<std::string, std::string> QueryPlanGuard::capture(Database& db) const {
+    std::map<std::string, std::string> plans;
+    for(const auto& statement : _statements){
+        plans[statement.first] = QueryPlan::explain(db, statement.second).text();
+    }
+    return plans;
+}
+
+void QueryPlanGuard::saveBaseline(Database& db, const std::string& path) const {
+    std::map<std::string, std::string> plans = capture(db);
+    std::ofstream out(path, std::ios::trunc);
+    if(!out){
+        throw DatabaseException(SQ3::CANTOPEN, "Cannot open " + path + ": " + std::strerror(errno));
+    }
+    for(const auto& plan : plans){
+        out << HEADER << plan.first << '\n' << plan.second << '\n';
+    }
+    out.close();
+    if(!out){
+        throw DatabaseException(SQ3::IOERR, "Failed to write " + path);
+    }
+}
+
+QueryPlanGuard::Result QueryPlanGuard::check(Database& db, const std::string& path) const {
+    std::ifstream in(path);
+    if(!in){
+        throw DatabaseException(SQ3::CANTOPEN, "Cannot open " + path + ": " + std::strerror(errno));
+    }
+    std::map<std::string, std::vector<std::string>> baseline;
+    std::vector<std::string>* current = nullptr;
+    std::string line;
+    while(std::getline(in, line)){
+        if(line.compare(0, 3, HEADER) == 0){
+            current = &baseline[line.substr(3)];
+        }else if(current){
+            std::size_t start = line.find_first_not_of(' ');
+            if(start != std::string::npos){
+                current->push_back(line.substr(start));
+            }
+        }
+    }
+
+    Result result;
+    for(const auto& statement : _statements){
+        const std::string& name = statement.first;
+        std::vector<std::string> lines;
+        try{
+            lines = planLines(QueryPlan::explain(db, statement.second).text());
+        } catch(const DatabaseException& e) {
+            result.regressions.push_back(Finding{name, Issue::ERROR, e.what()});
+            continue;
+        }
+        auto expected = baseline.find(name);
+        if(expected == baseline.end()){
+            result.missing.push_back(name);
+            continue;
+        }
+        if(lines == expected->second){
+            continue;
+        }
+        // Nodes not in the baseline (as a multiset, so a second scan counts)
+        std::vector<std::string> remaining = expected->second;
+        bool regressed = false;
+        for(const std::string& detail : lines){
+            auto match = std::find(remaining.begin(), remaining.end(), detail);
+            if(match != remaining.end()){
+                remaining.erase(match);
+                continue;
+            }
+            Issue issue;
+            if(classify(detail, issue)){
+                result.regressions.push_back(Finding{name, issue, detail});
+                regressed = true;
+            }
+        }
+        if(!regressed){
+            result.changed.push_back(name);
+        }
+    }
+    return result;
+}
+
+void QueryPlanGuard::verify(Database& db, const std::string& path) const {
+    Result result = check(db, path);
+    if(!result.ok()){
+        throw DatabaseException(SQ3::ERROR, result.report());
+    }
+}
+
+std::string QueryPlanGuard::Result::report() const {
+    std::string out;
+    if(!regressions.empty()){
+        out += std::to_string(regressions.size()) + " query plan regression(s):\n";
+        for(const Finding& finding : regressions){
+            out += "  " + finding.name + ": " + issueName(finding.issue) + ": " + finding.detail + "\n";
+        }
+    }
+    for(const std::string& name : changed){
+        out += "  " + name + ": plan changed\n";
+    }
+    for(const std::string& name : missing){
+        out += "  " + name + ": no baseline\n";
+    }
+    return out.empty() ? "Query plans match the baseline.\n" : out;
+}
+
+const char* QueryPlanGuard::issueName(Issue issue) {
+    switch(issue){
+        case Issue::FULL_SCAN: return "full scan";
+        case Issue::TEMP_BTREE: return "temp b-tree";
+        case Issue::AUTOMATIC_INDEX: return "automatic index";
+        default: return "error";
+    }
+}
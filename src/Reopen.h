@@ -0,0 +1,50 @@
+#ifndef SQ3PP_REOPEN_H
+#define SQ3PP_REOPEN_H
+
+#include <string>
+#include <sqlite3.h>
+#include <sq3pp/Database.h>
+
+namespace sq3pp{
+namespace detail{
+
+inline std::string uriEscape(const char* text) {
+    static const char hex[] = "0123456789ABCDEF";
+    std::string out;
+    for(const char* p = text; *p; ++p){
+        char c = *p;
+        if(c == '?' || c == '#' || c == '%' || c == '&' || c == '='){
+            out += '%';
+            out += hex[(c >> 4) & 0xF];
+            out += hex[c & 0xF];
+        }else{
+            out += c;
+        }
+    }
+    return out;
+}
+
+// Open target on the main database file of source through the same VFS and
+// with the same URI parameters, for helper connections (maintenance,
+// checkpoints) that must see the file exactly as the application does
+inline int reopen(sqlite3* source, Database& target, int flags) {
+    const char* file = sqlite3_db_filename(source, "main");
+    if(!file || !*file){
+        return SQLITE_MISUSE;
+    }
+    std::string uri = "file:" + uriEscape(file);
+    char separator = '?';
+    const char* key = nullptr;
+    for(int i = 0; (key = sqlite3_uri_key(file, i)) != nullptr; ++i){
+        const char* value = sqlite3_uri_parameter(file, key);
+        uri += separator + uriEscape(key) + "=" + uriEscape(value ? value : "");
+        separator = '&';
+    }
+    sqlite3_vfs* vfs = nullptr;
+    sqlite3_file_control(source, "main", SQLITE_FCNTL_VFS_POINTER, &vfs);
+    return target.open(uri, flags | SQLITE_OPEN_URI, vfs ? vfs->zName : nullptr);
+}
+
+}
+}
+#endif // SQ3PP_REOPEN_H
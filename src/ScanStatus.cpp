@@ -0,0 +1,116 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sq3pp/ScanStatus.h>
+#include <sq3pp/Exception.h>
+#include <cstdio>
+#include <map>
+
+using namespace sq3pp;
+
+std::string ScanStatus::text() const {
+    std::string out;
+    char numbers[160];
+    for(const Loop& loop : loops){
+        out.append(static_cast<std::size_t>(loop.depth) * 2, ' ');
+        out += loop.detail;
+        if(loop.loops >= 0){
+            // Estimates are per loop, visits are totals
+            double perLoop = loop.loops > 0 ? static_cast<double>(loop.rowsVisited) / static_cast<double>(loop.loops) : 0.0;
+            std::snprintf(numbers, sizeof(numbers), "  (loops=%lld rows=%lld rows/loop=%.1f est=%.1f",
+                          static_cast<long long>(loop.loops), static_cast<long long>(loop.rowsVisited),
+                          perLoop, loop.estimatedRows);
+            out += numbers;
+            if(loop.cycles >= 0 && cycles > 0){
+                std::snprintf(numbers, sizeof(numbers), " cycles=%lld %.1f%%", static_cast<long long>(loop.cycles),
+                              100.0 * static_cast<double>(loop.cycles) / static_cast<double>(cycles));
+                out += numbers;
+            }
+            out += ')';
+        }else if(loop.cycles >= 0 && cycles > 0){
+            std::snprintf(numbers, sizeof(numbers), "  (cycles=%lld %.1f%%)", static_cast<long long>(loop.cycles),
+                          100.0 * static_cast<double>(loop.cycles) / static_cast<double>(cycles));
+            out += numbers;
+        }
+        out += '\n';
+    }
+    return out;
+}
+
+#ifdef HAVE_SQLITE3_STMT_SCANSTATUS_V2
+
+ScanStatus ScanStatus::read(sqlite3_stmt* stmt) {
+    if(!stmt){
+        throw DatabaseException(SQ3::MISUSE, "Cannot read scan status: statement is not valid.");
+    }
+    ScanStatus status;
+    status.cycles = -1;
+    sqlite3_int64 total = -1;
+    if(sqlite3_stmt_scanstatus_v2(stmt, -1, SQLITE_SCANSTAT_NCYCLE, SQLITE_SCANSTAT_COMPLEX, &total) == 0){
+        status.cycles = total;
+    }
+
+    // COMPLEX includes sorters, subqueries and the like besides the loops
+    std::map<int, int> depths;
+    for(int index = 0; ; ++index){
+        sqlite3_int64 loops = -1;
+        if(sqlite3_stmt_scanstatus_v2(stmt, index, SQLITE_SCANSTAT_NLOOP, SQLITE_SCANSTAT_COMPLEX, &loops) != 0){
+            break;
+        }
+        Loop loop;
+        loop.loops = loops;
+        sqlite3_int64 visited = -1;
+        double estimate = -1.0;
+        sqlite3_int64 loopCycles = -1;
+        const char* name = nullptr;
+        const char* detail = nullptr;
+        int id = 0;
+        int parent = 0;
+        sqlite3_stmt_scanstatus_v2(stmt, index, SQLITE_SCANSTAT_NVISIT, SQLITE_SCANSTAT_COMPLEX, &visited);
+        sqlite3_stmt_scanstatus_v2(stmt, index, SQLITE_SCANSTAT_EST, SQLITE_SCANSTAT_COMPLEX, &estimate);
+        sqlite3_stmt_scanstatus_v2(stmt, index, SQLITE_SCANSTAT_NCYCLE, SQLITE_SCANSTAT_COMPLEX, &loopCycles);
+        sqlite3_stmt_scanstatus_v2(stmt, index, SQLITE_SCANSTAT_NAME, SQLITE_SCANSTAT_COMPLEX, &name);
+        sqlite3_stmt_scanstatus_v2(stmt, index, SQLITE_SCANSTAT_EXPLAIN, SQLITE_SCANSTAT_COMPLEX, &detail);
+        sqlite3_stmt_scanstatus_v2(stmt, index, SQLITE_SCANSTAT_SELECTID, SQLITE_SCANSTAT_COMPLEX, &id);
+        sqlite3_stmt_scanstatus_v2(stmt, index, SQLITE_SCANSTAT_PARENTID, SQLITE_SCANSTAT_COMPLEX, &parent);
+        loop.rowsVisited = visited;
+        loop.estimatedRows = estimate;
+        loop.cycles = loopCycles;
+        loop.name = name ? name : "";
+        loop.detail = detail ? detail : "";
+        loop.id = id;
+        loop.parent = parent;
+        auto parentDepth = depths.find(parent);
+        loop.depth = parentDepth == depths.end() ? 0 : parentDepth->second + 1;
+        depths[id] = loop.depth;
+        status.loops.push_back(loop);
+    }
+    return status;
+}
+
+void ScanStatus::reset(sqlite3_stmt* stmt) {
+    if(stmt){
+        sqlite3_stmt_scanstatus_reset(stmt);
+    }
+}
+
+bool ScanStatus::isAvailable() {
+    return true;
+}
+
+#else
+
+ScanStatus ScanStatus::read(sqlite3_stmt*) {
+    throw DatabaseException(SQ3::ERROR, "SQLite was built without SQLITE_ENABLE_STMT_SCANSTATUS.");
+}
+
+void ScanStatus::reset(sqlite3_stmt*) {
+    throw DatabaseException(SQ3::ERROR, "SQLite was built without SQLITE_ENABLE_STMT_SCANSTATUS.");
+}
+
+bool ScanStatus::isAvailable() {
+    return false;
+}
+
+#endif
@@ -0,0 +1,239 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_SQLITE3SESSION_CREATE
+// The session API is only declared by sqlite3.h when these are defined
+#define SQLITE_ENABLE_SESSION 1
+#define SQLITE_ENABLE_PREUPDATE_HOOK 1
+#endif
+
+#include <sq3pp/Session.h>
+#include <sq3pp/Exception.h>
+#include <exception>
+#include <istream>
+#include <ostream>
+
+using namespace sq3pp;
+
+#ifdef HAVE_SQLITE3SESSION_CREATE
+
+static void throwOnError(sqlite3* handle, int rc, const std::string& what) {
+    if(rc != SQLITE_OK){
+        const char* errMsg = handle ? sqlite3_errmsg(handle) : nullptr;
+        if(!errMsg || rc != sqlite3_errcode(handle)) errMsg = sqlite3_errstr(rc);
+        throw DatabaseException(static_cast<SQ3>(rc), what + ": " + errMsg);
+    }
+}
+
+static int streamInput(void* data, void* buffer, int* size) {
+    std::istream* in = static_cast<std::istream*>(data);
+    in->read(static_cast<char*>(buffer), *size);
+    *size = static_cast<int>(in->gcount());
+    return in->bad() ? SQLITE_IOERR : SQLITE_OK;
+}
+
+static int streamOutput(void* data, const void* buffer, int size) {
+    std::ostream* out = static_cast<std::ostream*>(data);
+    out->write(static_cast<const char*>(buffer), size);
+    return out->good() ? SQLITE_OK : SQLITE_IOERR;
+}
+
+struct ApplyContext{
+    const Changeset::ConflictHandler* handler;
+    std::exception_ptr error;
+};
+
+static int onConflict(void* data, int conflictType, sqlite3_changeset_iter* iter) {
+    ApplyContext* ctx = static_cast<ApplyContext*>(data);
+    if(!ctx->handler || !*ctx->handler){
+        return SQLITE_CHANGESET_ABORT;
+    }
+
+    Changeset::Conflict conflict;
+    switch(conflictType){
+        case SQLITE_CHANGESET_DATA: conflict.type = Changeset::ConflictType::DATA; break;
+        case SQLITE_CHANGESET_NOTFOUND: conflict.type = Changeset::ConflictType::NOTFOUND; break;
+        case SQLITE_CHANGESET_CONFLICT: conflict.type = Changeset::ConflictType::CONFLICT; break;
+        case SQLITE_CHANGESET_FOREIGN_KEY: conflict.type = Changeset::ConflictType::FOREIGN_KEY; break;
+        case SQLITE_CHANGESET_CONSTRAINT:
+        default: conflict.type = Changeset::ConflictType::CONSTRAINT; break;
+    }
+
+    const char* table = nullptr;
+    int columns = 0;
+    int op = 0;
+    int indirect = 0;
+    sqlite3changeset_op(iter, &table, &columns, &op, &indirect);
+    conflict.table = table ? table : "";
+    conflict.op = op == SQLITE_INSERT ? Changeset::Operation::INSERT
+                : op == SQLITE_DELETE ? Changeset::Operation::DELETE
+                : Changeset::Operation::UPDATE;
+
+    try{
+        switch((*ctx->handler)(conflict)){
+            case Changeset::Resolution::OMIT:
+                return SQLITE_CHANGESET_OMIT;
+            case Changeset::Resolution::REPLACE:
+                if(conflictType == SQLITE_CHANGESET_DATA || conflictType == SQLITE_CHANGESET_CONFLICT){
+                    return SQLITE_CHANGESET_REPLACE;
+                }
+                throw DatabaseException(SQ3::MISUSE, "REPLACE is only valid for DATA and CONFLICT conflicts.");
+            case Changeset::Resolution::ABORT:
+            default:
+                return SQLITE_CHANGESET_ABORT;
+        }
+    } catch(...) {
+        // Never let exceptions unwind through SQLite
+        ctx->error = std::current_exception();
+        return SQLITE_CHANGESET_ABORT;
+    }
+}
+
+Changeset Changeset::invert() const {
+    int size = 0;
+    void* buffer = nullptr;
+    int rc = sqlite3changeset_invert(static_cast<int>(_data.size()), _data.data(), &size, &buffer);
+    throwOnError(nullptr, rc, "Failed to invert changeset");
+    const uint8_t* bytes = static_cast<const uint8_t*>(buffer);
+    Changeset inverted(std::vector<uint8_t>(bytes, bytes + size));
+    sqlite3_free(buffer);
+    return inverted;
+}
+
+void Changeset::apply(Database& db, ConflictHandler handler) const {
+    if(!db.isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot apply changeset: database is not open.");
+    }
+    ApplyContext ctx{&handler, nullptr};
+    int rc = sqlite3changeset_apply(db.getHandle(), static_cast<int>(_data.size()), const_cast<uint8_t*>(_data.data()),
+        nullptr, onConflict, &ctx);
+    if(ctx.error){
+        std::rethrow_exception(ctx.error);
+    }
+    throwOnError(db.getHandle(), rc, "Failed to apply changeset");
+}
+
+void Changeset::invert(std::istream& in, std::ostream& out) {
+    int rc = sqlite3changeset_invert_strm(streamInput, &in, streamOutput, &out);
+    throwOnError(nullptr, rc, "Failed to invert changeset");
+}
+
+void Changeset::apply(Database& db, std::istream& in, ConflictHandler handler) {
+    if(!db.isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot apply changeset: database is not open.");
+    }
+    ApplyContext ctx{&handler, nullptr};
+    int rc = sqlite3changeset_apply_strm(db.getHandle(), streamInput, &in, nullptr, onConflict, &ctx);
+    if(ctx.error){
+        std::rethrow_exception(ctx.error);
+    }
+    throwOnError(db.getHandle(), rc, "Failed to apply changeset");
+}
+
+bool Changeset::isAvailable() {
+    return true;
+}
+
+Session::Session(std::shared_ptr<sqlite3> handle, const std::vector<std::string>& tables)
+    : _handle(handle), _session(nullptr) {
+    int rc = sqlite3session_create(_handle.get(), "main", &_session);
+    throwOnError(_handle.get(), rc, "Failed to create session");
+    try{
+        if(tables.empty()){
+            // NULL attaches every table, including ones created later
+            throwOnError(_handle.get(), sqlite3session_attach(_session, nullptr), "Failed to attach tables");
+        }
+        for(const std::string& table : tables){
+            attach(table);
+        }
+    } catch(...) {
+        sqlite3session_delete(_session);
+        throw;
+    }
+}
+
+Session::~Session() {
+    if(_session){
+        sqlite3session_delete(_session);
+    }
+}
+
+void Session::attach(const std::string& table) {
+    if(!_session){
+        throw DatabaseException(SQ3::MISUSE, "Session is not valid.");
+    }
+    int rc = sqlite3session_attach(_session, table.c_str());
+    throwOnError(_handle.get(), rc, "Failed to attach table " + table);
+}
+
+void Session::enable(bool enabled) {
+    if(_session){
+        sqlite3session_enable(_session, enabled ? 1 : 0);
+    }
+}
+
+bool Session::isEmpty() const {
+    return !_session || sqlite3session_isempty(_session);
+}
+
+Changeset Session::changeset() const {
+    if(!_session){
+        throw DatabaseException(SQ3::MISUSE, "Session is not valid.");
+    }
+    int size = 0;
+    void* buffer = nullptr;
+    int rc = sqlite3session_changeset(_session, &size, &buffer);
+    throwOnError(_handle.get(), rc, "Failed to generate changeset");
+    const uint8_t* bytes = static_cast<const uint8_t*>(buffer);
+    Changeset result(std::vector<uint8_t>(bytes, bytes + size));
+    sqlite3_free(buffer);
+    return result;
+}
+
+void Session::changeset(std::ostream& out) const {
+    if(!_session){
+        throw DatabaseException(SQ3::MISUSE, "Session is not valid.");
+    }
+    int rc = sqlite3session_changeset_strm(_session, streamOutput, &out);
+    throwOnError(_handle.get(), rc, "Failed to generate changeset");
+}
+
+#else // HAVE_SQLITE3SESSION_CREATE
+
+static void notAvailable() {
+    throw DatabaseException(SQ3::ERROR, "SQLite was built without the session extension (SQLITE_ENABLE_SESSION).");
+}
+
+Changeset Changeset::invert() const { notAvailable(); return Changeset(); }
+void Changeset::apply(Database&, ConflictHandler) const { notAvailable(); }
+void Changeset::invert(std::istream&, std::ostream&) { notAvailable(); }
+void Changeset::apply(Database&, std::istream&, ConflictHandler) { notAvailable(); }
+bool Changeset::isAvailable() { return false; }
+
+Session::Session(std::shared_ptr<sqlite3> handle, const std::vector<std::string>&)
+    : _handle(handle), _session(nullptr) {
+    notAvailable();
+}
+Session::~Session() {}
+void Session::attach(const std::string&) { notAvailable(); }
+void Session::enable(bool) { notAvailable(); }
+bool Session::isEmpty() const { return true; }
+Changeset Session::changeset() const { notAvailable(); return Changeset(); }
+void Session::changeset(std::ostream&) const { notAvailable(); }
+
+#endif // HAVE_SQLITE3SESSION_CREATE
+
+Session::Session(Session&& other) noexcept : _handle(std::move(other._handle)), _session(other._session) {
+    other._session = nullptr;
+}
+
+Session& Session::operator=(Session&& other) noexcept {
+    if(this != &other){
+        Session tmp(std::move(*this));
+        _handle = std::move(other._handle);
+        _session = other._session;
+        other._session = nullptr;
+    }
+    return *this;
+}
@@ -0,0 +1,254 @@
+#include <sq3pp/ShardedDatabase.h>
+#include <sq3pp/Transaction.h>
+#include <sq3pp/Exception.h>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <queue>
+
+using namespace sq3pp;
+
+ShardedDatabase::ShardedDatabase(const std::vector<std::string>& files, KeyHash hash, std::size_t threads)
+    : _hash(hash ? std::move(hash) : KeyHash(&ShardedDatabase::defaultHash)),
+      _pool(threads > 0 ? threads : files.size()) {
+    if(files.empty()){
+        throw DatabaseException(SQ3::MISUSE, "A sharded database needs at least one shard.");
+    }
+    _shards.reserve(files.size());
+    for(const std::string& file : files){
+        std::unique_ptr<Shard> shard(new Shard());
+        int rc = shard->db.open(file);
+        if(rc != SQLITE_OK){
+            throw DatabaseException(static_cast<SQ3>(rc), "Cannot open shard " + file + ": " + sqlite3_errstr(rc));
+        }
+        _shards.push_back(std::move(shard));
+    }
+}
+
+ShardedDatabase::~ShardedDatabase() = default;
+
+std::size_t ShardedDatabase::shardFor(const CellValue& key) const {
+    return _hash(key) % _shards.size();
+}
+
+static void fnv1a(uint64_t& hash, const unsigned char* data, std::size_t n) {
+    for(std::size_t i = 0; i < n; ++i){
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+}
+
+static void fnv1a(uint64_t& hash, int64_t integer) {
+    uint64_t value = static_cast<uint64_t>(integer);
+    unsigned char bytes[8];
+    for(int i = 0; i < 8; ++i){
+        bytes[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+    fnv1a(hash, bytes, sizeof(bytes));
+}
+
+std::size_t ShardedDatabase::defaultHash(const CellValue& key) {
+    // Independent of std::hash so rows stay on the same shard across builds
+    uint64_t hash = 14695981039346656037ULL;
+    switch(key.valueType()){
+        case CellValue::Type::INTEGER:
+            fnv1a(hash, key.valueAs<int64_t>());
+            break;
+        case CellValue::Type::DOUBLE: {
+            double value = key.valueAs<double>();
+            // SQLite compares 5.0 equal to 5, so both must land on one shard
+            if(value >= -9223372036854775808.0 && value < 9223372036854775808.0 && std::trunc(value) == value){
+                fnv1a(hash, static_cast<int64_t>(value));
+            }else{
+                fnv1a(hash, reinterpret_cast<const unsigned char*>(&value), sizeof(value));
+            }
+            break;
+        }
+        case CellValue::Type::TEXT: {
+            std::string text = key.valueAs<std::string>();
+            fnv1a(hash, reinterpret_cast<const unsigned char*>(text.data()), text.size());
+            break;
+        }
+        case CellValue::Type::BLOB: {
+            std::vector<uint8_t> blob = key.valueAs<std::vector<uint8_t>>();
+            fnv1a(hash, blob.data(), blob.size());
+            break;
+        }
+        case CellValue::Type::NULLTYPE:
+        default:
+            break;
+    }
+    return static_cast<std::size_t>(hash);
+}
+
+int ShardedDatabase::execute(const CellValue& key, const std::string& sql, const std::vector<CellValue>& params) {
+    Shard& shard = *_shards[shardFor(key)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Statement stmt = shard.db.createStatement(sql);
+    for(std::size_t i = 0; i < params.size(); ++i){
+        stmt.bind(params[i], static_cast<int>(i));
+    }
+    return stmt.execute();
+}
+
+void ShardedDatabase::write(const CellValue& key, const std::function<void(Database& db)>& work) {
+    Shard& shard = *_shards[shardFor(key)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Transaction transaction = shard.db.beginTransaction();
+    work(shard.db);
+    transaction.commit();
+}
+
+void ShardedDatabase::executeAll(const std::string& sql) {
+    std::vector<std::future<void>> pending;
+    pending.reserve(_shards.size());
+    for(std::unique_ptr<Shard>& shard : _shards){
+        Shard* target = shard.get();
+        pending.push_back(_pool.submit([target, &sql](){
+            std::lock_guard<std::mutex> lock(target->mutex);
+            target->db.execute(sql);
+        }));
+    }
+    // Let every shard finish before reporting the first failure
+    for(std::future<void>& result : pending){
+        result.wait();
+    }
+    for(std::future<void>& result : pending){
+        result.get();
+    }
+}
+
+std::vector<ShardedDatabase::Result> ShardedDatabase::fanOut(const std::string& sql, const std::vector<CellValue>& params) {
+    std::vector<std::future<Result>> pending;
+    pending.reserve(_shards.size());
+    for(std::unique_ptr<Shard>& shard : _shards){
+        Shard* target = shard.get();
+        pending.push_back(_pool.submit([target, &sql, &params](){
+            Result result;
+            std::lock_guard<std::mutex> lock(target->mutex);
+            Statement stmt = target->db.createStatement(sql);
+            for(std::size_t i = 0; i < params.size(); ++i){
+                stmt.bind(params[i], static_cast<int>(i));
+            }
+            stmt.execute(result.rows, &result.columns);
+            return result;
+        }));
+    }
+    for(std::future<Result>& result : pending){
+        result.wait();
+    }
+    std::vector<Result> results;
+    results.reserve(pending.size());
+    for(std::future<Result>& result : pending){
+        results.push_back(result.get());
+    }
+    return results;
+}
+
+ShardedDatabase::Result ShardedDatabase::query(const std::string& sql, const std::vector<CellValue>& params) {
+    std::vector<Result> parts = fanOut(sql, params);
+    Result merged;
+    std::size_t total = 0;
+    for(const Result& part : parts){
+        total += part.rows.size();
+    }
+    merged.rows.reserve(total);
+    for(Result& part : parts){
+        if(merged.columns.empty()){
+            merged.columns = std::move(part.columns);
+        }
+        for(std::vector<CellValue>& row : part.rows){
+            merged.rows.push_back(std::move(row));
+        }
+    }
+    return merged;
+}
+
+ShardedDatabase::Result ShardedDatabase::queryOrdered(const std::string& sql, int column, bool descending,
+                                                      const std::vector<CellValue>& params) {
+    std::vector<Result> parts = fanOut(sql, params);
+    Result merged;
+    std::size_t total = 0;
+    for(Result& part : parts){
+        total += part.rows.size();
+        if(merged.columns.empty()){
+            merged.columns = part.columns;
+        }
+    }
+    if(column < 0 || (!merged.columns.empty() && column >= static_cast<int>(merged.columns.size()))){
+        throw DatabaseException(SQ3::RANGE, "Merge column " + std::to_string(column) + " is out of range.");
+    }
+    merged.rows.reserve(total);
+
+    // K-way merge: the heap holds the next unmerged row of each shard
+    struct Cursor{
+        std::size_t shard;
+        std::size_t row;
+    };
+    auto after = [&parts, column, descending](const Cursor& a, const Cursor& b) {
+        int c = parts[a.shard].rows[a.row][column].compare(parts[b.shard].rows[b.row][column]);
+        if(c == 0){
+            return a.shard > b.shard;
+        }
+        return descending ? c < 0 : c > 0;
+    };
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(after)> heap(after);
+    for(std::size_t i = 0; i < parts.size(); ++i){
+        if(!parts[i].rows.empty()){
+            heap.push(Cursor{i, 0});
+        }
+    }
+    while(!heap.empty()){
+        Cursor next = heap.top();
+        heap.pop();
+        merged.rows.push_back(std::move(parts[next.shard].rows[next.row]));
+        if(next.row + 1 < parts[next.shard].rows.size()){
+            heap.push(Cursor{next.shard, next.row + 1});
+        }
+    }
+    return merged;
+}
+
+ShardedDatabase::Result ShardedDatabase::queryReduced(const std::string& sql, const Reducer& reducer,
+                                                      const std::vector<CellValue>& params) {
+    std::vector<Result> parts = fanOut(sql, params);
+    Result reduced;
+    bool first = true;
+    std::vector<CellValue> accumulator;
+    for(Result& part : parts){
+        if(reduced.columns.empty()){
+            reduced.columns = std::move(part.columns);
+        }
+        for(std::vector<CellValue>& row : part.rows){
+            if(first){
+                accumulator = std::move(row);
+                first = false;
+            }else{
+                reducer(accumulator, row);
+            }
+        }
+    }
+    if(!first){
+        reduced.rows.push_back(std::move(accumulator));
+    }
+    return reduced;
+}
+
+ShardedDatabase::Reducer ShardedDatabase::sum() {
+    return [](std::vector<CellValue>& accumulator, const std::vector<CellValue>& row) {
+        for(std::size_t i = 0; i < accumulator.size() && i < row.size(); ++i){
+            const CellValue& value = row[i];
+            CellValue& total = accumulator[i];
+            if(value.isNull()){
+                continue;
+            }
+            if(total.isNull()){
+                total = value;
+            }else if(total.isInteger() && value.isInteger()){
+                total = CellValue(total.valueAs<int64_t>() + value.valueAs<int64_t>());
+            }else if((total.isInteger() || total.isDouble()) && (value.isInteger() || value.isDouble())){
+                total = CellValue(total.valueAs<double>() + value.valueAs<double>());
+            }
+        }
+    };
+}
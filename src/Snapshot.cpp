@@ -0,0 +1,74 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sq3pp/Snapshot.h>
+#include <sq3pp/Exception.h>
+
+using namespace sq3pp;
+
+#ifdef HAVE_SQLITE3_SNAPSHOT_GET
+
+static void throwOnError(sqlite3* handle, int rc, const std::string& what) {
+    if(rc != SQLITE_OK){
+        const char* errMsg = sqlite3_errmsg(handle);
+        if(!errMsg || rc != sqlite3_errcode(handle)) errMsg = sqlite3_errstr(rc);
+        throw DatabaseException(static_cast<SQ3>(rc), what + ": " + errMsg);
+    }
+}
+
+Snapshot::Snapshot(std::shared_ptr<sqlite3> handle, const std::string& schema) : _schema(schema) {
+    sqlite3* db = handle.get();
+    // sqlite3_snapshot_get needs a transaction; open a short one if none is active
+    bool ownTransaction = sqlite3_get_autocommit(db) != 0;
+    if(ownTransaction){
+        throwOnError(db, sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr), "Cannot take snapshot");
+    }
+    sqlite3_snapshot* snapshot = nullptr;
+    int rc = sqlite3_snapshot_get(db, _schema.c_str(), &snapshot);
+    if(ownTransaction){
+        sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+    }
+    throwOnError(db, rc, "Cannot take snapshot (the database must be in WAL mode)");
+    _snapshot = std::shared_ptr<sqlite3_snapshot>(snapshot, sqlite3_snapshot_free);
+}
+
+int Snapshot::compare(const Snapshot& other) const {
+    if(!isValid() || !other.isValid()){
+        throw DatabaseException(SQ3::MISUSE, "Cannot compare an empty snapshot.");
+    }
+    return sqlite3_snapshot_cmp(_snapshot.get(), other._snapshot.get());
+}
+
+bool Snapshot::isAvailable() {
+    return true;
+}
+
+void Snapshot::openOn(sqlite3* handle) const {
+    if(!isValid()){
+        throw DatabaseException(SQ3::MISUSE, "Cannot open an empty snapshot.");
+    }
+    throwOnError(handle, sqlite3_snapshot_open(handle, _schema.c_str(), _snapshot.get()), "Cannot open snapshot");
+}
+
+#else
+
+static const char* NOT_AVAILABLE = "SQLite was built without SQLITE_ENABLE_SNAPSHOT.";
+
+Snapshot::Snapshot(std::shared_ptr<sqlite3>, const std::string& schema) : _schema(schema) {
+    throw DatabaseException(SQ3::ERROR, NOT_AVAILABLE);
+}
+
+int Snapshot::compare(const Snapshot&) const {
+    throw DatabaseException(SQ3::ERROR, NOT_AVAILABLE);
+}
+
+bool Snapshot::isAvailable() {
+    return false;
+}
+
+void Snapshot::openOn(sqlite3*) const {
+    throw DatabaseException(SQ3::ERROR, NOT_AVAILABLE);
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef SQ3PP_SQLTEXT_H
+#define SQ3PP_SQLTEXT_H
+
+#include <string>
+
+namespace sq3pp{
+namespace detail{
+
+// Quote a table or column name for use in generated SQL
+inline std::string quoteIdentifier(const std::string& name) {
+    std::string out = "\"";
+    for(char c : name){
+        if(c == '"') out += '"';
+        out += c;
+    }
+    out += '"';
+    return out;
+}
+
+// Quote a value as an SQL string literal
+inline std::string quoteString(const std::string& value) {
+    std::string out = "'";
+    for(char c : value){
+        if(c == '\'') out += '\'';
+        out += c;
+    }
+    out += '\'';
+    return out;
+}
+
+}
+}
+#endif // SQ3PP_SQLTEXT_H
@@ -1,5 +1,8 @@
 #include <sq3pp/Statement.h>
 #include <sq3pp/Exception.h>
+#include <sq3pp/Binding.h>
+#include "ConnectionContext.h"
+#include <algorithm>
 #include <cstring>
 using namespace sq3pp;
 
@@ -219,6 +222,56 @@ std::vector<uint8_t> CellValue::valueAs<std::vector<uint8_t>>() const {
     return {};
 }
 
+int CellValue::size() const {
+    if(_type == Type::BLOB){
+        return _blobValue.size;
+    } else if(_type == Type::TEXT){
+        return static_cast<int>(std::strlen(_strValue));
+    }
+    return 0;
+}
+
+static int storageRank(CellValue::Type type) {
+    switch(type){
+        case CellValue::Type::NULLTYPE: return 0;
+        case CellValue::Type::INTEGER:
+        case CellValue::Type::DOUBLE: return 1;
+        case CellValue::Type::TEXT: return 2;
+        case CellValue::Type::BLOB:
+        default: return 3;
+    }
+}
+
+int CellValue::compare(const CellValue& other) const {
+    int rank = storageRank(_type);
+    int otherRank = storageRank(other._type);
+    if(rank != otherRank){
+        return rank < otherRank ? -1 : 1;
+    }
+    switch(rank){
+        case 0:
+            return 0;
+        case 1: {
+            if(_type == Type::INTEGER && other._type == Type::INTEGER){
+                return _i64Value < other._i64Value ? -1 : (_i64Value > other._i64Value ? 1 : 0);
+            }
+            double a = _type == Type::INTEGER ? static_cast<double>(_i64Value) : _dValue;
+            double b = other._type == Type::INTEGER ? static_cast<double>(other._i64Value) : other._dValue;
+            return a < b ? -1 : (a > b ? 1 : 0);
+        }
+        case 2:
+            return std::strcmp(_strValue, other._strValue);
+        default: {
+            int n = std::min(_blobValue.size, other._blobValue.size);
+            int c = n > 0 ? std::memcmp(_blobValue.data, other._blobValue.data, n) : 0;
+            if(c != 0){
+                return c;
+            }
+            return _blobValue.size - other._blobValue.size;
+        }
+    }
+}
+
 std::ostream& operator<<(std::ostream& os, const CellValue& cellValue){
     switch(cellValue.valueType()){
         case CellValue::Type::INTEGER:
@@ -230,11 +283,9 @@ std::ostream& operator<<(std::ostream& os, const CellValue& cellValue){
         case CellValue::Type::TEXT:
             os << cellValue.valueAs<std::string>();
             break;
-        case CellValue::Type::BLOB: {
-            std::vector<uint8_t> blobData = cellValue.valueAs<std::vector<uint8_t>>();
-            os << "BLOB(" << blobData.size() << " bytes)";
+        case CellValue::Type::BLOB:
+            os << "BLOB(" << cellValue.size() << " bytes)";
             break;
-        }
         case CellValue::Type::NULLTYPE:
             os << "NULL";
             break;
@@ -303,23 +354,67 @@ Statement::Binder& Statement::Binder::operator=(const std::vector<uint8_t>& blob
 }
 
 
-Statement::Statement(std::shared_ptr<sqlite3> handle, const std::string& query) : 
-    _stmt(nullptr), _query(query), _bindIndex(1), _rowIndex(0), _currentRow(0, nullptr) {
+Statement::Statement(std::shared_ptr<sqlite3> handle, std::shared_ptr<detail::ConnectionContext> context, const std::string& query,
+                     unsigned int prepareFlags) : 
+    _context(context), _stmt(nullptr), _query(query), _bindIndex(1), _rowIndex(0), _changes(0), _timeout(0), _currentRow(0, nullptr) {
     if (handle) {
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(handle.get(), query.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        if (sqlite3_prepare_v3(handle.get(), query.c_str(), -1, prepareFlags, &stmt, nullptr) != SQLITE_OK) {
             return;
         }
         _stmt = std::shared_ptr<sqlite3_stmt>(stmt, sqlite3_finalize);
+        indexParameterNames();
+    }
+}
+
+// SQLite keeps the prefix in parameter names; lookups by bare name used to
+// try ':', '@' and '$' in that order, so that order decides between duplicates
+static int prefixRank(char prefix) {
+    switch(prefix){
+        case ':': return 0;
+        case '@': return 1;
+        case '$': return 2;
+        default: return -1;
     }
 }
 
+void Statement::indexParameterNames() {
+    _paramNames.clear();
+    std::vector<int> ranks;
+    int count = sqlite3_bind_parameter_count(_stmt.get());
+    for(int i = 1; i <= count; ++i){
+        const char* name = sqlite3_bind_parameter_name(_stmt.get(), i);
+        int rank = name ? prefixRank(name[0]) : -1;
+        if(rank < 0){
+            continue; // Anonymous ? or numbered ?NNN parameter
+        }
+        std::string bare(name + 1);
+        bool duplicate = false;
+        for(std::size_t n = 0; n < _paramNames.size(); ++n){
+            if(_paramNames[n].first == bare){
+                duplicate = true;
+                if(rank < ranks[n]){
+                    _paramNames[n].second = i - 1;
+                    ranks[n] = rank;
+                }
+                break;
+            }
+        }
+        if(!duplicate){
+            _paramNames.emplace_back(std::move(bare), i - 1);
+            ranks.push_back(rank);
+        }
+    }
+    std::sort(_paramNames.begin(), _paramNames.end());
+}
+
 Statement::Statement() : 
-    _stmt(nullptr), _query(""), _bindIndex(1), _rowIndex(0), _currentRow(0, nullptr) {}
+    _context(nullptr), _stmt(nullptr), _query(""), _bindIndex(1), _rowIndex(0), _changes(0), _timeout(0), _currentRow(0, nullptr) {}
 
 Statement::Statement(Statement&& other) noexcept : 
-    _stmt(std::move(other._stmt)), _query(std::move(other._query)), _bindIndex(other._bindIndex), 
-    _rowIndex(other._rowIndex), _currentRow(std::move(other._currentRow)) {
+    _context(std::move(other._context)), _stmt(std::move(other._stmt)), _query(std::move(other._query)), _bindIndex(other._bindIndex), 
+    _rowIndex(other._rowIndex), _changes(other._changes), _timeout(other._timeout), _deadline(other._deadline), _currentRow(std::move(other._currentRow)),
+    _paramNames(std::move(other._paramNames)) {
     other._bindIndex = 1;
     other._rowIndex = 0;
 }
@@ -327,10 +422,15 @@ Statement::Statement(Statement&& other) noexcept :
 Statement& Statement::operator=(Statement&& other) noexcept {
     if (this != &other) {
         _stmt = std::move(other._stmt);
+        _context = std::move(other._context);
         _query = std::move(other._query);
         _bindIndex = other._bindIndex;
         _rowIndex = other._rowIndex;
+        _changes = other._changes;
+        _timeout = other._timeout;
+        _deadline = other._deadline;
         _currentRow = std::move(other._currentRow);
+        _paramNames = std::move(other._paramNames);
         other._bindIndex = 1;
         other._rowIndex = 0;
         other._currentRow = Row(0, nullptr);
@@ -358,6 +458,7 @@ void Statement::finalize() {
     if (isValid()) {
         _stmt.reset();
     }
+    _paramNames.clear();
 }
 
 Statement& Statement::bind(const std::string& value, int index) {
@@ -518,87 +619,90 @@ Statement& Statement::bind(const CellValue& cellValue, int index) {
     }
 }
 
-Statement& Statement::bindById(const std::string& id, const std::string& value) {
+Statement& Statement::bindById(std::string_view id, const std::string& value) {
     int index = getIndexForId(id);
     if(index < 0){
-        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + id);
+        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + std::string(id));
     }
     return bind(value, index);
 }
-Statement& Statement::bindById(const std::string& id, const char* value) {
+Statement& Statement::bindById(std::string_view id, const char* value) {
     int index = getIndexForId(id);
     if(index < 0){
-        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + id);
+        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + std::string(id));
     }
     return bind(value, index);
 }
-Statement& Statement::bindById(const std::string& id, std::nullptr_t) {
+Statement& Statement::bindById(std::string_view id, std::nullptr_t) {
     int index = getIndexForId(id);
     if(index < 0) {
-        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + id);
+        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + std::string(id));
     }
     return bind(nullptr, index);
 }
-Statement& Statement::bindById(const std::string& id, int value) {
+Statement& Statement::bindById(std::string_view id, int value) {
     int index = getIndexForId(id);
     if(index < 0) {
-        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + id);
+        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + std::string(id));
     }
     return bind(value, index);
 }
-Statement& Statement::bindById(const std::string& id, int64_t value) {
+Statement& Statement::bindById(std::string_view id, int64_t value) {
     int index = getIndexForId(id);
     if(index < 0) {
-        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + id);
+        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + std::string(id));
     }
     return bind(value, index);
 }
-Statement& Statement::bindById(const std::string& id, double value) {
+Statement& Statement::bindById(std::string_view id, double value) {
     int index = getIndexForId(id);
     if(index < 0) {
-        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + id);
+        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + std::string(id));
     }
     return bind(value, index);
 }
-Statement& Statement::bindById(const std::string& id, void* blob_value, int n) {
+Statement& Statement::bindById(std::string_view id, void* blob_value, int n) {
     int index = getIndexForId(id);
     if(index < 0) {
-        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + id);
+        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + std::string(id));
     }
     return bind(blob_value, n, index);
 }
-Statement& Statement::bindById(const std::string& id, const std::vector<uint8_t>& blob_value) {
+Statement& Statement::bindById(std::string_view id, const std::vector<uint8_t>& blob_value) {
     int index = getIndexForId(id);
     if(index < 0) {
-        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + id);
+        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + std::string(id));
     }
     return bind(blob_value, index);
 }
 
-Statement& Statement::bindById(const std::string& id, const CellValue& cellValue) {
+Statement& Statement::bindById(std::string_view id, const CellValue& cellValue) {
     int index = getIndexForId(id);
     if(index < 0) {
-        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + id);
+        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + std::string(id));
     }
     return bind(cellValue, index);
 }
 
-int Statement::getIndexForId(const std::string& id) {
-    if(!isValid()){
-        return -1;
-    }
-    // Try all SQLite parameter prefixes: :, @, $
-    const char* prefixes[] = {":", "@", "$"};
-    for(const char* prefix : prefixes) {
-        std::string paramName = std::string(prefix) + id;
-        int index = sqlite3_bind_parameter_index(_stmt.get(), paramName.c_str());
-        if(index > 0) {
-            return index - 1; // Convert to 0-based index
-        }
+int Statement::getIndexForId(std::string_view id) const {
+    auto it = std::lower_bound(_paramNames.begin(), _paramNames.end(), id,
+        [](const std::pair<std::string, int>& entry, std::string_view name){
+            return std::string_view(entry.first) < name;
+        });
+    if(it != _paramNames.end() && it->first == id){
+        return it->second;
     }
     return -1;
 }
 
+ParamHandle Statement::param(std::string_view id) const {
+    int index = getIndexForId(id);
+    if(index < 0){
+        throw DatabaseException(SQ3::MISUSE, "Parameter name not found: " + std::string(id));
+    }
+    return ParamHandle(index);
+}
+
 void Statement::resetBindIndex(int index) {
     if(index >= 0){
         _bindIndex = index + 1; // SQLite parameters are 1-based
@@ -612,17 +716,84 @@ SQ3 Statement::step(std::function<void(Row& row)> onRowFound) {
     if (!isValid()) {
         return SQ3::MISUSE;
     }
-    int rc = sqlite3_step(_stmt.get());
+    if(_rowIndex == 0){
+        _deadline = _timeout.count() > 0 ? std::chrono::steady_clock::now() + _timeout : std::chrono::steady_clock::time_point::max();
+    }
+    int rc = SQLITE_OK;
+    {
+        detail::DeadlineScope scope(_context.get(), _deadline);
+        rc = sqlite3_step(_stmt.get());
+    }
     if(rc == SQLITE_ROW){
         _currentRow = Row(_rowIndex, _stmt);
         if(onRowFound){
             onRowFound(_currentRow);
         }
         ++_rowIndex;
+    } else if(rc == SQLITE_DONE && _context){
+        _context->afterStep();
+    } else if(rc != SQLITE_DONE && _context){
+        return _context->errorCode(rc);
     }
     return static_cast<SQ3>(rc);
 }
 
+ScanStatus Statement::scanStatus() const {
+    return ScanStatus::read(_stmt.get());
+}
+
+void Statement::resetScanStatus() {
+    ScanStatus::reset(_stmt.get());
+}
+
+ScanStatus Statement::explainAnalyze() {
+    if(!isValid()){
+        throw DatabaseException(SQ3::MISUSE, "Cannot analyze statement: statement is not valid.");
+    }
+    reset(false);
+    resetScanStatus();
+    try{
+        while(stepRow()){}
+    } catch(...) {
+        reset(false);
+        throw;
+    }
+    ScanStatus status = scanStatus();
+    reset(false);
+    return status;
+}
+
+bool Statement::stepRow() {
+    if (!isValid()) {
+        throw DatabaseException(SQ3::MISUSE, "Cannot step statement: statement is not valid.");
+    }
+    if(_rowIndex == 0){
+        _deadline = _timeout.count() > 0 ? std::chrono::steady_clock::now() + _timeout : std::chrono::steady_clock::time_point::max();
+    }
+    int rc = SQLITE_OK;
+    {
+        detail::DeadlineScope scope(_context.get(), _deadline);
+        rc = sqlite3_step(_stmt.get());
+    }
+    if(rc == SQLITE_ROW){
+        ++_rowIndex;
+        return true;
+    }
+    if(rc == SQLITE_DONE){
+        // Read the count before change listeners get a chance to run statements
+        _changes = sqlite3_changes(sqlite3_db_handle(_stmt.get()));
+        if(_context){
+            _context->afterStep();
+        }
+        return false;
+    }
+    const char* errMsg = sqlite3_errmsg(sqlite3_db_handle(_stmt.get()));
+    if(!errMsg) errMsg = sqlite3_errstr(rc);
+    SQ3 code = _context ? _context->errorCode(rc) : static_cast<SQ3>(rc);
+    if(code == SQ3::TIMEOUT) errMsg = "Statement deadline exceeded";
+    throw DatabaseException(code, errMsg);
+}
+
 int Statement::execute() {
     return execute(nullptr);
 }
@@ -634,6 +805,8 @@ int Statement::execute(std::function<void(Row& row)> onRowFound){
     }
     int rc = SQLITE_OK;
     bool isSelect = false;
+    _deadline = _timeout.count() > 0 ? std::chrono::steady_clock::now() + _timeout : std::chrono::steady_clock::time_point::max();
+    detail::DeadlineScope scope(_context.get(), _deadline);
     do{
         rc = sqlite3_step(_stmt.get());
         if(rc == SQLITE_ROW){
@@ -649,13 +822,16 @@ int Statement::execute(std::function<void(Row& row)> onRowFound){
     if(rc != SQLITE_DONE){
         const char* errMsg = sqlite3_errmsg(sqlite3_db_handle(_stmt.get()));
         if(!errMsg) errMsg = sqlite3_errstr(rc);
-        throw DatabaseException(static_cast<SQ3>(rc), errMsg);
+        SQ3 code = _context ? _context->errorCode(rc) : static_cast<SQ3>(rc);
+        if(code == SQ3::TIMEOUT) errMsg = "Statement deadline exceeded";
+        throw DatabaseException(code, errMsg);
     }
-
-    if(isSelect){
-        return _rowIndex; // Number of rows retrieved
+    // Read the count before change listeners get a chance to run statements
+    int result = isSelect ? _rowIndex : sqlite3_changes(sqlite3_db_handle(_stmt.get()));
+    if(_context){
+        _context->afterStep();
     }
-    return sqlite3_changes(sqlite3_db_handle(_stmt.get()));
+    return result; // Number of rows retrieved or affected
 }
 int Statement::execute(std::vector<std::vector<CellValue>>& outRows, std::vector<std::string>* outColumnNames){
     if(!isValid()) {
@@ -856,6 +1032,13 @@ CellValue Row::Cell::valueAs<CellValue>(bool autoConvert) const {
 }
 
 
+int Row::Cell::size() const {
+    if(_parent && _column >= 0){
+        return sqlite3_column_bytes(_parent->_stmt.get(), _column);
+    }
+    return 0;
+}
+
 const char* Row::Cell::columnName() const {
     if(_parent && _column >=0){
         const char* colName = sqlite3_column_name(_parent->_stmt.get(), _column);
@@ -949,11 +1132,9 @@ std::ostream& operator<<(std::ostream& os, const sq3pp::Row::Cell& cell){
             case SQLITE_TEXT:
                 os << cell.valueAs<const char*>();
                 break;
-            case SQLITE_BLOB: {
-                std::vector<uint8_t> blobData = cell.valueAs<std::vector<uint8_t>>();
-                os << "BLOB(" << blobData.size() << " bytes)";
+            case SQLITE_BLOB:
+                os << "BLOB(" << cell.size() << " bytes)";
                 break;
-            }
             case SQLITE_NULL:
             default:
                 os << "NULL";
@@ -961,4 +1142,45 @@ std::ostream& operator<<(std::ostream& os, const sq3pp::Row::Cell& cell){
         }
     }
     return os;
-}
\ No newline at end of file
+}
+
+
+int detail::bindCell(sqlite3_stmt* stmt, int index, const CellValue& value) {
+    switch(value.valueType()){
+        case CellValue::Type::INTEGER:
+            return sqlite3_bind_int64(stmt, index, value.valueAs<int64_t>());
+        case CellValue::Type::DOUBLE:
+            return sqlite3_bind_double(stmt, index, value.valueAs<double>());
+        case CellValue::Type::TEXT: {
+            std::string text = value.valueAs<std::string>();
+            return sqlite3_bind_text(stmt, index, text.data(), static_cast<int>(text.size()), SQLITE_TRANSIENT);
+        }
+        case CellValue::Type::BLOB: {
+            std::vector<uint8_t> blob = value.valueAs<std::vector<uint8_t>>();
+            return sqlite3_bind_blob(stmt, index, blob.data(), static_cast<int>(blob.size()), SQLITE_TRANSIENT);
+        }
+        case CellValue::Type::NULLTYPE:
+        default:
+            return sqlite3_bind_null(stmt, index);
+    }
+}
+
+CellValue detail::columnCell(sqlite3_stmt* stmt, int column) {
+    switch(sqlite3_column_type(stmt, column)){
+        case SQLITE_INTEGER:
+            return CellValue(static_cast<int64_t>(sqlite3_column_int64(stmt, column)));
+        case SQLITE_FLOAT:
+            return CellValue(sqlite3_column_double(stmt, column));
+        case SQLITE_TEXT: {
+            const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, column));
+            return CellValue(text ? text : "");
+        }
+        case SQLITE_BLOB: {
+            const void* data = sqlite3_column_blob(stmt, column);
+            return CellValue(const_cast<void*>(data), sqlite3_column_bytes(stmt, column));
+        }
+        case SQLITE_NULL:
+        default:
+            return CellValue();
+    }
+}
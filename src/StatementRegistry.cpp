@@ -0,0 +1,148 @@
+#include <sq3pp/StatementRegistry.h>
+#include <sq3pp/ThreadPool.h>
+#include <algorithm>
+#include <future>
+#include <thread>
+
+using namespace sq3pp;
+using Clock = std::chrono::steady_clock;
+
+StatementRegistry::Id StatementRegistry::add(const std::string& name, const std::string& sql) {
+    if(_ids.count(name)){
+        throw DatabaseException(SQ3::MISUSE, "Statement already registered: " + name);
+    }
+    Id id = _entries.size();
+    _entries.push_back(Entry{name, sql});
+    _ids.emplace(name, id);
+    return id;
+}
+
+StatementRegistry::Id StatementRegistry::id(const std::string& name) const {
+    auto it = _ids.find(name);
+    if(it == _ids.end()){
+        throw DatabaseException(SQ3::MISUSE, "Statement not registered: " + name);
+    }
+    return it->second;
+}
+
+StatementRegistry::Prepared StatementRegistry::prepareAll(Database& db, const std::shared_ptr<const std::unordered_map<std::string, Id>>& ids,
+                                                          std::vector<Error>& errors, std::vector<std::chrono::microseconds>& durations) const {
+    if(!db.isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot prepare statements: database is not open.");
+    }
+    Prepared prepared;
+    prepared._ids = ids;
+    prepared._statements.resize(_entries.size());
+    durations.assign(_entries.size(), std::chrono::microseconds(0));
+    for(Id id = 0; id < _entries.size(); ++id){
+        Clock::time_point start = Clock::now();
+        // Persistent: these live as long as the connection
+        Statement& stmt = prepared._statements[id];
+        stmt = db.createStatement(_entries[id].sql, SQLITE_PREPARE_PERSISTENT);
+        if(!stmt.isValid()){
+            // A failed prepare leaves its error on the connection
+            int rc = sqlite3_errcode(db.getHandle());
+            if(rc == SQLITE_OK){
+                errors.push_back(Error{id, _entries[id].name, SQ3::MISUSE, "no SQL statement"});
+            }else{
+                errors.push_back(Error{id, _entries[id].name, static_cast<SQ3>(rc), sqlite3_errmsg(db.getHandle())});
+            }
+        }
+        durations[id] = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+    }
+    return prepared;
+}
+
+void StatementRegistry::throwErrors(const std::vector<Error>& errors) const {
+    if(errors.empty()){
+        return;
+    }
+    std::string message = std::to_string(errors.size()) + " statement(s) failed to prepare:";
+    for(const Error& error : errors){
+        message += "\n  " + error.name + ": " + error.message;
+    }
+    throw DatabaseException(errors.front().code, message);
+}
+
+static void fillTimings(StatementRegistry::Timings* timings, Clock::time_point start, std::size_t connections,
+                        const std::vector<std::vector<std::chrono::microseconds>>& durations, std::size_t count) {
+    if(!timings){
+        return;
+    }
+    timings->total = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+    timings->connections = connections;
+    timings->prepare.assign(count, std::chrono::microseconds(0));
+    for(const auto& perConnection : durations){
+        for(std::size_t id = 0; id < count; ++id){
+            timings->prepare[id] = std::max(timings->prepare[id], perConnection[id]);
+        }
+    }
+    timings->first = count > 0 ? timings->prepare[0] : std::chrono::microseconds(0);
+    timings->slowest = 0;
+    for(std::size_t id = 1; id < count; ++id){
+        if(timings->prepare[id] > timings->prepare[timings->slowest]){
+            timings->slowest = id;
+        }
+    }
+}
+
+StatementRegistry::Prepared StatementRegistry::prepare(Database& db, Timings* timings) const {
+    Clock::time_point start = Clock::now();
+    std::vector<Error> errors;
+    std::vector<std::vector<std::chrono::microseconds>> durations(1);
+    Prepared prepared = prepareAll(db, std::make_shared<const std::unordered_map<std::string, Id>>(_ids), errors, durations[0]);
+    throwErrors(errors);
+    fillTimings(timings, start, 1, durations, _entries.size());
+    return prepared;
+}
+
+std::vector<StatementRegistry::Prepared> StatementRegistry::prepare(const std::vector<Database*>& connections,
+                                                                    std::size_t threads, Timings* timings) const {
+    Clock::time_point start = Clock::now();
+    std::vector<Prepared> prepared(connections.size());
+    std::vector<std::vector<Error>> errors(connections.size());
+    std::vector<std::vector<std::chrono::microseconds>> durations(connections.size());
+    // One copy of the names shared by the statements of every connection
+    auto ids = std::make_shared<const std::unordered_map<std::string, Id>>(_ids);
+    {
+        // A connection is only ever used by the task preparing on it
+        ThreadPool pool(std::min(threads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : threads,
+                                 std::max<std::size_t>(1, connections.size())));
+        std::vector<std::future<void>> tasks;
+        for(std::size_t i = 0; i < connections.size(); ++i){
+            tasks.push_back(pool.submit([this, &connections, &ids, &prepared, &errors, &durations, i](){
+                prepared[i] = prepareAll(*connections[i], ids, errors[i], durations[i]);
+            }));
+        }
+        for(std::future<void>& task : tasks){
+            task.wait();
+        }
+        for(std::future<void>& task : tasks){
+            task.get();
+        }
+    }
+
+    // Statements failing on one connection usually fail on all, report each once
+    std::vector<Error> failed;
+    for(const std::vector<Error>& perConnection : errors){
+        for(const Error& error : perConnection){
+            bool seen = std::any_of(failed.begin(), failed.end(), [&error](const Error& other){
+                return other.id == error.id && other.message == error.message;
+            });
+            if(!seen){
+                failed.push_back(error);
+            }
+        }
+    }
+    std::sort(failed.begin(), failed.end(), [](const Error& a, const Error& b){ return a.id < b.id; });
+    throwErrors(failed);
+    fillTimings(timings, start, connections.size(), durations, _entries.size());
+    return prepared;
+}
+
+std::vector<StatementRegistry::Error> StatementRegistry::validate(Database& db) const {
+    std::vector<Error> errors;
+    std::vector<std::chrono::microseconds> durations;
+    prepareAll(db, nullptr, errors, durations);
+    return errors;
+}
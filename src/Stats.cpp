@@ -0,0 +1,196 @@
+#include <sq3pp/Stats.h>
+#include <sq3pp/Exception.h>
+#include <sqlite3.h>
+
+using namespace sq3pp;
+
+static DatabaseStats readStats(sqlite3* handle, bool resetHighwater) {
+    DatabaseStats stats{};
+    int reset = resetHighwater ? 1 : 0;
+    int current = 0;
+    int highwater = 0;
+    auto read = [handle, reset, &current, &highwater](int op) {
+        current = highwater = 0;
+        int rc = sqlite3_db_status(handle, op, &current, &highwater, reset);
+        if(rc != SQLITE_OK){
+            throw DatabaseException(static_cast<SQ3>(rc), sqlite3_errstr(rc));
+        }
+    };
+
+    read(SQLITE_DBSTATUS_CACHE_USED);
+    stats.cacheUsed = current;
+    read(SQLITE_DBSTATUS_CACHE_USED_SHARED);
+    stats.cacheUsedShared = current;
+    read(SQLITE_DBSTATUS_SCHEMA_USED);
+    stats.schemaUsed = current;
+    read(SQLITE_DBSTATUS_STMT_USED);
+    stats.stmtUsed = current;
+    read(SQLITE_DBSTATUS_LOOKASIDE_USED);
+    stats.lookasideUsed = current;
+    stats.lookasideUsedHighwater = highwater;
+
+    // Hit/miss counters are in the current value, lookaside ones in the highwater
+    read(SQLITE_DBSTATUS_CACHE_HIT);
+    stats.cacheHit = current;
+    read(SQLITE_DBSTATUS_CACHE_MISS);
+    stats.cacheMiss = current;
+    read(SQLITE_DBSTATUS_CACHE_WRITE);
+    stats.cacheWrite = current;
+    read(SQLITE_DBSTATUS_CACHE_SPILL);
+    stats.cacheSpill = current;
+    read(SQLITE_DBSTATUS_LOOKASIDE_HIT);
+    stats.lookasideHit = highwater;
+    read(SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE);
+    stats.lookasideMissSize = highwater;
+    read(SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL);
+    stats.lookasideMissFull = highwater;
+    return stats;
+}
+
+DatabaseStats Database::stats(bool resetHighwater) const {
+    if(!isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot read statistics: database is not open.");
+    }
+    return readStats(_handle.get(), resetHighwater);
+}
+
+DatabaseStats DatabaseStats::operator-(const DatabaseStats& earlier) const {
+    DatabaseStats delta = *this;
+    delta.cacheHit -= earlier.cacheHit;
+    delta.cacheMiss -= earlier.cacheMiss;
+    delta.cacheWrite -= earlier.cacheWrite;
+    delta.cacheSpill -= earlier.cacheSpill;
+    delta.lookasideHit -= earlier.lookasideHit;
+    delta.lookasideMissSize -= earlier.lookasideMissSize;
+    delta.lookasideMissFull -= earlier.lookasideMissFull;
+    return delta;
+}
+
+double DatabaseStats::cacheHitRatio() const {
+    int64_t total = cacheHit + cacheMiss;
+    return total > 0 ? static_cast<double>(cacheHit) / static_cast<double>(total) : 0.0;
+}
+
+MemoryStats MemoryStats::operator-(const MemoryStats& earlier) const {
+    // Every field is a gauge or a highwater mark: only the usage moves
+    MemoryStats delta = *this;
+    delta.memoryUsed -= earlier.memoryUsed;
+    delta.mallocCount -= earlier.mallocCount;
+    delta.pageCacheUsed -= earlier.pageCacheUsed;
+    delta.pageCacheOverflow -= earlier.pageCacheOverflow;
+    return delta;
+}
+
+MemoryStats sq3pp::memoryStats(bool resetHighwater) {
+    MemoryStats stats{};
+    int reset = resetHighwater ? 1 : 0;
+    sqlite3_int64 current = 0;
+    sqlite3_int64 highwater = 0;
+
+    sqlite3_status64(SQLITE_STATUS_MEMORY_USED, &current, &highwater, reset);
+    stats.memoryUsed = current;
+    stats.memoryHighwater = highwater;
+    sqlite3_status64(SQLITE_STATUS_MALLOC_COUNT, &current, &highwater, reset);
+    stats.mallocCount = current;
+    stats.mallocCountHighwater = highwater;
+    sqlite3_status64(SQLITE_STATUS_MALLOC_SIZE, &current, &highwater, reset);
+    stats.largestAllocation = highwater;
+    sqlite3_status64(SQLITE_STATUS_PAGECACHE_USED, &current, &highwater, reset);
+    stats.pageCacheUsed = current;
+    sqlite3_status64(SQLITE_STATUS_PAGECACHE_OVERFLOW, &current, &highwater, reset);
+    stats.pageCacheOverflow = current;
+    stats.pageCacheOverflowHighwater = highwater;
+    sqlite3_status64(SQLITE_STATUS_PAGECACHE_SIZE, &current, &highwater, reset);
+    stats.largestPageCacheAllocation = highwater;
+    return stats;
+}
+
+StatsSampler::StatsSampler(Database& db, std::chrono::milliseconds interval, Callback callback)
+    : _handle(db._handle), _interval(interval), _callback(std::move(callback)), _stopping(false) {
+    if(!db.isOpen()){
+        throw DatabaseException(SQ3::NOT_OPEN, "Cannot sample statistics: database is not open.");
+    }
+    // Without a connection mutex the sampler would race with the thread
+    // using the connection
+    if(!sqlite3_db_mutex(db.getHandle())){
+        throw DatabaseException(SQ3::MISUSE, "Cannot sample statistics: the connection is not in serialized threading mode.");
+    }
+    if(_interval.count() <= 0){
+        _interval = std::chrono::milliseconds(1000);
+    }
+    _thread = std::thread(&StatsSampler::run, this);
+}
+
+StatsSampler::~StatsSampler() {
+    stop();
+}
+
+void StatsSampler::stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wakeup.notify_all();
+    if(_thread.joinable()){
+        _thread.join();
+    }
+}
+
+bool StatsSampler::readDatabase(DatabaseStats& stats) {
+    // Keeps the connection open while it is read, even if the Database
+    // closes it meanwhile
+    std::shared_ptr<sqlite3> handle = _handle.lock();
+    if(!handle){
+        fail("Cannot read statistics: database is closed.");
+        return false;
+    }
+    // All counters under one lock, so they form a consistent snapshot
+    sqlite3_mutex* mutex = sqlite3_db_mutex(handle.get());
+    sqlite3_mutex_enter(mutex);
+    try{
+        stats = readStats(handle.get(), false);
+    } catch(const std::exception& e) {
+        sqlite3_mutex_leave(mutex);
+        fail(e.what());
+        return false;
+    }
+    sqlite3_mutex_leave(mutex);
+    return true;
+}
+
+void StatsSampler::run() {
+    DatabaseStats previous;
+    if(!readDatabase(previous)){
+        return;
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    while(!_wakeup.wait_for(lock, _interval, [this]{ return _stopping; })){
+        lock.unlock();
+        Sample sample;
+        sample.memory = memoryStats();
+        if(!readDatabase(sample.database)){
+            return;
+        }
+        sample.databaseDelta = sample.database - previous;
+        sample.time = std::chrono::steady_clock::now();
+        previous = sample.database;
+        try{
+            if(_callback){
+                _callback(sample);
+            }
+        } catch(...) {
+            // Keep sampling, a background thread has nowhere to report to
+        }
+        lock.lock();
+    }
+}
+
+void StatsSampler::fail(const std::string& error) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _error = error;
+}
+
+std::string StatsSampler::error() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _error;
+}
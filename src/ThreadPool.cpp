@@ -0,0 +1,51 @@
+#include <sq3pp/ThreadPool.h>
+
+using namespace sq3pp;
+
+ThreadPool::ThreadPool(std::size_t threads) : _stopping(false) {
+    if(threads == 0){
+        threads = std::thread::hardware_concurrency();
+        if(threads == 0){
+            threads = 1;
+        }
+    }
+    _workers.reserve(threads);
+    for(std::size_t i = 0; i < threads; ++i){
+        _workers.emplace_back(&ThreadPool::run, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wakeup.notify_all();
+    for(std::thread& worker : _workers){
+        worker.join();
+    }
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.push_back(std::move(task));
+    }
+    _wakeup.notify_one();
+}
+
+void ThreadPool::run() {
+    for(;;){
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wakeup.wait(lock, [this]{ return _stopping || !_tasks.empty(); });
+            if(_tasks.empty()){
+                return;
+            }
+            task = std::move(_tasks.front());
+            _tasks.pop_front();
+        }
+        task();
+    }
+}
@@ -1,11 +1,14 @@
 #include <stdexcept>
 #include <sq3pp/Exception.h>
 #include <sq3pp/Transaction.h>
+#include <sq3pp/Snapshot.h>
+#include "ConnectionContext.h"
 
 using namespace sq3pp;
 
-Transaction::Transaction(std::shared_ptr<sqlite3> database) 
-    : _dbHandle(database), _committed(false) {
+Transaction::Transaction(std::shared_ptr<sqlite3> database, std::shared_ptr<detail::ConnectionContext> context,
+                         const Snapshot* snapshot) 
+    : _dbHandle(database), _context(context), _committed(false) {
     if(!_dbHandle) {
         throw DatabaseException(SQ3::NOT_OPEN, "Cannot create transaction: database is not open.");
     }
@@ -16,6 +19,15 @@ Transaction::Transaction(std::shared_ptr<sqlite3> database)
         sqlite3_free(errMsg);
         throw DatabaseException(static_cast<SQ3>(rc), "Failed to begin transaction: " + strMsg);
     }
+    if(snapshot){
+        // Must happen before the transaction reads anything
+        try{
+            snapshot->openOn(_dbHandle.get());
+        } catch(...) {
+            sqlite3_exec(_dbHandle.get(), "ROLLBACK;", nullptr, nullptr, nullptr);
+            throw;
+        }
+    }
 }
 
 Transaction::~Transaction() {
@@ -40,6 +52,9 @@ void Transaction::commit() {
         throw DatabaseException(static_cast<SQ3>(rc), "Failed to commit transaction: " + strMsg);
     }
     _committed = true;
+    if(_context){
+        _context->afterStep();
+    }
 }
 
 void Transaction::rollback() {
@@ -0,0 +1,195 @@
+#include "VfsShim.h"
+
+namespace sq3pp{
+namespace detail{
+
+namespace{
+
+sqlite3_vfs* baseOf(sqlite3_vfs* vfs) {
+    return vfsShimOf(vfs)->base;
+}
+
+int shimDelete(sqlite3_vfs* vfs, const char* name, int syncDir) {
+    return baseOf(vfs)->xDelete(baseOf(vfs), name, syncDir);
+}
+
+int shimAccess(sqlite3_vfs* vfs, const char* name, int flags, int* result) {
+    return baseOf(vfs)->xAccess(baseOf(vfs), name, flags, result);
+}
+
+int shimFullPathname(sqlite3_vfs* vfs, const char* name, int size, char* out) {
+    return baseOf(vfs)->xFullPathname(baseOf(vfs), name, size, out);
+}
+
+void* shimDlOpen(sqlite3_vfs* vfs, const char* name) {
+    return baseOf(vfs)->xDlOpen(baseOf(vfs), name);
+}
+
+void shimDlError(sqlite3_vfs* vfs, int size, char* message) {
+    baseOf(vfs)->xDlError(baseOf(vfs), size, message);
+}
+
+void (*shimDlSym(sqlite3_vfs* vfs, void* library, const char* symbol))(void) {
+    return baseOf(vfs)->xDlSym(baseOf(vfs), library, symbol);
+}
+
+void shimDlClose(sqlite3_vfs* vfs, void* library) {
+    baseOf(vfs)->xDlClose(baseOf(vfs), library);
+}
+
+int shimRandomness(sqlite3_vfs* vfs, int size, char* out) {
+    return baseOf(vfs)->xRandomness(baseOf(vfs), size, out);
+}
+
+int shimSleep(sqlite3_vfs* vfs, int micros) {
+    return baseOf(vfs)->xSleep(baseOf(vfs), micros);
+}
+
+int shimCurrentTime(sqlite3_vfs* vfs, double* now) {
+    return baseOf(vfs)->xCurrentTime(baseOf(vfs), now);
+}
+
+int shimGetLastError(sqlite3_vfs* vfs, int size, char* message) {
+    return baseOf(vfs)->xGetLastError ? baseOf(vfs)->xGetLastError(baseOf(vfs), size, message) : 0;
+}
+
+int shimCurrentTimeInt64(sqlite3_vfs* vfs, sqlite3_int64* now) {
+    return baseOf(vfs)->xCurrentTimeInt64(baseOf(vfs), now);
+}
+
+int shimSetSystemCall(sqlite3_vfs* vfs, const char* name, sqlite3_syscall_ptr call) {
+    return baseOf(vfs)->xSetSystemCall(baseOf(vfs), name, call);
+}
+
+sqlite3_syscall_ptr shimGetSystemCall(sqlite3_vfs* vfs, const char* name) {
+    return baseOf(vfs)->xGetSystemCall(baseOf(vfs), name);
+}
+
+const char* shimNextSystemCall(sqlite3_vfs* vfs, const char* name) {
+    return baseOf(vfs)->xNextSystemCall(baseOf(vfs), name);
+}
+
+}
+
+void initVfsShim(VfsShim& shim, sqlite3_vfs* base, const char* name, int szOsFile,
+                 int (*xOpen)(sqlite3_vfs*, const char*, sqlite3_file*, int, int*)) {
+    shim.base = base;
+    sqlite3_vfs& vfs = shim.vfs;
+    vfs.iVersion = base->iVersion < 3 ? base->iVersion : 3;
+    vfs.szOsFile = szOsFile;
+    vfs.mxPathname = base->mxPathname;
+    vfs.pNext = nullptr;
+    vfs.zName = name;
+    vfs.pAppData = &shim;
+    vfs.xOpen = xOpen;
+    vfs.xDelete = shimDelete;
+    vfs.xAccess = shimAccess;
+    vfs.xFullPathname = shimFullPathname;
+    vfs.xDlOpen = shimDlOpen;
+    vfs.xDlError = shimDlError;
+    vfs.xDlSym = shimDlSym;
+    vfs.xDlClose = shimDlClose;
+    vfs.xRandomness = shimRandomness;
+    vfs.xSleep = shimSleep;
+    vfs.xCurrentTime = shimCurrentTime;
+    vfs.xGetLastError = shimGetLastError;
+    vfs.xCurrentTimeInt64 = base->iVersion >= 2 ? shimCurrentTimeInt64 : nullptr;
+    vfs.xSetSystemCall = base->iVersion >= 3 ? shimSetSystemCall : nullptr;
+    vfs.xGetSystemCall = base->iVersion >= 3 ? shimGetSystemCall : nullptr;
+    vfs.xNextSystemCall = base->iVersion >= 3 ? shimNextSystemCall : nullptr;
+}
+
+int forwardClose(sqlite3_file* file) {
+    sqlite3_file* real = realFile(file);
+    int rc = real->pMethods ? real->pMethods->xClose(real) : SQLITE_OK;
+    file->pMethods = nullptr;
+    return rc;
+}
+
+int forwardRead(sqlite3_file* file, void* buffer, int amount, sqlite3_int64 offset) {
+    sqlite3_file* real = realFile(file);
+    return real->pMethods->xRead(real, buffer, amount, offset);
+}
+
+int forwardWrite(sqlite3_file* file, const void* buffer, int amount, sqlite3_int64 offset) {
+    sqlite3_file* real = realFile(file);
+    return real->pMethods->xWrite(real, buffer, amount, offset);
+}
+
+int forwardTruncate(sqlite3_file* file, sqlite3_int64 size) {
+    sqlite3_file* real = realFile(file);
+    return real->pMethods->xTruncate(real, size);
+}
+
+int forwardSync(sqlite3_file* file, int flags) {
+    sqlite3_file* real = realFile(file);
+    return real->pMethods->xSync(real, flags);
+}
+
+int forwardFileSize(sqlite3_file* file, sqlite3_int64* size) {
+    sqlite3_file* real = realFile(file);
+    return real->pMethods->xFileSize(real, size);
+}
+
+int forwardLock(sqlite3_file* file, int lock) {
+    sqlite3_file* real = realFile(file);
+    return real->pMethods->xLock(real, lock);
+}
+
+int forwardUnlock(sqlite3_file* file, int lock) {
+    sqlite3_file* real = realFile(file);
+    return real->pMethods->xUnlock(real, lock);
+}
+
+int forwardCheckReservedLock(sqlite3_file* file, int* result) {
+    sqlite3_file* real = realFile(file);
+    return real->pMethods->xCheckReservedLock(real, result);
+}
+
+int forwardFileControl(sqlite3_file* file, int op, void* arg) {
+    sqlite3_file* real = realFile(file);
+    return real->pMethods->xFileControl(real, op, arg);
+}
+
+int forwardSectorSize(sqlite3_file* file) {
+    sqlite3_file* real = realFile(file);
+    return real->pMethods->xSectorSize(real);
+}
+
+int forwardDeviceCharacteristics(sqlite3_file* file) {
+    sqlite3_file* real = realFile(file);
+    return real->pMethods->xDeviceCharacteristics(real);
+}
+
+int forwardShmMap(sqlite3_file* file, int region, int size, int extend, void volatile** memory) {
+    sqlite3_file* real = realFile(file);
+    return real->pMethods->xShmMap(real, region, size, extend, memory);
+}
+
+int forwardShmLock(sqlite3_file* file, int offset, int n, int flags) {
+    sqlite3_file* real = realFile(file);
+    return real->pMethods->xShmLock(real, offset, n, flags);
+}
+
+void forwardShmBarrier(sqlite3_file* file) {
+    sqlite3_file* real = realFile(file);
+    real->pMethods->xShmBarrier(real);
+}
+
+int forwardShmUnmap(sqlite3_file* file, int deleteFlag) {
+    sqlite3_file* real = realFile(file);
+    return real->pMethods->xShmUnmap(real, deleteFlag);
+}
+
+int forwardFetch(sqlite3_file* file, sqlite3_int64 offset, int amount, void** page) {
+    sqlite3_file* real = realFile(file);
+    return real->pMethods->xFetch(real, offset, amount, page);
+}
+
+int forwardUnfetch(sqlite3_file* file, sqlite3_int64 offset, void* page) {
+    sqlite3_file* real = realFile(file);
+    return real->pMethods->xUnfetch(real, offset, page);
+}
+
+}
+}
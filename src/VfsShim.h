@@ -0,0 +1,58 @@
+#ifndef SQ3PP_VFSSHIM_H
+#define SQ3PP_VFSSHIM_H
+
+#include <sqlite3.h>
+
+namespace sq3pp{
+namespace detail{
+
+// Building blocks for VFSes that wrap another VFS and only replace some of
+// its methods. pAppData of the registered sqlite3_vfs points to the VfsShim.
+struct VfsShim{
+    sqlite3_vfs vfs;
+    sqlite3_vfs* base;
+};
+
+// Fill shim.vfs with methods forwarding to base; xOpen and szOsFile are the
+// wrapper's own
+void initVfsShim(VfsShim& shim, sqlite3_vfs* base, const char* name, int szOsFile,
+                 int (*xOpen)(sqlite3_vfs*, const char*, sqlite3_file*, int, int*));
+
+inline VfsShim* vfsShimOf(sqlite3_vfs* vfs) {
+    return static_cast<VfsShim*>(vfs->pAppData);
+}
+
+// File object of a wrapper, followed in memory by the base VFS's file object
+// (szOsFile = sizeof(the wrapper's file struct) + base->szOsFile)
+struct ShimFile{
+    sqlite3_file file;
+    sqlite3_file* real;
+};
+
+inline sqlite3_file* realFile(sqlite3_file* file) {
+    return reinterpret_cast<ShimFile*>(file)->real;
+}
+
+// io_methods forwarding to the wrapped file
+int forwardClose(sqlite3_file* file);
+int forwardRead(sqlite3_file* file, void* buffer, int amount, sqlite3_int64 offset);
+int forwardWrite(sqlite3_file* file, const void* buffer, int amount, sqlite3_int64 offset);
+int forwardTruncate(sqlite3_file* file, sqlite3_int64 size);
+int forwardSync(sqlite3_file* file, int flags);
+int forwardFileSize(sqlite3_file* file, sqlite3_int64* size);
+int forwardLock(sqlite3_file* file, int lock);
+int forwardUnlock(sqlite3_file* file, int lock);
+int forwardCheckReservedLock(sqlite3_file* file, int* result);
+int forwardFileControl(sqlite3_file* file, int op, void* arg);
+int forwardSectorSize(sqlite3_file* file);
+int forwardDeviceCharacteristics(sqlite3_file* file);
+int forwardShmMap(sqlite3_file* file, int region, int size, int extend, void volatile** memory);
+int forwardShmLock(sqlite3_file* file, int offset, int n, int flags);
+void forwardShmBarrier(sqlite3_file* file);
+int forwardShmUnmap(sqlite3_file* file, int deleteFlag);
+int forwardFetch(sqlite3_file* file, sqlite3_int64 offset, int amount, void** page);
+int forwardUnfetch(sqlite3_file* file, sqlite3_int64 offset, void* page);
+
+}
+}
+#endif // SQ3PP_VFSSHIM_H